@@ -7,6 +7,7 @@
 #include <SDL3/SDL_main.h>
 
 #include <supernova/core.h>
+#include <supernova/coroutine.h>
 
 class App {
 public:
@@ -26,6 +27,9 @@ public:
 
 	Clock clock;
 	Events events;
+	// Runs the tasks started with executor.spawn(), once per frame before
+	// update()
+	Executor executor;
 
 	EventKeys event_keys;
 	Mouse mouse;
@@ -104,9 +108,11 @@ public:
 
 	void iterate() override {
 		double dt = (fps)? clock.tick(fps) : clock.tick();
+		executor.update(dt);
 		update(dt);
 		draw();
 		reset_input_states();
+		get_frame_arena().reset();
 	}
 
 private:
@@ -0,0 +1,124 @@
+#ifndef SUPERNOVA_ASSET_PACK_H
+#define SUPERNOVA_ASSET_PACK_H
+
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "core.h"
+
+
+
+// Globals
+// Every integer in the pack is stored in little endian
+// Layout: header, index sorted by hash, name table, aligned entry data
+const char ASSET_PACK_MAGIC[4] = {'S', 'N', 'P', 'K'};
+const uint32_t ASSET_PACK_VERSION = 1;
+const size_t ASSET_PACK_HEADER_SIZE = 32;
+const size_t ASSET_PACK_ENTRY_SIZE = 48;
+
+enum ASSET_PACK_FLAGS {
+	ASSET_COMPRESSED = 1
+};
+
+
+
+// Structs
+struct AssetPackEntry {
+	// FNV-1a hash of the name
+	uint64_t hash;
+	uint64_t offset;
+	// The size of the stored data which is smaller than original_size if
+	// the entry is compressed
+	uint64_t size;
+	uint64_t original_size;
+	uint32_t name_offset;
+	uint32_t name_length;
+	uint32_t flags;
+};
+
+
+
+// Classes
+// Builds pack files, used by the supernova_packer tool
+class AssetPackWriter {
+private:
+	struct PendingEntry {
+		string name;
+		std::vector<std::byte> data;
+		bool compress;
+	};
+
+	std::vector<PendingEntry> entries;
+	// The index of every name in entries
+	std::unordered_map<string, size_t> indices;
+
+public:
+	// Names use '/' as the separator and are matched exactly at runtime
+	// Adding a name again replaces the earlier entry
+	void add(const string &name, std::vector<std::byte> data, const bool compress=false);
+	// Returns false if the file couldn't be read
+	bool add_file(const string &file, const string &name, const bool compress=false);
+	// The data of every entry starts at a multiple of alignment, which
+	// should be a power of two
+	// Compressed entries are stored uncompressed if compression doesn't
+	// make them smaller
+	// Returns false if the pack couldn't be written completely, in which
+	// case the file is removed
+	bool save(const string &file, const uint32_t alignment=16);
+};
+
+
+// Serves the entries of a pack file from a single mapping, so the existing
+// loaders can read them through SDL_IOStreams without opening a file each
+class AssetPack {
+private:
+	MappedFile file;
+	std::vector<AssetPackEntry> entries;
+	std::string_view names;
+	bool loaded = false;
+
+	bool load_index();
+
+public:
+	AssetPack(const string &file);
+
+	bool is_loaded() const;
+	// Returns nullptr if the pack has no entry with the name
+	const AssetPackEntry* find(std::string_view name) const;
+	bool contains(std::string_view name) const;
+	std::vector<string> get_names() const;
+	std::string_view get_name(const AssetPackEntry &entry) const;
+	// Returns the stored data without copying, which is only usable as is
+	// for entries which aren't compressed
+	std::span<const std::byte> get_bytes(const AssetPackEntry &entry) const;
+	std::span<const std::byte> get_bytes(std::string_view name) const;
+	// Returns the original data, decompressing it if needed
+	std::vector<std::byte> read(std::string_view name) const;
+	// Returns a read only stream over the entry which can be passed to
+	// functions like IMG_Load_IO, TTF_OpenFontIO or MIX_LoadAudio_IO
+	// Uncompressed entries are served from the mapping, compressed ones
+	// are decompressed into a buffer owned by the stream
+	// The stream must be closed before the pack is destroyed
+	// Returns nullptr if the entry doesn't exist or can't be decompressed
+	SDL_IOStream* open_io(std::string_view name) const;
+};
+
+
+
+// Helper functions
+uint64_t hash_asset_name(std::string_view name);
+// A small LZ77 codec in the style of LZ4 blocks, so the packs don't need an
+// external compression library
+std::vector<std::byte> compress_asset(std::span<const std::byte> data);
+// Returns false if the data is corrupted or doesn't decompress to the
+// exact size of output
+bool decompress_asset(
+	std::span<const std::byte> data,
+	std::span<std::byte> output
+);
+
+#endif /* SUPERNOVA_ASSET_PACK_H */
@@ -0,0 +1,112 @@
+#ifndef SUPERNOVA_ASYNC_IO_H
+#define SUPERNOVA_ASYNC_IO_H
+
+
+#include <cstddef>
+#include <deque>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "core.h"
+
+
+
+// Structs
+struct AsyncIOResult {
+	enum TYPE {
+		READ,
+		WRITE
+	};
+
+	uint64_t id;
+	TYPE type;
+	string file;
+	bool success;
+	// The data which was read, empty for writes
+	managed_ptr<void> buffer = {nullptr, SDL_free};
+	size_t size = 0;
+
+	std::span<const std::byte> get_bytes() const;
+	std::string_view get_view() const;
+};
+
+
+
+// Classes
+// Runs file reads and writes in the background using SDL_AsyncIO
+// Finished requests are collected by calling poll(), usually once per frame
+// Atmost max_in_flight requests are handed to SDL at once, the rest wait
+// in order so that large batches don't flood the I/O threads
+// Writes to the same file run one after another, so the last one wins
+class AsyncIOQueue {
+private:
+	enum STAGE {
+		WAITING,
+		LOADING,
+		TRANSFERRING,
+		CLOSING
+	};
+
+	struct Request {
+		AsyncIOResult::TYPE type;
+		string file;
+		STAGE stage = WAITING;
+		SDL_AsyncIO *asyncio = nullptr;
+		// Only used for reads of a part of the file, size 0 reads all
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		std::vector<std::byte> data;
+		managed_ptr<void> buffer = {nullptr, SDL_free};
+		uint64_t transferred = 0;
+		bool success = true;
+	};
+
+	SDL_AsyncIOQueue *queue;
+	std::unordered_map<uint64_t, Request> requests;
+	std::deque<uint64_t> waiting;
+	// The files with a write in flight
+	std::unordered_set<string> writing;
+	std::vector<AsyncIOResult> finished;
+	uint64_t next_id = 1;
+	int in_flight = 0;
+
+	uint64_t add(Request &&request);
+	void start_waiting();
+	bool start(const uint64_t id, Request &request);
+	void handle(const SDL_AsyncIOOutcome &outcome);
+	void finish(const uint64_t id, Request &request);
+
+public:
+	int max_in_flight;
+
+	AsyncIOQueue(const int max_in_flight=8);
+	AsyncIOQueue(const AsyncIOQueue&) = delete;
+	// Blocks until every request is finished
+	~AsyncIOQueue();
+
+	AsyncIOQueue& operator=(const AsyncIOQueue&) = delete;
+
+	// All the functions return an ID which identifies the result
+	// Reads the whole file
+	uint64_t read(const string &file);
+	// Reads size bytes starting at offset, e.g. a chunk of a large file
+	uint64_t read(const string &file, const uint64_t offset, const uint64_t size);
+	std::vector<uint64_t> read(const std::vector<string> &files);
+	// The data is written to a temporary file which replaces the file
+	// after it was flushed, so a failed write keeps the old contents
+	uint64_t write(const string &file, std::vector<std::byte> data);
+	uint64_t write(const string &file, const string &data);
+
+	// Returns the requests which finished since the last call without
+	// blocking
+	std::vector<AsyncIOResult> poll();
+	// Blocks until every request is finished and returns them
+	std::vector<AsyncIOResult> wait_all();
+	// The number of requests which haven't been returned by poll() yet
+	int get_pending() const;
+};
+
+#endif /* SUPERNOVA_ASYNC_IO_H */
@@ -0,0 +1,226 @@
+#ifndef SUPERNOVA_BINARY_LOG_H
+#define SUPERNOVA_BINARY_LOG_H
+
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "buffered_io.h"
+#include "core.h"
+#include "logging.h"
+
+
+
+// Writes a message to the binary log without formatting it
+// The format string is checked at compile time and stored in the log once,
+// every message only stores its id and the raw arguments
+// Like the FLOG_* macros, the arguments are only evaluated if the level is
+// enabled and the binary log is open
+#define SUPERNOVA_BLOG(level, category, fmt, ...) \
+	do { \
+		if constexpr (is_log_compiled(level, category)) { \
+			if ((get_log_state(category) & level) && is_binary_logging()) { \
+				static const uint32_t supernova_blog_id = register_binary_log_format(fmt); \
+				write_binary_log(level, category, supernova_blog_id, fmt __VA_OPT__(,) __VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+
+#define BLOG_INFO(category, ...) SUPERNOVA_BLOG(INFO, category, __VA_ARGS__)
+#define BLOG_WARN(category, ...) SUPERNOVA_BLOG(WARN, category, __VA_ARGS__)
+#define BLOG_ERROR(category, ...) SUPERNOVA_BLOG(ERROR, category, __VA_ARGS__)
+
+
+
+// Globals
+// Every integer in the log is stored in little endian
+// Layout: header, then records which start with their size and type
+// A record size of 0 marks the end, since the file is mapped in chunks
+const char BINARY_LOG_MAGIC[4] = {'S', 'N', 'B', 'L'};
+const uint32_t BINARY_LOG_VERSION = 1;
+const size_t BINARY_LOG_HEADER_SIZE = 16;
+// Size, type, id and format string
+const size_t BINARY_LOG_FORMAT_HEADER_SIZE = 9;
+// Size, type, level, category, format id and time
+const size_t BINARY_LOG_MESSAGE_HEADER_SIZE = 19;
+// Used for the messages from BinaryLogSink, which stores formatted text
+const uint32_t BINARY_LOG_TEXT_FORMAT = 0;
+
+enum BINARY_LOG_RECORD {
+	BINARY_LOG_FORMAT = 1,
+	BINARY_LOG_MESSAGE = 2
+};
+
+// Every argument starts with its type
+enum BINARY_LOG_ARG {
+	BINARY_LOG_INT = 1,
+	BINARY_LOG_UINT,
+	BINARY_LOG_FLOAT,
+	BINARY_LOG_BOOL,
+	BINARY_LOG_CHAR,
+	BINARY_LOG_STRING,
+	BINARY_LOG_POINTER
+};
+
+
+
+// Structs
+struct BinaryLogMessage {
+	LOGLEVEL level;
+	LOGCATEGORY category;
+	// In nanoseconds since SDL was initialized
+	uint64_t time;
+	uint32_t format_id;
+	std::string_view format;
+	// The encoded arguments, which are decoded by format_binary_log_message
+	std::span<const std::byte> args;
+};
+
+
+
+// Classes
+// Writes every text message into the binary log while it's open, so that
+// the normal log calls end up in the same file as the BLOG_* macros
+class BinaryLogSink: public LogSink {
+public:
+	void write(
+		const LOGLEVEL level,
+		const LOGCATEGORY category,
+		const uint64_t time,
+		std::string_view message
+	) override;
+};
+
+
+// Reads the messages of a binary log, used by the supernova_logdecode tool
+class BinaryLogReader {
+private:
+	MappedFile file;
+	std::vector<std::string_view> formats;
+	size_t pos = BINARY_LOG_HEADER_SIZE;
+	bool loaded = false;
+
+public:
+	BinaryLogReader(const string &file);
+
+	bool is_loaded() const;
+	// Returns false at the end of the log
+	// The message points into the file, so it's valid while the reader is
+	bool next(BinaryLogMessage &message);
+};
+
+
+
+// Helper functions
+template<typename T>
+void encode_binary_log_value(std::byte *&ptr, const T value) {
+	const T swapped = swap_le(value);
+	memcpy(ptr, &swapped, sizeof(T));
+	ptr += sizeof(T);
+}
+
+template<typename T>
+std::string_view get_binary_log_text(const T &arg) {
+	static_assert(std::is_convertible_v<const T&, std::string_view>, "Only numbers, pointers and strings can be logged");
+	if constexpr (std::is_pointer_v<T>) {
+		if (arg == nullptr)
+			return "(null)";
+	}
+
+	return arg;
+}
+
+template<typename T>
+size_t get_binary_log_arg_size(const T &arg) {
+	using Type = std::decay_t<T>;
+	if constexpr (std::is_same_v<Type, bool> || std::is_same_v<Type, char>)
+		return 1 + 1;
+	else if constexpr (std::is_arithmetic_v<Type> || std::is_enum_v<Type>)
+		return 1 + 8;
+	else if constexpr (std::is_pointer_v<Type> && !std::is_convertible_v<Type, std::string_view>)
+		return 1 + 8;
+	else
+		return 1 + 4 + get_binary_log_text<Type>(arg).size();
+}
+
+template<typename T>
+void encode_binary_log_arg(std::byte *&ptr, const T &arg) {
+	using Type = std::decay_t<T>;
+	if constexpr (std::is_same_v<Type, bool>) {
+		*ptr++ = std::byte(BINARY_LOG_BOOL);
+		*ptr++ = std::byte(arg);
+	} else if constexpr (std::is_same_v<Type, char>) {
+		*ptr++ = std::byte(BINARY_LOG_CHAR);
+		*ptr++ = std::byte(arg);
+	} else if constexpr (std::is_floating_point_v<Type>) {
+		*ptr++ = std::byte(BINARY_LOG_FLOAT);
+		encode_binary_log_value<double>(ptr, arg);
+	} else if constexpr (std::is_enum_v<Type> || std::is_signed_v<Type>) {
+		*ptr++ = std::byte(BINARY_LOG_INT);
+		encode_binary_log_value<int64_t>(ptr, static_cast<int64_t>(arg));
+	} else if constexpr (std::is_unsigned_v<Type>) {
+		*ptr++ = std::byte(BINARY_LOG_UINT);
+		encode_binary_log_value<uint64_t>(ptr, arg);
+	} else if constexpr (std::is_pointer_v<Type> && !std::is_convertible_v<Type, std::string_view>) {
+		*ptr++ = std::byte(BINARY_LOG_POINTER);
+		encode_binary_log_value<uint64_t>(ptr, reinterpret_cast<uintptr_t>(arg));
+	} else {
+		const std::string_view text = get_binary_log_text<Type>(arg);
+		*ptr++ = std::byte(BINARY_LOG_STRING);
+		encode_binary_log_value<uint32_t>(ptr, text.size());
+		memcpy(ptr, text.data(), text.size());
+		ptr += text.size();
+	}
+}
+
+
+
+// Functions
+// Maps the file and starts writing to it, closing the previous log
+// The file grows in chunks of chunk_size and is truncated when closed
+// Messages written before a crash stay in the file where it's mapped
+bool open_binary_log(const string &file, const size_t chunk_size=4*1024*1024);
+void close_binary_log();
+bool is_binary_logging();
+
+// Returns the id of the format string and stores it in the open log
+// The BLOG_* macros call this once for every call site
+uint32_t register_binary_log_format(std::string_view format);
+// Appends the encoded arguments with a message header, threads only contend
+// on an atomic reservation into the mapping until it has to grow
+void write_binary_log_record(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	const uint32_t format_id,
+	const uint64_t time,
+	std::span<const std::byte> args
+);
+// Returns a buffer of the calling thread to encode the arguments into
+std::vector<std::byte>& get_binary_log_buffer();
+
+// Reconstructs the text of a message
+// Returns false if the arguments don't match the format string
+bool format_binary_log_message(const BinaryLogMessage &message, std::string &output);
+
+
+template<typename ...A>
+void write_binary_log(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	const uint32_t format_id,
+	[[maybe_unused]] std::format_string<A...> fmt,
+	const A&... args
+) {
+	// The format string is only passed to be checked at compile time
+	std::vector<std::byte> &buffer = get_binary_log_buffer();
+	buffer.resize((get_binary_log_arg_size(args) + ... + 0));
+
+	std::byte *ptr = buffer.data();
+	(encode_binary_log_arg(ptr, args), ...);
+	write_binary_log_record(level, category, format_id, SDL_GetTicksNS(), buffer);
+}
+
+#endif /* SUPERNOVA_BINARY_LOG_H */
@@ -0,0 +1,145 @@
+#ifndef SUPERNOVA_BUFFERED_IO_H
+#define SUPERNOVA_BUFFERED_IO_H
+
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "core.h"
+
+
+
+// Globals
+const size_t DEFAULT_IO_BUFFER_SIZE = 64*1024;
+
+
+
+// Helper functions
+// Converts between little endian and the native byte order
+template<typename T>
+T swap_le(T value) {
+	static_assert(std::is_arithmetic_v<T>, "Only arithmetic types can be swapped");
+	if constexpr (std::endian::native == std::endian::big) {
+		std::byte bytes[sizeof(T)];
+		memcpy(bytes, &value, sizeof(T));
+		std::reverse(bytes, bytes + sizeof(T));
+		memcpy(&value, bytes, sizeof(T));
+	}
+
+	return value;
+}
+
+
+
+// Classes
+// Reads an IO in large blocks so that small reads and line reads don't go
+// through SDL for every call
+class BufferedReader {
+private:
+	std::unique_ptr<IO> owned_io;
+	IO *io;
+	std::vector<char> buffer;
+	size_t start = 0;
+	size_t end = 0;
+	bool eof = false;
+
+	// Moves the unread data to the front and reads more after it
+	// Returns false if nothing more could be read
+	bool fill();
+
+public:
+	// The IO must outlive the reader
+	BufferedReader(IO &io, const size_t buffer_size=DEFAULT_IO_BUFFER_SIZE);
+	BufferedReader(const string &file, const size_t buffer_size=DEFAULT_IO_BUFFER_SIZE);
+
+	// Returns false at the end of the file
+	// The line doesn't contain the line ending and points into the buffer,
+	// so it's only valid until the next read
+	// The buffer grows if a line doesn't fit in it
+	bool read_line(std::string_view &line);
+	// Returns the number of bytes read
+	size_t read(void *ptr, const size_t size);
+	// Reads a little endian value, returns false at the end of the file
+	template<typename T>
+	bool read_le(T &value) {
+		if (read(&value, sizeof(T)) != sizeof(T))
+			return false;
+		value = swap_le(value);
+		return true;
+	}
+	bool is_eof() const;
+};
+
+
+// Collects small writes and passes them to the IO in large blocks
+class BufferedWriter {
+private:
+	std::unique_ptr<IO> owned_io;
+	IO *io;
+	std::vector<char> buffer;
+	size_t size = 0;
+
+public:
+	// The IO must outlive the writer
+	BufferedWriter(IO &io, const size_t buffer_size=DEFAULT_IO_BUFFER_SIZE);
+	BufferedWriter(const string &file, const size_t buffer_size=DEFAULT_IO_BUFFER_SIZE);
+	BufferedWriter(const BufferedWriter&) = delete;
+	// Flushes the buffer
+	~BufferedWriter();
+
+	BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+	void write(const void *ptr, const size_t size);
+	void write(std::string_view data);
+	// Appends a '\n' after the line
+	void write_line(std::string_view line);
+	template<typename T>
+	void write_le(const T value) {
+		const T swapped = swap_le(value);
+		write(&swapped, sizeof(T));
+	}
+	// Passes the buffered data to the IO
+	void flush();
+};
+
+
+// Splits text into fields without allocating
+// The tokens are views into the text
+class Tokenizer {
+private:
+	std::string_view text;
+	size_t pos = 0;
+	char delimiter;
+
+public:
+	// A delimiter of ' ' splits on any whitespace and skips empty fields
+	// Any other delimiter splits CSV style, keeping empty fields, and a
+	// field in double quotes can contain the delimiter
+	// Doubled quotes inside a quoted field are not unescaped
+	Tokenizer(std::string_view text, const char delimiter=' ');
+
+	// Returns false if there are no more tokens
+	bool next(std::string_view &token);
+	// Parses the next token as a number
+	// Returns false if there are no more tokens or the token isn't a number
+	template<typename T>
+	bool next(T &value) {
+		static_assert(std::is_arithmetic_v<T>, "Only numbers can be parsed");
+		std::string_view token;
+		if (!next(token))
+			return false;
+
+		const auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+		return result.ec == std::errc() && result.ptr == token.data() + token.size();
+	}
+	// Returns the text which hasn't been tokenized yet
+	std::string_view get_remaining() const;
+};
+
+#endif /* SUPERNOVA_BUFFERED_IO_H */
@@ -0,0 +1,157 @@
+#ifndef SUPERNOVA_CAMERA_H
+#define SUPERNOVA_CAMERA_H
+
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core.h"
+
+
+
+// Structs
+struct CameraPipelineStats {
+	// Frames converted into the ring
+	uint64_t captured = 0;
+	// Frames handed out by acquire_frame()
+	uint64_t delivered = 0;
+	// Frames which were replaced by a newer one before being acquired
+	uint64_t dropped = 0;
+	// Time taken by the last conversion in nanoseconds
+	uint64_t conversion_ns = 0;
+};
+
+
+
+// Classes
+// Frame sources are polled from the pipeline's worker thread
+class FrameSource {
+public:
+	virtual ~FrameSource() = default;
+
+	virtual IVector get_size() = 0;
+	// Returns nullptr if a new frame isn't available
+	// Otherwise the frame stays valid until release_frame()
+	virtual Surface* acquire_frame(uint64_t &time_stamp) = 0;
+	virtual void release_frame() = 0;
+};
+
+
+class CameraSource: public FrameSource {
+public:
+	Camera camera;
+
+	CameraSource(const int id=0);
+
+	IVector get_size() override;
+	Surface* acquire_frame(uint64_t &time_stamp) override;
+	void release_frame() override;
+};
+
+
+// Produces frames at a fixed rate by calling generator with the surface
+// and the frame index, useful for testing without a camera
+class SyntheticSource: public FrameSource {
+private:
+	Surface frame;
+	uint64_t frame_ns;
+	uint64_t next_ns = 0;
+	uint64_t index = 0;
+
+public:
+	typedef std::function<void(Surface&, uint64_t)> Generator;
+
+	Generator generator;
+
+	// The default generator draws a bar moving over a background whose
+	// colour cycles
+	SyntheticSource(
+		const IVector &size,
+		const float fps=30,
+		Generator generator=nullptr,
+		const SDL_PixelFormat format=SDL_PIXELFORMAT_RGBA32
+	);
+
+	IVector get_size() override;
+	Surface* acquire_frame(uint64_t &time_stamp) override;
+	void release_frame() override;
+};
+
+
+// Plays a sequence of image files in a loop at a fixed rate
+class FileSource: public FrameSource {
+private:
+	std::vector<Surface> frames;
+	uint64_t frame_ns;
+	uint64_t next_ns = 0;
+	size_t index = 0;
+
+public:
+	FileSource(const std::vector<string> &files, const float fps=30);
+
+	IVector get_size() override;
+	Surface* acquire_frame(uint64_t &time_stamp) override;
+	void release_frame() override;
+};
+
+
+// Captures frames from a source on a worker thread and converts them into
+// a ring of preallocated surfaces
+// Only the latest converted frame is kept for the render thread, older
+// ones which weren't acquired are counted as dropped
+class CameraPipeline {
+private:
+	std::unique_ptr<FrameSource> source;
+	std::vector<Surface> frames;
+	std::vector<uint64_t> time_stamps;
+	IVector size;
+	// Slot indices, latest is -1 until the first frame arrives and the
+	// first slot is handed out blank until then
+	int latest = -1;
+	int reading = 0;
+	bool fresh = false;
+	mutable std::mutex mutex;
+	std::atomic<bool> running = true;
+	CameraPipelineStats stats;
+	std::thread worker;
+
+	int get_free_slot() const;
+	void capture_loop();
+
+public:
+	SDL_PixelFormat format;
+	// The time stamp of the acquired frame
+	uint64_t time_stamp = 0;
+
+	// ring_size is clamped to atleast 3 so that the worker always has a
+	// slot which is neither the latest frame nor the one being read
+	CameraPipeline(
+		std::unique_ptr<FrameSource> source,
+		const SDL_PixelFormat format=SDL_PIXELFORMAT_RGBA32,
+		const int ring_size=3
+	);
+	// Converts into the preferred texture format of the renderer
+	CameraPipeline(
+		std::unique_ptr<FrameSource> source,
+		Renderer &renderer,
+		const int ring_size=3
+	);
+	CameraPipeline(const CameraPipeline&) = delete;
+	~CameraPipeline();
+
+	CameraPipeline& operator=(const CameraPipeline&) = delete;
+
+	IVector get_size() const;
+	// This function must be called before acquire_frame()
+	// Otherwise acquire_frame() will keep returning the old frame
+	bool is_new_frame_available();
+	// The frame stays valid until the next call to is_new_frame_available()
+	const Surface& acquire_frame();
+	CameraPipelineStats get_stats() const;
+};
+
+#endif /* SUPERNOVA_CAMERA_H */
@@ -7,6 +7,9 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <memory_resource>
+#include <span>
+#include <string_view>
 
 #include <SDL3/SDL.h>
 
@@ -24,6 +27,10 @@ struct EngineArgs;
 class Mouse;
 class Surface;
 class Texture;
+class CollisionMask;
+class FrameArena;
+class Camera2D;
+class Renderer;
 
 
 
@@ -48,6 +55,10 @@ template<typename T> using managed_ptr = std::unique_ptr<T, void(*)(T*)>;
 
 
 // General functions
+// Returns the arena for the data which is only needed during the current
+// frame, see FrameArena
+FrameArena& get_frame_arena();
+
 #ifdef __ANDROID__
 void trigger_back_button();
 
@@ -85,6 +96,7 @@ struct Colour {
 	friend Colour operator*(const Colour &colour, const float &val);
 	friend void operator*=(Colour &colour1, const Colour &colour2);
 	friend void operator/=(Colour &colour, const float val);
+	friend bool operator==(const Colour &colour1, const Colour &colour2);
 
 	operator FColour() const;
 	operator SDL_Color() const;
@@ -329,6 +341,22 @@ struct Finger {
 typedef std::unordered_map<SDL_FingerID, Finger> Fingers;
 
 
+// Writable pixels of a locked texture area
+struct PixelView {
+	uint8_t *pixels = nullptr;
+	// The pitch of the whole texture, the rows of the area are row_bytes long
+	int pitch = 0;
+	int row_bytes = 0;
+	IRect rect = {0, 0, 0, 0};
+
+	// Returns false if nothing was locked
+	explicit operator bool() const;
+
+	// y is relative to the locked area
+	std::span<uint8_t> get_row(const int y) const;
+};
+
+
 struct EventArgs {
 	EventKeys *event_keys = nullptr;
 	Mouse *mouse = nullptr;
@@ -340,7 +368,12 @@ struct EventArgs {
 // Classes
 class Engine {
 public:
-	Engine(const unsigned int init_flags=SDL_INIT_VIDEO|SDL_INIT_EVENTS|SDL_INIT_AUDIO);
+	// Headless engines use the offscreen video driver, the software renderer
+	// and the dummy audio driver, so they run without a display or a GPU
+	Engine(
+		const unsigned int init_flags=SDL_INIT_VIDEO|SDL_INIT_EVENTS|SDL_INIT_AUDIO,
+		const bool headless=false
+	);
 	~Engine();
 };
 
@@ -401,9 +434,14 @@ public:
 	// Returns the number of objects read or -1 on error
 	int read(void *ptr, const int max);
 	// Reads the whole file at once to a string
+	// Returns an empty string on error
 	string read();
 	// Reads the next max number of chars from the file to a string
 	string read(const int max);
+	// Same as above but the string is allocated from the resource, e.g.
+	// the frame arena for data which is only needed during the frame
+	std::pmr::string read(std::pmr::memory_resource *resource);
+	std::pmr::string read(const int max, std::pmr::memory_resource *resource);
 	// The size parameter takes the size of the object to read in bytes
 	// and the num parameter takes the number of objects to write
 	// Returns the numer of objects written
@@ -417,6 +455,81 @@ public:
 };
 
 
+// Read only view of a whole file without copying it
+// The file is memory mapped where supported, otherwise it is loaded with
+// SDL_LoadFile (e.g. for Android assets)
+class MappedFile {
+private:
+	const std::byte *data = nullptr;
+	size_t length = 0;
+	bool loaded = false;
+	bool mapped = false;
+
+	void unload();
+
+public:
+	MappedFile(const string &file);
+	MappedFile(MappedFile &&file);
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile();
+
+	MappedFile& operator=(MappedFile &&file);
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool is_loaded() const;
+	size_t size() const;
+	std::span<const std::byte> get_bytes() const;
+	std::string_view get_view() const;
+	// Returns a read only stream over the mapped memory which can be passed
+	// to functions like IMG_Load_IO, TTF_OpenFontIO or MIX_LoadAudio_IO
+	// The stream must be closed before the file is destroyed
+	SDL_IOStream* open_io() const;
+};
+
+
+// Bump allocator for data which is only needed during one frame, like
+// vertices which are passed straight to SDL
+// Deallocating does nothing, everything is released at once by reset(),
+// which Renderer::present() and SApp::iterate() call
+// Any std::pmr container can use it, e.g.
+// std::pmr::vector<Vector> points(&get_frame_arena());
+// It isn't thread safe and is only meant for the main thread
+class FrameArena: public std::pmr::memory_resource {
+private:
+	struct Block {
+		std::unique_ptr<std::byte[]> data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t block_size;
+	size_t current = 0;
+	size_t offset = 0;
+	size_t used = 0;
+	size_t peak = 0;
+
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void*, size_t, size_t) override {}
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+public:
+	FrameArena(const size_t block_size=64*1024);
+	FrameArena(const FrameArena&) = delete;
+
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// Invalidates everything which was allocated from the arena
+	// If a frame needed more than one block, they are replaced by a single
+	// block large enough for the whole frame
+	void reset();
+	// The number of bytes allocated since the last reset
+	size_t get_used() const;
+	size_t get_capacity() const;
+	// The most bytes used in a single frame
+	size_t get_peak() const;
+};
+
+
 class Window {
 public:
 	managed_ptr<SDL_Window> window;
@@ -439,14 +552,196 @@ public:
 };
 
 
+// Draws recorded as plain data, the vertices, texture handles and sort keys,
+// without calling SDL, so worker threads can fill their own buffers at the
+// same time and RenderQueue::submit() them on the main thread
+// The camera and the textures are only read and mustn't change while a
+// buffer is being filled
+// Only the handles of the textures are recorded, so they have to outlive
+// the next RenderQueue::flush() or present() after the buffer is submitted
+class RenderCommandBuffer {
+private:
+	friend class RenderQueue;
+
+	struct Command {
+		Texture *texture;
+		SDL_Texture *target;
+		SDL_BlendMode blend_mode;
+		SDL_FColor colour;
+		SDL_FPoint positions[4];
+		SDL_FPoint tex_coords[4];
+	};
+
+	std::vector<Command> commands;
+	std::vector<uint64_t> keys;
+	const Camera2D *camera = nullptr;
+	SDL_Texture *target = nullptr;
+	SDL_BlendMode blend_mode = SDL_BLENDMODE_BLEND;
+	int pass = 0;
+
+	void add(
+		Command &command,
+		const Rect &dst_rect,
+		const float angle,
+		const int layer,
+		const float depth,
+		const int texture_id
+	);
+	void set_target(SDL_Texture *target);
+
+public:
+	// Layers are drawn in increasing order from 0 to 255, inside a layer
+	// smaller depths are drawn first for the same blend mode and texture
+	// The angle is in degrees clockwise around the center of dst_rect
+	void draw(
+		Texture &texture,
+		const Rect &dst_rect,
+		const Rect &src_rect,
+		const int layer=0,
+		const float depth=0,
+		const float angle=0,
+		const FColour &colour={1, 1, 1, 1},
+		const SDL_FlipMode flip=SDL_FLIP_NONE
+	);
+	void fill_rect(
+		const Rect &rect,
+		const FColour &colour,
+		const int layer=0,
+		const float depth=0
+	);
+	// The draws recorded after these calls use them, the camera can be
+	// nullptr for screen coordinates and the target starts as the window
+	void set_camera(const Camera2D *camera);
+	void set_target(Texture &target);
+	void set_target();
+	void set_blend_mode(const SDL_BlendMode blend_mode);
+	// The number of recorded draws
+	size_t size() const;
+	void clear();
+};
+
+
+// Records draws and executes them sorted by a 64 bit key at present(), so
+// that draws issued in logical order are still batched by texture
+// The key is made of, from the highest bits, the render target pass, the
+// layer, the blend mode, the texture and the depth. Draws with the same
+// key keep the order they were issued in
+// Consecutive draws with the same target, texture and blend mode become a
+// single SDL_RenderGeometry call and render state is only set when it
+// changes, the blend mode of a queued texture is set to the one of its draws
+// Queued draws are executed after everything drawn directly
+// Queued textures have to outlive the next flush() or present()
+class RenderQueue {
+private:
+	Renderer &renderer;
+	RenderCommandBuffer buffer;
+	// Shared by every quad of a batch
+	std::vector<int> indices;
+	// Reused by record_parallel()
+	std::vector<std::unique_ptr<RenderCommandBuffer>> free_buffers;
+	int draw_calls = 0, state_changes = 0;
+
+	void sort(std::vector<uint32_t> &order);
+
+public:
+	RenderQueue(Renderer &renderer);
+
+	// Same as RenderCommandBuffer::draw() with the current camera and render
+	// target of the renderer
+	void draw(
+		Texture &texture,
+		const Rect &dst_rect,
+		const Rect &src_rect,
+		const int layer=0,
+		const float depth=0,
+		const float angle=0,
+		const FColour &colour={1, 1, 1, 1},
+		const SDL_FlipMode flip=SDL_FLIP_NONE
+	);
+	void fill_rect(
+		const Rect &rect,
+		const FColour &colour,
+		const int layer=0,
+		const float depth=0
+	);
+	// Used by the draws recorded after it
+	void set_blend_mode(const SDL_BlendMode blend_mode);
+	// Moves the draws of the buffer into the queue, it's left empty
+	// Has to be called from the main thread
+	void submit(RenderCommandBuffer &buffer);
+	// Calls func(buffer, band_begin, band_end) for bands of [begin, end) in
+	// parallel, every band fills its own buffer which starts with the
+	// current camera and render target of the renderer
+	// The buffers are submitted in the order of the bands after all of them
+	// are finished
+	void record_parallel(
+		const int begin,
+		const int end,
+		const std::function<void(RenderCommandBuffer&, int, int)> &func,
+		const int min_band=256
+	);
+	// The number of recorded draws
+	size_t size() const;
+	// Executes and clears the recorded draws
+	void flush();
+	// Statistics of the last flush, the state changes only count the ones
+	// which reached SDL
+	int get_draw_calls() const;
+	int get_state_changes() const;
+};
+
+
+// The work a frame gave to SDL, see Renderer::get_stats()
+struct RenderStats {
+	int draw_calls = 0;
+	int vertices = 0;
+	// Draws using another texture than the previous textured draw
+	int texture_binds = 0;
+	int target_switches = 0;
+	int state_changes = 0;
+	int skipped_state_changes = 0;
+	// Draw calls of SpriteBatch and RenderQueue and the quads drawn by them
+	int batches = 0;
+	int batched_quads = 0;
+};
+
+
 class Renderer {
+private:
+	friend class Texture;
+
+	const Camera2D *camera = nullptr;
+	// The state last set through the renderer, SDL is only called when it
+	// changes. Unknown state is read back from SDL when it's needed
+	// The clip rect and the scale belong to the render target in SDL, so
+	// they become unknown when the target changes
+	Colour colour = {0, 0, 0, 0};
+	SDL_BlendMode blend_mode = SDL_BLENDMODE_NONE;
+	SDL_Texture *target = nullptr;
+	SDL_Rect clip_rect = {0, 0, 0, 0};
+	bool clip_enabled = false;
+	Vector scale = {1, 1};
+	bool colour_known = false, blend_mode_known = false, target_known = false;
+	bool clip_known = false, scale_known = false;
+	int issued_state_changes = 0, skipped_state_changes = 0;
+	RenderStats frame_stats, last_stats;
+	SDL_Texture *last_texture = nullptr;
+
+	// Counts the state change and returns whether it has to reach SDL
+	bool count_state_change(const bool changed);
+
 public:
 	managed_ptr<SDL_Renderer> renderer;
+	// Flushed by present()
+	RenderQueue queue;
 
 	Renderer(
 		Window &window,
 		const string &driver=""
 	);
+	// Software renderer drawing into the surface, which has to outlive it
+	// Doesn't need a window or the video subsystem
+	Renderer(Surface &surface);
 
 	void static destroy(SDL_Renderer *renderer);
 	void set_colour(const Colour &colour);
@@ -454,8 +749,44 @@ public:
 	void present();
 	void flush();
 	void set_blend_mode(const SDL_BlendMode blend_mode);
+	SDL_BlendMode get_blend_mode();
 	void set_target(); // Resets the render target to the window
 	void set_target(Texture &tex);
+	// nullptr is the window
+	void set_target(SDL_Texture *target);
+	SDL_Texture* get_target();
+	void set_clip_rect(const IRect &rect);
+	void reset_clip_rect(); // Disables clipping
+	// Returns false if clipping is disabled
+	bool get_clip_rect(IRect &rect);
+	void set_scale(const Vector &scale);
+	Vector get_scale();
+	// Has to be called after changing the state of the renderer with SDL
+	// functions directly, the next changes are then always issued
+	void invalidate_state();
+	// The state changes of the renderer and its textures which reached SDL
+	// and the ones which were skipped because nothing changed
+	int get_issued_state_changes() const;
+	int get_skipped_state_changes() const;
+	void reset_state_changes();
+	// The statistics of the last presented frame
+	const RenderStats& get_stats() const;
+	// Used by every draw function, draws made with SDL directly can be
+	// counted with them too
+	void count_draw(
+		SDL_Texture *texture,
+		const int vertices,
+		const int draw_calls=1
+	);
+	void count_batch(const int quads);
+	// Textures and sprite batches are drawn in the world coordinates of the
+	// camera and culled against its view, the other draw functions still
+	// use screen coordinates
+	// The camera has to stay valid until it's reset, drawing isn't clipped
+	// to its viewport
+	void set_camera(const Camera2D &camera);
+	void reset_camera();
+	const Camera2D* get_camera() const;
 	void set_logical_presentation(
 		const IVector &size,
 		const SDL_RendererLogicalPresentation
@@ -463,6 +794,9 @@ public:
 	);
 	IVector get_output_size();
 	string get_driver_name();
+	// Returns the first texture format supported by the renderer, which
+	// doesn't need a conversion while uploading
+	SDL_PixelFormat get_preferred_format();
 	void draw_point_raw(const Vector &point_pos);
 	void draw_point(const Vector &point_pos, const Colour &colour);
 	void draw_line_raw(const Vector &v1, const Vector &v2);
@@ -570,6 +904,8 @@ public:
 	managed_ptr<SDL_Surface> surface;
 	int w, h;
 
+	// Creates an invalid surface without any pixels
+	Surface();
 	Surface(
 		const IVector &size,
 		const SDL_PixelFormat format=SDL_PIXELFORMAT_RGBA8888
@@ -584,7 +920,15 @@ public:
 	void set_blend_mode(const SDL_BlendMode blend_mode);
 	void set_colour_key(const uint32_t key, const bool enable=true);
 	void flip(const SDL_FlipMode flip_mode);
+	// The conversions and blits are split into row bands across threads
+	// for large surfaces, unless the surfaces have palettes or colour keys
+	// The converted surface keeps the blend mode, colour and alpha mods
 	Surface convert_format(const SDL_PixelFormat format);
+	// Converts the pixels into dst using the format of dst, reusing its
+	// buffer instead of allocating a new surface
+	// Only the pixels change, indexed pixels use the palette of dst
+	// Both the surfaces should have the same size
+	void convert_format(Surface &dst) const;
 	void convert_format_ip(const SDL_PixelFormat format);
 	void blit(Surface &dst_surface, const IVector &ivec);
 	void blit(Surface &dst_surface, const IRect &dst_rect);
@@ -593,6 +937,25 @@ public:
 		const IRect &dst_rect,
 		const IRect &src_rect
 	);
+	// The pixel operations below only work on 32 bit pixel formats and
+	// are vectorised and split across threads for large surfaces
+	void fill(const Colour &colour);
+	void fill_rect(const IRect &rect, const Colour &colour);
+	// Blends the src surface over this surface using the alpha of src
+	// The src surface is converted to the format of this surface if needed
+	void blend(const Surface &src, const IVector &pos);
+	void premultiply();
+	void unpremultiply();
+	// Multiplies every channel with the respective channel of the colour
+	void modulate(const Colour &colour);
+	void greyscale();
+	void box_blur(const int radius);
+	// Approximated by three successive box blurs
+	void gaussian_blur(const float sigma);
+	Surface scale(
+		const IVector &size,
+		const SDL_ScaleMode mode=SDL_SCALEMODE_LINEAR
+	) const;
 	// This function saves the surface as png
 	void save(const string &file);
 	// This function saves the surface as jpg
@@ -601,12 +964,91 @@ public:
 };
 
 
+// Stores a 1 bit per pixel mask packed into 64 bit words per row so that
+// two masks can be tested against each other a word at a time
+class CollisionMask {
+private:
+	// Number of 64 bit words used by every row
+	int stride = 0;
+	std::vector<uint64_t> bits;
+	IRect bounds = {0, 0, 0, 0};
+
+	uint64_t get_word(const int row, const int bit) const;
+	void update_bounds();
+
+public:
+	int w = 0, h = 0;
+
+	CollisionMask() {};
+	CollisionMask(const IVector &size, const bool filled=false);
+	// Pixels with an alpha greater than the threshold are set
+	// If the surface has a colour key then the keyed pixels are unset
+	// The parts of src_rect outside the surface are unset
+	CollisionMask(const Surface &surface, const uint8_t threshold=127);
+	CollisionMask(
+		const Surface &surface,
+		const IRect &src_rect,
+		const uint8_t threshold=127
+	);
+
+	// Creates a mask for every cell of a columns x rows grid inside
+	// src_rect in row major order while converting the surface only once
+	static std::vector<CollisionMask> from_grid(
+		const Surface &surface,
+		const IRect &src_rect,
+		const int columns,
+		const int rows,
+		const uint8_t threshold=127
+	);
+
+	IVector size() const;
+	bool get_at(const IVector &pos) const;
+	void set_at(const IVector &pos, const bool val=true);
+	void fill();
+	void clear();
+	// Returns the number of set pixels
+	int count() const;
+	// Returns the smallest rect containing all the set pixels
+	// The rect is only shrunk when the mask is rebuilt, so after
+	// set_at(pos, false) it may be larger than necessary
+	IRect get_bounding_rect() const;
+
+	// The offset is the position of the top left corner of the other
+	// mask relative to the top left corner of this mask
+	bool overlap(const CollisionMask &mask, const IVector &offset) const;
+	// Returns the number of pixels set in both masks
+	int overlap_area(const CollisionMask &mask, const IVector &offset) const;
+	// Returns false if the masks don't overlap, otherwise stores the
+	// average position of the overlapping pixels in this mask's
+	// coordinates in centroid
+	bool overlap_centroid(
+		const CollisionMask &mask,
+		const IVector &offset,
+		Vector &centroid
+	) const;
+};
+
+
 class Texture {
+private:
+	// The state last set through the texture, SDL is only called when it
+	// changes
+	// Textures created from surfaces start with the mods of the surface, so
+	// the first colour mod is always set
+	Colour colour_mod = {255, 255, 255, 255};
+	bool colour_mod_known = false;
+	SDL_BlendMode blend_mode = SDL_BLENDMODE_INVALID;
+	SDL_ScaleMode scale_mode = SDL_SCALEMODE_LINEAR;
+	bool scale_mode_known = false;
+
+	bool count_state_change(const bool changed);
+
 public:
-	int id;
+	// Unique for every texture which was created successfully, -1 otherwise
+	int id = -1;
 	managed_ptr<SDL_Texture> texture;
-	Renderer *tex_renderer;
-	int w, h;
+	Renderer *tex_renderer = nullptr;
+	int w = 0, h = 0;
 
 	Texture(Renderer &renderer, SDL_Texture *_texture);
 	Texture(Texture &&_texture);
@@ -618,6 +1060,9 @@ public:
 		const SDL_PixelFormat format=SDL_PIXELFORMAT_RGBA32,
 		const SDL_TextureAccess access=SDL_TEXTUREACCESS_TARGET
 	);
+	// SDL falls back to the window when the current render target is
+	// destroyed, so the target state of the renderer becomes unknown
+	~Texture();
 
 	// Also updates the w and h member variables
 	IVector get_size();
@@ -627,6 +1072,8 @@ public:
 
 	void set_colour_mod(const Colour &colour);
 	void set_blend_mode(const SDL_BlendMode blend_mode);
+	void set_scale_mode(const SDL_ScaleMode scale_mode);
+	SDL_ScaleMode get_scale_mode();
 	void update(const void *pixels, const int pitch);
 	void update(const void *pixels, const int pitch, const IRect &rect);
 	void update(const Surface &surface);
@@ -650,6 +1097,122 @@ public:
 };
 
 
+// Streaming textures whose pixels are written straight into the buffer SDL
+// uploads from, without an intermediate copy
+// With double buffering the producer writes into the texture which isn't
+// being drawn, so locking doesn't have to wait for pending draw calls
+class StreamingTexture {
+private:
+	int front = 0;
+	bool locked = false;
+	// The changed areas which each texture hasn't received yet
+	IRect pending[2] = {{0, 0, 0, 0}, {0, 0, 0, 0}};
+
+	int get_back() const;
+
+public:
+	std::vector<Texture> textures;
+	SDL_PixelFormat format;
+	int w, h;
+
+	StreamingTexture(
+		Renderer &renderer,
+		const IVector &size,
+		const SDL_PixelFormat format=SDL_PIXELFORMAT_RGBA32,
+		const bool double_buffered=true
+	);
+
+	// Marks an area which will be written on the next lock
+	void mark_dirty(const IRect &rect);
+	void mark_dirty();
+	// Locks the changed areas of the back texture, only these areas are
+	// uploaded on unlock
+	// Every pixel in the returned rect has to be written, it may be larger
+	// than the marked areas when double buffered
+	// Returns an empty view if nothing has changed
+	PixelView lock();
+	PixelView lock(const IRect &rect);
+	// Returns a surface using the locked pixels, it must not be used
+	// after unlock()
+	// Returns an invalid surface if nothing has changed
+	Surface lock_surface();
+	// Uploads the locked area and makes the back texture the front one
+	void unlock();
+	// Returns the texture which should be drawn
+	Texture& get_texture();
+};
+
+
+// Maps world coordinates to the viewport, the position is the world point at
+// the center of the viewport and the rotation is in degrees clockwise
+// Use Renderer::set_camera() to draw textures and sprite batches through it
+class Camera2D {
+private:
+	Vector position = {0, 0};
+	float zoom = 1;
+	float rotation = 0;
+	Rect viewport;
+	// Cached by update()
+	float cos_rot = 1, sin_rot = 0;
+	Rect view_rect;
+
+	void update();
+
+public:
+	Camera2D(const Rect &viewport);
+
+	void set_position(const Vector &position);
+	Vector get_position() const;
+	void move(const Vector &offset);
+	void set_zoom(const float zoom);
+	float get_zoom() const;
+	void set_rotation(const float rotation);
+	float get_rotation() const;
+	void set_viewport(const Rect &viewport);
+	const Rect& get_viewport() const;
+
+	Vector world_to_screen(const Vector &pos) const;
+	Vector screen_to_world(const Vector &pos) const;
+	// The smallest world rect containing everything inside the viewport
+	const Rect& get_view_rect() const;
+	// AABB test against the view rect
+	bool is_visible(const Rect &rect) const;
+	bool is_visible(const Circle &circle) const;
+};
+
+// Collects textured quads which use the same texture and draws all of them
+// with a single SDL_RenderGeometry call
+// When the renderer has a camera the quads are transformed and culled as
+// they're added
+class SpriteBatch {
+private:
+	Texture *texture;
+	std::vector<SDL_Vertex> vertices;
+	// Shared by every quad, only grown when more quads are added
+	std::vector<int> indices;
+
+public:
+	SpriteBatch(Texture &texture, const size_t capacity=0);
+
+	// Renders the current quads first if the texture changes
+	void set_texture(Texture &texture);
+	Texture& get_texture();
+	void add(const Rect &dst_rect, const IRect &src_rect);
+	void add(
+		const Rect &dst_rect,
+		const IRect &src_rect,
+		const FColour &colour,
+		const SDL_FlipMode flip=SDL_FLIP_NONE
+	);
+	// The number of quads
+	size_t size() const;
+	void clear();
+	// Draws the quads and keeps them, flush() also clears them
+	void render();
+	void flush();
+};
+
+
 class Camera {
 private:
 	SDL_Surface *surface;
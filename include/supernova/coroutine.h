@@ -0,0 +1,284 @@
+#ifndef SUPERNOVA_COROUTINE_H
+#define SUPERNOVA_COROUTINE_H
+
+
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "core.h"
+#include "threading.h"
+#include "timer_scheduler.h"
+
+
+
+// Globals
+// Coroutine frames up to this size are reused instead of freed
+const size_t TASK_FRAME_POOL_LIMIT = 1024;
+
+
+
+// Forward Declarations
+class Executor;
+struct TaskPromise;
+
+
+
+// Helper functions
+// Allocators of the pooled coroutine frames
+void* allocate_task_frame(const size_t size);
+void free_task_frame(void *ptr, const size_t size);
+
+
+
+// Structs
+// Thread safe list of coroutines which are resumed by the executor, used by
+// awaitables which complete on other threads
+struct TaskQueue {
+	std::mutex mutex;
+	std::vector<std::coroutine_handle<>> handles;
+
+	void push(const std::coroutine_handle<> handle);
+};
+
+
+
+// Classes
+// A coroutine which is started by Executor::spawn() or by awaiting it from
+// another task, in which case the caller continues after it finished
+// Tasks can only be resumed on the thread which updates their executor
+class Task {
+public:
+	using promise_type = TaskPromise;
+
+	Task(std::coroutine_handle<TaskPromise> handle);
+	Task(Task &&task);
+	Task(const Task&) = delete;
+	~Task();
+
+	Task& operator=(Task &&task);
+	Task& operator=(const Task&) = delete;
+
+	// Gives up the ownership of the coroutine
+	std::coroutine_handle<TaskPromise> release();
+	bool is_done() const;
+
+	struct Awaiter {
+		std::coroutine_handle<TaskPromise> handle;
+
+		bool await_ready() const {
+			return !handle || handle.done();
+		}
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<TaskPromise> caller);
+		void await_resume() {}
+	};
+
+	Awaiter operator co_await() {
+		return {handle};
+	}
+
+private:
+	std::coroutine_handle<TaskPromise> handle;
+};
+
+
+struct TaskPromise {
+	Executor *executor = nullptr;
+	// The task awaiting this one
+	std::coroutine_handle<> continuation;
+	// Position in the list of spawned tasks of the executor
+	size_t root_index = SIZE_MAX;
+
+	struct FinalAwaiter {
+		bool await_ready() noexcept {
+			return false;
+		}
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<TaskPromise> handle) noexcept;
+		void await_resume() noexcept {}
+	};
+
+	static void* operator new(const size_t size) {
+		return allocate_task_frame(size);
+	}
+	static void operator delete(void *ptr, const size_t size) {
+		free_task_frame(ptr, size);
+	}
+
+	Task get_return_object() {
+		return Task(std::coroutine_handle<TaskPromise>::from_promise(*this));
+	}
+	std::suspend_always initial_suspend() noexcept {
+		return {};
+	}
+	FinalAwaiter final_suspend() noexcept {
+		return {};
+	}
+	void return_void() {}
+	void unhandled_exception() {
+		std::terminate();
+	}
+};
+
+
+// Resumes tasks once the thing they wait for happened, update() should be
+// called once per frame from the main thread, SApp does that by itself
+class Executor {
+private:
+	struct Condition {
+		std::coroutine_handle<> handle;
+		std::function<bool()> condition;
+	};
+
+	std::vector<std::coroutine_handle<TaskPromise>> tasks;
+	std::vector<std::coroutine_handle<>> ready, next_frame;
+	std::vector<Condition> conditions;
+	std::shared_ptr<TaskQueue> jobs = std::make_shared<TaskQueue>();
+	TimerScheduler timers;
+
+	void resume_ready();
+
+public:
+	Executor() = default;
+	Executor(const Executor&) = delete;
+	~Executor();
+
+	Executor& operator=(const Executor&) = delete;
+
+	// Starts the task right away, it runs until its first suspension
+	void spawn(Task task);
+	void update(const double dt);
+	// Destroys all the tasks which haven't finished yet
+	void clear();
+	// The number of spawned tasks which haven't finished
+	size_t size() const;
+
+	// Used by the awaitables, each handle is resumed exactly once
+	void resume_next_frame(const std::coroutine_handle<> handle);
+	void resume_after(const double seconds, const std::coroutine_handle<> handle);
+	// The condition is checked once per update
+	void resume_when(std::function<bool()> condition, const std::coroutine_handle<> handle);
+	// Handles pushed to the queue are resumed on the next update, the queue
+	// stays valid after the executor is cleared or destroyed
+	std::shared_ptr<TaskQueue> get_job_queue() const;
+	// Called when a spawned task finished
+	void finish(const std::coroutine_handle<TaskPromise> handle);
+};
+
+
+
+// Awaitables
+struct NextFrameAwaitable {
+	bool await_ready() const {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<TaskPromise> handle) {
+		handle.promise().executor->resume_next_frame(handle);
+	}
+	void await_resume() {}
+};
+
+
+struct SecondsAwaitable {
+	double seconds;
+
+	bool await_ready() const {
+		return seconds <= 0;
+	}
+	void await_suspend(std::coroutine_handle<TaskPromise> handle) {
+		handle.promise().executor->resume_after(seconds, handle);
+	}
+	void await_resume() {}
+};
+
+
+struct ConditionAwaitable {
+	std::function<bool()> condition;
+
+	bool await_ready() {
+		return condition();
+	}
+	void await_suspend(std::coroutine_handle<TaskPromise> handle) {
+		handle.promise().executor->resume_when(std::move(condition), handle);
+	}
+	void await_resume() {}
+};
+
+
+// Runs the job on the thread pool and returns its result to the task
+template<typename T>
+struct JobAwaitable {
+	// void results are stored as a bool
+	using Result = std::conditional_t<std::is_void_v<T>, bool, T>;
+
+	std::function<T()> job;
+	ThreadPool &pool;
+	// Shared with the job so that it can finish after the task is destroyed
+	std::shared_ptr<std::optional<Result>> result = std::make_shared<std::optional<Result>>();
+
+	bool await_ready() const {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<TaskPromise> handle) {
+		pool.submit([job=std::move(job), result=result, queue=handle.promise().executor->get_job_queue(), handle]() {
+			if constexpr (std::is_void_v<T>) {
+				job();
+				result->emplace(true);
+			} else
+				result->emplace(job());
+			queue->push(handle);
+		});
+	}
+	T await_resume() {
+		if constexpr (!std::is_void_v<T>)
+			return std::move(**result);
+	}
+};
+
+
+// Resumes once the state of the socket is the given one or DEAD, works with
+// anything which has a get_state() like StreamSocket and DatagramSocket
+template<typename Socket>
+struct SocketStateAwaitable {
+	Socket &socket;
+	typename Socket::State state;
+
+	bool is_reached() {
+		const typename Socket::State current = socket.get_state();
+		return current == state || current == Socket::DEAD;
+	}
+	bool await_ready() {
+		return is_reached();
+	}
+	void await_suspend(std::coroutine_handle<TaskPromise> handle) {
+		handle.promise().executor->resume_when([this]() {
+			return is_reached();
+		}, handle);
+	}
+	// Returns the state which was reached
+	typename Socket::State await_resume() {
+		return socket.state;
+	}
+};
+
+
+
+// Functions
+NextFrameAwaitable next_frame();
+SecondsAwaitable wait_seconds(const double seconds);
+ConditionAwaitable wait_until(std::function<bool()> condition);
+
+template<typename Func>
+JobAwaitable<std::invoke_result_t<Func>> wait_for_job(Func job, ThreadPool &pool=ThreadPool::get_global()) {
+	return {std::move(job), pool};
+}
+
+template<typename Socket>
+SocketStateAwaitable<Socket> wait_for_state(Socket &socket, const typename Socket::State state) {
+	return {socket, state};
+}
+
+#endif /* SUPERNOVA_COROUTINE_H */
@@ -0,0 +1,432 @@
+#ifndef SUPERNOVA_ECS_H
+#define SUPERNOVA_ECS_H
+
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core.h"
+#include "threading.h"
+
+
+
+// Globals
+// Entities with the same components are stored together in chunks of this
+// size, with one array per component
+const size_t ECS_CHUNK_SIZE = 16*1024;
+const size_t ECS_CHUNK_ALIGNMENT = 64;
+const size_t MAX_COMPONENTS = 128;
+
+
+
+// Typedefs
+typedef std::bitset<MAX_COMPONENTS> ComponentMask;
+
+
+
+// Structs
+struct Entity {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	friend bool operator==(const Entity &entity1, const Entity &entity2) = default;
+
+	// False for default constructed entities
+	explicit operator bool() const {
+		return index != UINT32_MAX;
+	}
+};
+
+
+struct ComponentInfo {
+	size_t size;
+	size_t alignment;
+	// Trivially copyable components are moved with memcpy
+	bool trivial;
+	// Move constructs dst from src and destroys src
+	void (*move)(void *dst, void *src);
+	void (*destroy)(void *ptr);
+};
+
+
+// Built in components, used by the built in systems
+struct Position: Vector {
+	Position() = default;
+	Position(const float x, const float y): Vector{x, y} {}
+	Position(const Vector &vec): Vector(vec) {}
+};
+
+
+// In units per second
+struct Velocity: Vector {
+	Velocity() = default;
+	Velocity(const float x, const float y): Vector{x, y} {}
+	Velocity(const Vector &vec): Vector(vec) {}
+};
+
+
+// Follows the Position of the entity with its top left corner
+struct Bounds: Rect {
+	using Rect::Rect;
+	Bounds(const Rect &rect): Rect(rect) {}
+};
+
+
+struct ArchetypeChunk {
+	std::byte *data;
+	size_t count = 0;
+
+	ArchetypeChunk(const size_t size);
+	ArchetypeChunk(const ArchetypeChunk&) = delete;
+	~ArchetypeChunk();
+
+	ArchetypeChunk& operator=(const ArchetypeChunk&) = delete;
+};
+
+
+// Stores every entity which has exactly the same components
+// Each chunk starts with the array of entities followed by one array per
+// component, so a query walks contiguous arrays
+// Rows are dense, every chunk except the last one is full
+struct Archetype {
+	ComponentMask mask;
+	// Sorted component ids
+	std::vector<uint32_t> components;
+	// The offsets of the component arrays in a chunk
+	std::vector<size_t> offsets;
+	size_t chunk_size;
+	size_t chunk_capacity;
+	size_t size = 0;
+	std::vector<std::unique_ptr<ArchetypeChunk>> chunks;
+	// The archetypes reached by adding or removing a component
+	std::unordered_map<uint32_t, Archetype*> add_edges, remove_edges;
+
+	Archetype(const ComponentMask &mask);
+
+	// Returns the index of the component in components or -1
+	int get_column(const uint32_t id) const;
+	Entity* get_entities(ArchetypeChunk &chunk) const;
+	void* get_component(const size_t row, const int column) const;
+	template<typename T>
+	T* get_array(ArchetypeChunk &chunk, const int column) const {
+		return reinterpret_cast<T*>(chunk.data + offsets[column]);
+	}
+};
+
+
+
+// Helper functions
+// Returns the id of a new component type, use get_component_id() instead
+uint32_t register_component(const ComponentInfo &info);
+const ComponentInfo& get_component_info(const uint32_t id);
+
+template<typename T>
+uint32_t get_component_id() {
+	using Type = std::remove_cvref_t<T>;
+	static_assert(alignof(Type) <= ECS_CHUNK_ALIGNMENT, "The component alignment is too large");
+	static_assert(std::is_move_constructible_v<Type>, "Components must be move constructible");
+
+	// const T has the same id as T
+	if constexpr (!std::is_same_v<T, Type>)
+		return get_component_id<Type>();
+	else {
+		static const uint32_t id = register_component({
+			sizeof(Type),
+			alignof(Type),
+			std::is_trivially_copyable_v<Type>,
+			[](void *dst, void *src) {
+				Type *component = static_cast<Type*>(src);
+				new (dst) Type(std::move(*component));
+				component->~Type();
+			},
+			[](void *ptr) {
+				static_cast<Type*>(ptr)->~Type();
+			}
+		});
+
+		return id;
+	}
+}
+
+template<typename ...T>
+ComponentMask get_component_mask() {
+	ComponentMask mask;
+	(mask.set(get_component_id<T>()), ...);
+	return mask;
+}
+
+template<typename T, typename ...Rest>
+constexpr bool are_components_unique() {
+	if constexpr (sizeof...(Rest) == 0)
+		return true;
+	else
+		return (!std::is_same_v<std::remove_cvref_t<T>, std::remove_cvref_t<Rest>> && ...) && are_components_unique<Rest...>();
+}
+
+
+
+// Classes
+// Stores entities and their components by archetype
+// Structural changes (creating, destroying, adding or removing components)
+// made while the world is iterated are deferred until the iteration ends,
+// the handle of a deferred entity is valid right away
+class World {
+private:
+	struct EntityRecord {
+		Archetype *archetype = nullptr;
+		size_t row = 0;
+		uint32_t generation = 0;
+		bool alive = false;
+	};
+
+	// Type erased so that move only components can be deferred as well
+	struct DeferredChange {
+		virtual ~DeferredChange() = default;
+		virtual void apply() = 0;
+	};
+
+	template<typename F>
+	struct DeferredFunction: DeferredChange {
+		F func;
+
+		DeferredFunction(F &&func): func(std::move(func)) {}
+		void apply() override {
+			func();
+		}
+	};
+
+	struct QueryCache {
+		std::vector<Archetype*> archetypes;
+		size_t checked = 0;
+	};
+
+	std::vector<std::unique_ptr<Archetype>> archetypes;
+	std::unordered_map<ComponentMask, Archetype*> archetype_map;
+	std::unordered_map<ComponentMask, QueryCache> queries;
+	std::vector<EntityRecord> records;
+	std::vector<uint32_t> free_indices;
+	size_t alive_count = 0;
+
+	std::atomic<int> iterating = 0;
+	std::mutex deferred_mutex;
+	std::vector<std::unique_ptr<DeferredChange>> deferred;
+	std::vector<std::function<void(World&, double)>> systems;
+
+	Archetype* get_archetype(const ComponentMask &mask);
+	Archetype* get_add_edge(Archetype *archetype, const uint32_t id);
+	Archetype* get_remove_edge(Archetype *archetype, const uint32_t id);
+	const std::vector<Archetype*>& get_matching(const ComponentMask &mask);
+	Entity reserve_entity();
+	size_t allocate_row(Archetype &archetype, const Entity entity);
+	// Fills the row with the last one, the components of the row are
+	// destroyed first unless they were already moved out
+	void remove_row(Archetype &archetype, const size_t row, const bool destroy_components=true);
+	// Moves the components which the target archetype has as well
+	void move_entity(const Entity entity, Archetype *target);
+	void begin_iteration();
+	void end_iteration();
+
+	template<typename F>
+	void defer(F &&change) {
+		std::lock_guard<std::mutex> lock(deferred_mutex);
+		deferred.push_back(std::make_unique<DeferredFunction<std::decay_t<F>>>(std::forward<F>(change)));
+	}
+
+	template<typename T>
+	void construct(Archetype &archetype, const size_t row, T &&component) {
+		using Type = std::remove_cvref_t<T>;
+		void *ptr = archetype.get_component(row, archetype.get_column(get_component_id<Type>()));
+		new (ptr) Type(std::forward<T>(component));
+	}
+
+	// Puts a reserved entity into its archetype
+	template<typename ...T>
+	void place(const Entity entity, T&&... components) {
+		Archetype *archetype = get_archetype(get_component_mask<T...>());
+		const size_t row = allocate_row(*archetype, entity);
+		(construct(*archetype, row, std::forward<T>(components)), ...);
+		records[entity.index].archetype = archetype;
+		records[entity.index].row = row;
+	}
+
+	template<typename F, typename ...T>
+	void call_for_chunk(F &func, Archetype &archetype, ArchetypeChunk &chunk) {
+		Entity *entities = archetype.get_entities(chunk);
+		std::tuple<T*...> arrays = {archetype.get_array<std::remove_cvref_t<T>>(chunk, archetype.get_column(get_component_id<T>()))...};
+		const size_t count = chunk.count;
+		for (size_t i = 0; i < count; i++) {
+			if constexpr (std::is_invocable_v<F&, Entity, T&...>)
+				func(entities[i], std::get<T*>(arrays)[i]...);
+			else
+				func(std::get<T*>(arrays)[i]...);
+		}
+	}
+
+public:
+	World() = default;
+	World(const World&) = delete;
+	~World();
+
+	World& operator=(const World&) = delete;
+
+	template<typename ...T>
+	Entity create(T&&... components) {
+		if constexpr (sizeof...(T) > 1)
+			static_assert(are_components_unique<T...>(), "An entity can't have the same component twice");
+
+		const Entity entity = reserve_entity();
+		if (is_deferring()) {
+			defer([this, entity, components = std::make_tuple(std::forward<T>(components)...)]() mutable {
+				std::apply([this, entity](auto&&... args) {
+					place(entity, std::move(args)...);
+				}, std::move(components));
+			});
+		} else
+			place(entity, std::forward<T>(components)...);
+
+		return entity;
+	}
+
+	void destroy(const Entity entity);
+	bool is_alive(const Entity entity) const;
+	// The number of alive entities
+	size_t size() const;
+
+	// Replaces the component if the entity already has it
+	template<typename T>
+	void add(const Entity entity, T &&component) {
+		using Type = std::remove_cvref_t<T>;
+		if (is_deferring()) {
+			defer([this, entity, component = Type(std::forward<T>(component))]() mutable {
+				add(entity, std::move(component));
+			});
+			return;
+		}
+		if (!is_alive(entity))
+			return;
+
+		if (Type *current = get<Type>(entity)) {
+			*current = std::forward<T>(component);
+			return;
+		}
+
+		Archetype *target = get_add_edge(records[entity.index].archetype, get_component_id<Type>());
+		move_entity(entity, target);
+		construct(*target, records[entity.index].row, std::forward<T>(component));
+	}
+
+	template<typename T>
+	void remove(const Entity entity) {
+		if (is_deferring()) {
+			defer([this, entity]() {
+				remove<T>(entity);
+			});
+			return;
+		}
+		if (!has<T>(entity))
+			return;
+
+		move_entity(entity, get_remove_edge(records[entity.index].archetype, get_component_id<T>()));
+	}
+
+	template<typename T>
+	bool has(const Entity entity) const {
+		if (!is_alive(entity) || records[entity.index].archetype == nullptr)
+			return false;
+		return records[entity.index].archetype->mask.test(get_component_id<T>());
+	}
+
+	// Returns nullptr if the entity doesn't have the component
+	// The pointer is invalidated by structural changes
+	template<typename T>
+	T* get(const Entity entity) {
+		if (!has<T>(entity))
+			return nullptr;
+
+		const EntityRecord &record = records[entity.index];
+		return static_cast<T*>(record.archetype->get_component(record.row, record.archetype->get_column(get_component_id<T>())));
+	}
+
+	// Calls func(T&...) or func(Entity, T&...) for every entity which has
+	// all the components
+	template<typename ...T, typename F>
+	void each(F &&func) {
+		const std::vector<Archetype*> &matching = get_matching(get_component_mask<T...>());
+		begin_iteration();
+		for (size_t i = 0; i < matching.size(); i++) {
+			Archetype &archetype = *matching[i];
+			for (auto &chunk: archetype.chunks)
+				call_for_chunk<F, T...>(func, archetype, *chunk);
+		}
+		end_iteration();
+	}
+
+	// Calls func(count, Entity*, T*...) with the arrays of every chunk, for
+	// loops which the compiler should vectorize
+	template<typename ...T, typename F>
+	void each_chunk(F &&func) {
+		const std::vector<Archetype*> &matching = get_matching(get_component_mask<T...>());
+		begin_iteration();
+		for (size_t i = 0; i < matching.size(); i++) {
+			Archetype &archetype = *matching[i];
+			for (auto &chunk: archetype.chunks) {
+				if (chunk->count > 0)
+					func(chunk->count, archetype.get_entities(*chunk), archetype.get_array<std::remove_cvref_t<T>>(*chunk, archetype.get_column(get_component_id<T>()))...);
+			}
+		}
+		end_iteration();
+	}
+
+	// Same as each() but the chunks are split over the thread pool
+	// The function must only access the components it's called with,
+	// structural changes are deferred and thread safe
+	template<typename ...T, typename F>
+	void each_parallel(F &&func, ThreadPool &pool=ThreadPool::get_global()) {
+		const std::vector<Archetype*> &matching = get_matching(get_component_mask<T...>());
+		std::vector<std::pair<Archetype*, ArchetypeChunk*>> chunks;
+		for (Archetype *archetype: matching) {
+			for (auto &chunk: archetype->chunks)
+				chunks.emplace_back(archetype, chunk.get());
+		}
+
+		begin_iteration();
+		pool.parallel_for(0, chunks.size(), [&](const int begin, const int end) {
+			for (int i = begin; i < end; i++)
+				call_for_chunk<F, T...>(func, *chunks[i].first, *chunks[i].second);
+		});
+		end_iteration();
+	}
+
+	// True while the world is iterated, structural changes are deferred
+	bool is_deferring() const;
+	// Applies the deferred changes, called automatically after iterating
+	void flush();
+
+	// Systems run in the order they were added
+	void add_system(std::function<void(World&, double)> system);
+	void run_systems(const double dt);
+};
+
+
+
+// Functions
+// Built in systems
+// Moves every entity with a Position and a Velocity
+void update_movement(World &world, const double dt);
+// Moves the Bounds of every entity with a Position to it
+void update_bounds(World &world);
+// Updates every Timer component, on_timeout is called for the timers which
+// finished and they are reset
+void update_timers(World &world, const double dt, const std::function<void(Entity, Timer&)> &on_timeout={});
+
+#endif /* SUPERNOVA_ECS_H */
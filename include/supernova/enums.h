@@ -33,6 +33,26 @@ enum LOGLEVEL {
 };
 
 
+// What happens when a log buffer is full
+enum LOGOVERFLOW {
+	LOG_DROP,
+	LOG_BLOCK
+};
+
+
+// Which part of the engine a log message comes from
+enum LOGCATEGORY {
+	LOG_APP,
+	LOG_CORE,
+	LOG_RENDER,
+	LOG_AUDIO,
+	LOG_FONT,
+	LOG_NET,
+	LOG_IO,
+	LOG_CATEGORY_COUNT
+};
+
+
 
 // Typedefs
 typedef MOUSEBUTTON MB;
@@ -101,6 +101,38 @@ public:
 };
 
 
+// Shows the statistics of the last frame over everything else, a graph of
+// the recent frame times, the draw calls, batches and state changes of the
+// renderer and the memory used by the frame arena
+// The HUD's own draws are included in the statistics
+class PerformanceHUD {
+private:
+	FontAtlas &atlas;
+	// Frame times in ms, used as a ring buffer
+	std::vector<float> frame_times;
+	size_t next = 0;
+	bool visible = true;
+	SDL_Keycode toggle_key;
+
+public:
+	PerformanceHUD(
+		FontAtlas &atlas,
+		const SDL_Keycode toggle_key=SDLK_F3,
+		const int history=120
+	);
+
+	// dt is the frame time in seconds, call it once per frame
+	void update(const double dt);
+	// Toggles the HUD when the toggle key is pressed
+	void process_event(const SDL_Event &event);
+	void set_visible(const bool visible);
+	bool is_visible() const;
+	// Flushes the render queue first so that the HUD is drawn on top, call
+	// it right before Renderer::present()
+	void draw(const IVector &pos={8, 8});
+};
+
+
 class TextEngine {
 public:
 	Renderer &renderer;
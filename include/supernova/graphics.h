@@ -7,6 +7,73 @@
 
 
 #include "core.h"
+#include "coroutine.h"
+#include "ecs.h"
+
+
+
+// Globals
+// Width and height of the chunks of a TileMap in tiles
+const int TILEMAP_CHUNK_SIZE = 16;
+const int EMPTY_TILE = -1;
+// Returned by AnimationSystem::add_instance() for an invalid clip
+const uint32_t INVALID_ANIMATION_INSTANCE = UINT32_MAX;
+
+
+
+// Forward Declarations
+class AnimatedSprite;
+class SpriteSheet;
+
+
+
+// Structs
+// Marks a frame of an AnimationClip, reaching it reports the id
+struct ClipEvent {
+	int frame;
+	int id;
+};
+
+
+// An event which was reached by an instance of an AnimationSystem
+struct AnimationEvent {
+	uint32_t instance;
+	int id;
+};
+
+
+// Animation data shared by every instance which plays it
+// The source rects of the frames are computed once from the sprite sheet
+struct AnimationClip {
+	std::vector<IRect> frames;
+	// Seconds per frame
+	std::vector<float> durations;
+	std::vector<ClipEvent> events;
+	bool loop = true;
+
+	AnimationClip() {};
+	// Uses count tiles of the sheet starting at first in row major order
+	AnimationClip(
+		const SpriteSheet &sheet,
+		const int first,
+		const int count,
+		const float frame_duration,
+		const bool loop=true
+	);
+
+	// Total length in seconds
+	float get_duration() const;
+};
+
+
+// Animation state of an entity, so that many entities can share one
+// AnimatedSprite whose speed and loop settings are used
+struct SpriteAnimation {
+	AnimatedSprite *sprite = nullptr;
+	double animation_index = 0;
+	// Set once an animation which doesn't loop reached its last tile
+	bool finished = false;
+};
 
 
 
@@ -16,6 +83,8 @@ public:
 	int tile_x, tile_y, tile_w, tile_h, total_tiles;
 	IRect src_rect;
 	Texture texture;
+	// One mask per tile in row major order, empty until create_masks()
+	std::vector<CollisionMask> masks;
 
 	SpriteSheet(
 		Renderer &renderer,
@@ -23,8 +92,13 @@ public:
 		const int &column,
 		const int &row
 	);
+	SpriteSheet(Texture &&texture, const int &column, const int &row);
 
 	void set_src_rect(const IRect &src_rect);
+	// The surface should contain the same image as the texture
+	void create_masks(const Surface &surface, const uint8_t threshold=127);
+	void create_masks(const string &file, const uint8_t threshold=127);
+	const CollisionMask& get_mask(const int &column, const int &row) const;
 	void draw_sprite(
 		const Rect &dst_rect,
 		const int &column,
@@ -38,6 +112,8 @@ public:
 	bool loop;
 	double animation_speed; // In animation_frames/sec
 	double animation_index = 0;
+	// The number of times the animation was completed
+	int completed_loops = 0;
 
 	AnimatedSprite(Renderer &renderer, const string &file, const int &column, const int &row, const double animation_speed, bool loop=true);
 
@@ -52,4 +128,156 @@ public:
 	);
 };
 
+
+// Updates many instances of shared AnimationClips in one pass
+// The instances are stored as separate arrays which are kept dense, the
+// instance ids returned by add_instance() stay valid until removed
+// The source rects can be passed straight to a SpriteBatch
+class AnimationSystem {
+private:
+	struct ClipData {
+		AnimationClip clip;
+		// Index of the first event of every frame in the sorted events,
+		// with one extra entry at the end
+		std::vector<uint32_t> event_offsets;
+
+		ClipData(const AnimationClip &clip);
+	};
+
+	std::vector<ClipData> clips;
+	// Instance data in dense order
+	std::vector<uint32_t> clip_ids, frames, instances;
+	std::vector<float> times, speeds;
+	std::vector<uint8_t> finished;
+	std::vector<IRect> src_rects;
+	// Dense index of every instance id
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> free_instances;
+	std::vector<AnimationEvent> events;
+
+	bool is_valid_clip(const int clip) const;
+	bool is_valid_instance(const uint32_t instance) const;
+
+public:
+	// Returns the id of the clip
+	int add_clip(const AnimationClip &clip);
+	const AnimationClip& get_clip(const int clip) const;
+
+	// Returns INVALID_ANIMATION_INSTANCE if the clip doesn't exist
+	uint32_t add_instance(const int clip, const float speed=1);
+	void remove_instance(const uint32_t instance);
+	// Switches to another clip, restarts it if it's the current one and
+	// restart is true, invalid ids are ignored
+	void play(const uint32_t instance, const int clip, const bool restart=true);
+	void set_speed(const uint32_t instance, const float speed);
+	// True once a clip which doesn't loop reached its last frame
+	bool is_finished(const uint32_t instance) const;
+	int get_frame(const uint32_t instance) const;
+	size_t size() const;
+
+	void update(const double dt);
+	const IRect& get_src_rect(const uint32_t instance) const;
+	// Source rects and instance ids in the same dense order
+	const std::vector<IRect>& get_src_rects() const;
+	const std::vector<uint32_t>& get_instances() const;
+	// The events which were reached during the last update
+	const std::vector<AnimationEvent>& get_events() const;
+};
+
+
+// Tile based map drawn with the tiles of a sprite sheet
+// Every layer is split into chunks of TILEMAP_CHUNK_SIZE x TILEMAP_CHUNK_SIZE
+// tiles, static layers draw each chunk into a target texture once and only
+// redraw it after its tiles changed, dynamic layers are drawn with a
+// SpriteBatch every frame
+// Only the chunks inside the view are drawn or baked, at most
+// max_cached_chunks textures are kept and the ones which weren't drawn for
+// the longest time are reused first
+class TileMap {
+private:
+	struct Chunk {
+		std::unique_ptr<Texture> texture;
+		int tile_count = 0;
+		bool dirty = true;
+		uint64_t last_drawn = 0;
+	};
+
+	struct Layer {
+		std::vector<int> tiles;
+		std::vector<Chunk> chunks;
+		bool is_static = true;
+		bool visible = true;
+	};
+
+	Renderer &renderer;
+	SpriteSheet &sheet;
+	SpriteBatch batch;
+	std::vector<Layer> layers;
+	std::vector<std::unique_ptr<Texture>> free_textures;
+	int columns, rows;
+	int chunk_columns, chunk_rows;
+	size_t cached_chunks = 0;
+	uint64_t frame = 0;
+	int drawn_chunks = 0;
+
+	Chunk& get_chunk(Layer &layer, const IVector &pos);
+	void add_tiles(
+		const Layer &layer,
+		const int chunk,
+		const Vector &offset,
+		const Vector &scale
+	);
+	void bake(Layer &layer, const int chunk);
+	void evict_chunks();
+	// Draws the chunks inside view mapped to dst_rect and clipped to clip
+	void render_chunks(const Rect &view, const Rect &dst_rect, const Rect &clip);
+
+public:
+	size_t max_cached_chunks = 256;
+
+	TileMap(
+		Renderer &renderer,
+		SpriteSheet &sheet,
+		const IVector &size,
+		const int layer_count=1
+	);
+
+	// Size in tiles
+	IVector get_size() const;
+	IVector get_tile_size() const;
+	int get_layer_count() const;
+	// Tiles are indices of the sprite sheet in row major order, or
+	// EMPTY_TILE
+	int get_tile(const int layer, const IVector &pos) const;
+	void set_tile(const int layer, const IVector &pos, const int tile);
+	void fill(const int layer, const int tile);
+	void set_layer_static(const int layer, const bool is_static);
+	void set_layer_visible(const int layer, const bool visible);
+	// Redraws every chunk, e.g. after the render targets were lost
+	void invalidate();
+
+	// Draws the area of the map inside view, which is in map pixels,
+	// stretched to dst_rect
+	void render(const Rect &view, const Rect &dst_rect);
+	// Draws the area of the map inside view at the same scale
+	void render(const Rect &view);
+	// Draws the map through the camera, the map starts at the world origin
+	void render(const Camera2D &camera);
+	// The number of chunks drawn by the last render
+	int get_drawn_chunks() const;
+};
+
+
+
+
+// Functions
+// Built in systems for the ECS
+// Advances the SpriteAnimation of every entity
+void update_sprite_animations(World &world, const double dt);
+// Draws the current tile of every entity with Bounds and a SpriteAnimation
+void render_sprites(World &world);
+// Resumes a Task once the sprite completed its animation, the sprite still
+// has to be updated by the caller
+ConditionAwaitable wait_for_animation(AnimatedSprite &sprite);
+
 #endif /* SUPERNOVA_GRAPHICS_H */
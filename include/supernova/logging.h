@@ -2,9 +2,14 @@
 #define SUPERNOVA_LOGGING_H
 
 
+#include <memory>
+#include <new>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <format>
+#include <tuple>
+#include <type_traits>
 
 #include <SDL3/SDL_log.h>
 
@@ -12,17 +17,207 @@
 
 
 
+// Compile time log levels
+// The levels above SUPERNOVA_LOG_LEVEL are removed at compile time, so their
+// log statements cost nothing, e.g. -DSUPERNOVA_LOG_LEVEL=2 keeps only the
+// warnings and errors
+// Each category can be overridden, e.g. -DSUPERNOVA_LOG_LEVEL_NET=4
+// The runtime functions like set_log_level() only work within these levels
+#ifndef SUPERNOVA_LOG_LEVEL
+#ifdef NDEBUG
+#define SUPERNOVA_LOG_LEVEL 2
+#else
+#define SUPERNOVA_LOG_LEVEL 4
+#endif /* NDEBUG */
+#endif /* SUPERNOVA_LOG_LEVEL */
+
+#ifndef SUPERNOVA_LOG_LEVEL_APP
+#define SUPERNOVA_LOG_LEVEL_APP SUPERNOVA_LOG_LEVEL
+#endif
+#ifndef SUPERNOVA_LOG_LEVEL_CORE
+#define SUPERNOVA_LOG_LEVEL_CORE SUPERNOVA_LOG_LEVEL
+#endif
+#ifndef SUPERNOVA_LOG_LEVEL_RENDER
+#define SUPERNOVA_LOG_LEVEL_RENDER SUPERNOVA_LOG_LEVEL
+#endif
+#ifndef SUPERNOVA_LOG_LEVEL_AUDIO
+#define SUPERNOVA_LOG_LEVEL_AUDIO SUPERNOVA_LOG_LEVEL
+#endif
+#ifndef SUPERNOVA_LOG_LEVEL_FONT
+#define SUPERNOVA_LOG_LEVEL_FONT SUPERNOVA_LOG_LEVEL
+#endif
+#ifndef SUPERNOVA_LOG_LEVEL_NET
+#define SUPERNOVA_LOG_LEVEL_NET SUPERNOVA_LOG_LEVEL
+#endif
+#ifndef SUPERNOVA_LOG_LEVEL_IO
+#define SUPERNOVA_LOG_LEVEL_IO SUPERNOVA_LOG_LEVEL
+#endif
+
+// The arguments are only evaluated if the level is enabled, and nothing is
+// compiled if the level is above the compile time level of the category
+#define SUPERNOVA_LOG(level, category, ...) \
+	do { \
+		if constexpr (is_log_compiled(level, category)) { \
+			if (get_log_state(category) & level) \
+				flog_at(level, category, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define FLOG_INFO(category, ...) SUPERNOVA_LOG(INFO, category, __VA_ARGS__)
+#define FLOG_WARN(category, ...) SUPERNOVA_LOG(WARN, category, __VA_ARGS__)
+#define FLOG_ERROR(category, ...) SUPERNOVA_LOG(ERROR, category, __VA_ARGS__)
+
+
+
+// Globals
+constexpr int COMPILED_LOG_LEVELS[LOG_CATEGORY_COUNT] = {
+	SUPERNOVA_LOG_LEVEL_APP,
+	SUPERNOVA_LOG_LEVEL_CORE,
+	SUPERNOVA_LOG_LEVEL_RENDER,
+	SUPERNOVA_LOG_LEVEL_AUDIO,
+	SUPERNOVA_LOG_LEVEL_FONT,
+	SUPERNOVA_LOG_LEVEL_NET,
+	SUPERNOVA_LOG_LEVEL_IO
+};
+
+
+
+// Forward Declarations
+class BufferedWriter;
+
+
+
 // Structs
 struct LogArgs {
 	std::string sep = " ", pre = "";
 };
 
 
+struct AsyncLogConfig {
+	// The size of the ring buffer of each thread which logs
+	size_t buffer_size = 64*1024;
+	// What happens when a thread logs faster than the messages are written
+	LOGOVERFLOW overflow = LOG_DROP;
+	// How often the background thread writes the buffered messages
+	int flush_interval_ms = 10;
+	// Writes the buffered messages before the process dies on a crash, the
+	// signal handlers installed earlier still run afterwards
+	// Nothing is written if the crashing thread holds a lock of the logger
+	bool flush_on_crash = true;
+};
+
+
+
+// Classes
+// Sinks receive the formatted messages, from the background thread when
+// the logging is asynchronous
+class LogSink {
+public:
+	virtual ~LogSink() = default;
+
+	// The time is in nanoseconds since SDL was initialized
+	virtual void write(
+		const LOGLEVEL level,
+		const LOGCATEGORY category,
+		const uint64_t time,
+		std::string_view message
+	) = 0;
+	virtual void flush() {}
+};
+
+
+// Writes to SDL_Log, which is the default sink
+class SDLLogSink: public LogSink {
+public:
+	void write(
+		const LOGLEVEL level,
+		const LOGCATEGORY category,
+		const uint64_t time,
+		std::string_view message
+	) override;
+};
+
+
+class StdoutLogSink: public LogSink {
+public:
+	void write(
+		const LOGLEVEL level,
+		const LOGCATEGORY category,
+		const uint64_t time,
+		std::string_view message
+	) override;
+	void flush() override;
+};
+
+
+class FileLogSink: public LogSink {
+private:
+	std::unique_ptr<BufferedWriter> writer;
+
+public:
+	FileLogSink(const std::string &file);
+	~FileLogSink();
+
+	void write(
+		const LOGLEVEL level,
+		const LOGCATEGORY category,
+		const uint64_t time,
+		std::string_view message
+	) override;
+	void flush() override;
+};
+
+
 
 // Functions
-int get_log_state();
+constexpr bool is_log_compiled(const LOGLEVEL level, const LOGCATEGORY category) {
+	return level <= COMPILED_LOG_LEVELS[category];
+}
+
+int get_log_state(const LOGCATEGORY category=LOG_APP);
+// The functions without a category change every category
 void set_log_state(const int log_level, const bool enable=true);
+void set_log_state(
+	const LOGCATEGORY category,
+	const int log_level,
+	const bool enable=true
+);
 void set_log_level(const int log_level);
+void set_log_level(const LOGCATEGORY category, const int log_level);
+const char* get_log_level_name(const LOGLEVEL level);
+const char* get_log_category_name(const LOGCATEGORY category);
+
+void add_log_sink(std::unique_ptr<LogSink> sink);
+// Removes every sink including the default SDL one
+void clear_log_sinks();
+// Starts a background thread which formats and writes the messages, the
+// calling threads only copy the arguments into their own ring buffer
+void start_async_logging(const AsyncLogConfig &config={});
+// Writes the buffered messages and goes back to logging synchronously
+void stop_async_logging();
+bool is_async_logging();
+// Blocks until every buffered message is written and the sinks are flushed
+void flush_logs();
+// The number of messages dropped because a ring buffer was full
+uint64_t get_dropped_logs();
+
+// Used by the logging templates
+// Formats the message on the calling thread and writes it to the sinks
+void write_log(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	std::string_view message
+);
+// Reserves space for a message in the ring buffer of the calling thread
+// Returns nullptr if the message was dropped
+void* reserve_log_record(
+	const size_t size,
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	void (*format)(void *payload, std::string &output),
+	void (*destroy)(void *payload)
+);
+void commit_log_record();
 
 
 template <typename Arg, typename... Args>
@@ -45,83 +240,169 @@ std::string log_to_string(const LogArgs &log_args, Arg&& arg, Args&&... args) {
 }
 
 
+// Copies an argument so that it can be formatted later on another thread
+// Strings are copied as the pointers might not be valid anymore, e.g. the
+// buffer returned by SDL_GetError()
+template <typename T>
+auto capture_log_arg(T &&arg) {
+	using Type = std::decay_t<T>;
+	if constexpr (std::is_pointer_v<Type> && std::is_convertible_v<Type, const char*>)
+		return std::string((arg != nullptr)? arg : "(null)");
+	else if constexpr (std::is_convertible_v<const Type&, std::string_view>)
+		return std::string(std::string_view(arg));
+	else
+		return Type(std::forward<T>(arg));
+}
+
+template <typename T>
+using log_capture_t = decltype(capture_log_arg(std::declval<T>()));
+
+
+template <typename... Args>
+struct StreamLogPayload {
+	LogArgs log_args;
+	std::tuple<Args...> args;
+
+	void format(std::string &output) const {
+		output = std::apply([this](auto&... args) {
+			return log_to_string(log_args, args...);
+		}, args);
+	}
+};
+
+template <typename... Args>
+struct FormatLogPayload {
+	// Format strings are literals, so the view stays valid
+	std::string_view fmt;
+	std::tuple<Args...> args;
+
+	void format(std::string &output) const {
+		output = std::apply([this](auto&... args) {
+			return std::vformat(fmt, std::make_format_args(args...));
+		}, args);
+	}
+};
+
+template <typename Payload>
+void submit_log(const LOGLEVEL level, const LOGCATEGORY category, Payload &&payload) {
+	using Type = std::decay_t<Payload>;
+	static_assert(alignof(Type) <= 16, "Log arguments can't be over aligned");
+
+	void *memory = reserve_log_record(
+		sizeof(Type), level, category,
+		[](void *data, std::string &output) {static_cast<Type*>(data)->format(output);},
+		[](void *data) {static_cast<Type*>(data)->~Type();}
+	);
+	if (memory != nullptr) {
+		new (memory) Type(std::forward<Payload>(payload));
+		commit_log_record();
+	}
+}
+
+template <typename... Args>
+void submit_stream_log(const LOGLEVEL level, const LOGCATEGORY category, const LogArgs &log_args, Args&&... args) {
+	// The arguments are only copied if the message is formatted later
+	if (!is_async_logging()) {
+		write_log(level, category, log_to_string(log_args, args...));
+		return;
+	}
+
+	submit_log(level, category, StreamLogPayload<log_capture_t<Args>...>{
+		log_args, {capture_log_arg(std::forward<Args>(args))...}
+	});
+}
+
+template <typename... Args>
+void submit_format_log(const LOGLEVEL level, const LOGCATEGORY category, std::string_view fmt, Args&&... args) {
+	if (!is_async_logging()) {
+		write_log(level, category, std::vformat(fmt, std::make_format_args(args...)));
+		return;
+	}
+
+	submit_log(level, category, FormatLogPayload<log_capture_t<Args>...>{
+		fmt, {capture_log_arg(std::forward<Args>(args))...}
+	});
+}
+
+// Used by the FLOG_* macros, which check the level before the arguments
+// are evaluated
+template<typename ...A>
+void flog_at(const LOGLEVEL level, const LOGCATEGORY category, std::format_string<A...> fmt, A&&...args) {
+	submit_format_log(level, category, fmt.get(), std::forward<A>(args)...);
+}
+
+
 template <typename Arg, typename... Args>
 void log_info(Arg&& arg, Args&&... args) {
-	if (get_log_state() & INFO)
-		SDL_Log("%s", log_to_string({}, arg, args...).c_str());
+	if constexpr (is_log_compiled(INFO, LOG_APP)) {
+		if (get_log_state() & INFO)
+			submit_stream_log(INFO, LOG_APP, {}, std::forward<Arg>(arg), std::forward<Args>(args)...);
+	}
 }
 
 template <typename Arg, typename... Args>
 void log_info(const LogArgs &log_args, Arg&& arg, Args&&... args) {
-	if (get_log_state() & INFO)
-		SDL_Log("%s", log_to_string(log_args, arg, args...).c_str());
+	if constexpr (is_log_compiled(INFO, LOG_APP)) {
+		if (get_log_state() & INFO)
+			submit_stream_log(INFO, LOG_APP, log_args, std::forward<Arg>(arg), std::forward<Args>(args)...);
+	}
 }
 
 template<typename ...A>
 void flog_info(std::format_string<A...> fmt, A&&...args){
-	if (get_log_state() & INFO)
-			SDL_Log("%s", format(fmt, std::forward<A>(args)...).c_str());
+	if constexpr (is_log_compiled(INFO, LOG_APP)) {
+		if (get_log_state() & INFO)
+			submit_format_log(INFO, LOG_APP, fmt.get(), std::forward<A>(args)...);
+	}
 }
 
 
 template <typename Arg, typename... Args>
 void log_error(Arg&& arg, Args&&... args) {
-	if (get_log_state() & ERROR) {
-		SDL_LogError(
-			SDL_LOG_CATEGORY_APPLICATION,
-			"%s",log_to_string({}, arg, args...).c_str()
-		);
+	if constexpr (is_log_compiled(ERROR, LOG_APP)) {
+		if (get_log_state() & ERROR)
+			submit_stream_log(ERROR, LOG_APP, {}, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
 }
 
 template <typename Arg, typename... Args>
 void log_error(const LogArgs &log_args, Arg&& arg, Args&&... args) {
-	if (get_log_state() & ERROR) {
-		SDL_LogError(
-			SDL_LOG_CATEGORY_APPLICATION,
-			"%s",log_to_string(log_args, arg, args...).c_str()
-		);
+	if constexpr (is_log_compiled(ERROR, LOG_APP)) {
+		if (get_log_state() & ERROR)
+			submit_stream_log(ERROR, LOG_APP, log_args, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
 }
 
 template<typename ...A>
 void flog_error(std::format_string<A...> fmt, A&&...args){
-	if (get_log_state() & ERROR) {
-		SDL_LogError(
-			SDL_LOG_CATEGORY_APPLICATION, 
-			"%s", format(fmt, std::forward<A>(args)...).c_str()
-		);
+	if constexpr (is_log_compiled(ERROR, LOG_APP)) {
+		if (get_log_state() & ERROR)
+			submit_format_log(ERROR, LOG_APP, fmt.get(), std::forward<A>(args)...);
 	}
 }
 
 
 template <typename Arg, typename... Args>
 void log_warn(Arg&& arg, Args&&... args) {
-	if (get_log_state() & WARN) {
-		SDL_LogWarn(
-			SDL_LOG_CATEGORY_APPLICATION,
-			log_to_string({}, arg, args...).c_str()
-		);
+	if constexpr (is_log_compiled(WARN, LOG_APP)) {
+		if (get_log_state() & WARN)
+			submit_stream_log(WARN, LOG_APP, {}, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
 }
 
 template <typename Arg, typename... Args>
 void log_warn(const LogArgs &log_args, Arg&& arg, Args&&... args) {
-	if (get_log_state() & WARN) {
-		SDL_LogWarn(
-			SDL_LOG_CATEGORY_APPLICATION,
-			log_to_string(log_args, arg, args...).c_str()
-		);
+	if constexpr (is_log_compiled(WARN, LOG_APP)) {
+		if (get_log_state() & WARN)
+			submit_stream_log(WARN, LOG_APP, log_args, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
 }
 
 template<typename ...A>
 void flog_warn(std::format_string<A...> fmt, A&&...args){
-	if (get_log_state() & WARN) {
-		SDL_LogWarn(
-			SDL_LOG_CATEGORY_APPLICATION, 
-			format(fmt, std::forward<A>(args)...).c_str()
-		);
+	if constexpr (is_log_compiled(WARN, LOG_APP)) {
+		if (get_log_state() & WARN)
+			submit_format_log(WARN, LOG_APP, fmt.get(), std::forward<A>(args)...);
 	}
 }
 
@@ -92,7 +92,10 @@ public:
 // Try to keep the packet size less than 512bytes
 class Packet {
 private:
-	string get_last_element();
+	size_t get_last_element_start() const;
+	// The element is a view into the buffer which is valid until it's popped
+	std::string_view get_last_element() const;
+	void pop_last_element();
 
 public:
 	char DELIMETER = '|'; // ASCII unit separater
@@ -0,0 +1,54 @@
+#ifndef SUPERNOVA_THREADING_H
+#define SUPERNOVA_THREADING_H
+
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+// Classes
+class ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable job_available, jobs_finished;
+	int active_jobs = 0;
+	bool stopping = false;
+
+	void worker_loop();
+
+public:
+	// If num_threads is 0 then one less than the number of logical cores
+	// is used, leaving one core for the thread which owns the pool
+	ThreadPool(const int num_threads=0);
+	ThreadPool(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Returns a pool shared by the engine which is created on first use
+	static ThreadPool& get_global();
+
+	int size() const;
+	void submit(std::function<void()> job);
+	// Blocks until all the submitted jobs are finished
+	void wait();
+	// Splits [begin, end) into bands of atleast min_band items and calls
+	// func(band_begin, band_end) for each of them in parallel
+	// The calling thread also processes bands and the function returns
+	// after all of them are finished
+	void parallel_for(
+		const int begin,
+		const int end,
+		const std::function<void(int, int)> &func,
+		const int min_band=1
+	);
+};
+
+#endif /* SUPERNOVA_THREADING_H */
@@ -0,0 +1,123 @@
+#ifndef SUPERNOVA_TIMER_SCHEDULER_H
+#define SUPERNOVA_TIMER_SCHEDULER_H
+
+
+#include <functional>
+#include <vector>
+
+#include "core.h"
+
+
+
+// Globals
+// The first wheel has 256 slots and every other one 64, so five of them
+// cover 2^32 ticks, longer timers are cascaded again until they're due
+const int TIMER_WHEEL_LEVELS = 5;
+const int TIMER_WHEEL_BITS = 8;
+const int TIMER_LEVEL_BITS = 6;
+
+
+
+// Structs
+struct TimerHandle {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	// False for default constructed handles
+	explicit operator bool() const {
+		return index != UINT32_MAX;
+	}
+};
+
+
+struct TimerEvent {
+	TimerHandle handle;
+	int id;
+};
+
+
+
+// Classes
+// Runs a large number of timers without updating each of them every frame
+// Implemented as a hierarchical timing wheel, scheduling and cancelling are
+// O(1) and an update only visits the timers which expire
+class TimerScheduler {
+private:
+	struct TimerNode {
+		uint64_t expiry;
+		// 0 for timers which fire once
+		uint64_t interval;
+		std::function<void()> callback;
+		int event_id;
+		uint32_t prev, next;
+		// The list the node is in, or FREE or FIRING
+		uint32_t slot;
+		uint32_t generation = 0;
+	};
+
+	std::vector<TimerNode> nodes;
+	std::vector<uint32_t> free_nodes;
+	std::vector<uint32_t> slots;
+	std::vector<TimerEvent> events;
+	double resolution;
+	// The last tick which was processed
+	uint64_t now = 0;
+	double pending_ticks = 0;
+	double time_scale = 1;
+	bool paused = false;
+	size_t active = 0;
+
+	TimerNode* get_node(const TimerHandle handle);
+	const TimerNode* get_node(const TimerHandle handle) const;
+	uint64_t to_ticks(const double seconds) const;
+	TimerHandle add(const double delay, const double interval, std::function<void()> callback, const int event_id);
+	void link(const uint32_t index);
+	void unlink(const uint32_t index);
+	void release(const uint32_t index);
+	void cascade(const int level);
+	void fire(const uint32_t index);
+
+public:
+	// The resolution is the length of a tick in seconds, timers fire on the
+	// first tick at or after their time
+	TimerScheduler(const double resolution=0.001);
+
+	// Calls the callback after delay seconds and then every interval
+	// seconds, an interval of 0 fires only once
+	TimerHandle schedule(
+		const double delay,
+		std::function<void()> callback,
+		const double interval=0
+	);
+	// Adds the event id to get_events() when the timer fires instead of
+	// calling a function
+	TimerHandle schedule_event(
+		const double delay,
+		const int event_id,
+		const double interval=0
+	);
+	// Returns false if the timer already finished or was cancelled
+	// Timers can be cancelled from their own callback
+	bool cancel(const TimerHandle handle);
+	bool is_active(const TimerHandle handle) const;
+	// In seconds, 0 for timers which aren't active
+	double get_time_left(const TimerHandle handle) const;
+	// The number of active timers
+	size_t size() const;
+	void clear();
+
+	// Advances the time by dt seconds multiplied with the time scale and
+	// fires the timers which expire on the way
+	void update(const double dt);
+	// Uses the frame time of the clock
+	void update(const Clock &clock);
+	// The events of the timers which fired during the last update
+	const std::vector<TimerEvent>& get_events() const;
+
+	void set_paused(const bool paused);
+	bool is_paused() const;
+	void set_time_scale(const double time_scale);
+	double get_time_scale() const;
+};
+
+#endif /* SUPERNOVA_TIMER_SCHEDULER_H */
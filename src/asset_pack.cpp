@@ -0,0 +1,514 @@
+#include "asset_pack.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "logging.h"
+
+
+
+// Globals
+// Matches shorter than this are stored as literals
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 16;
+
+
+
+// Structs
+// Compressed entries are decompressed into a buffer owned by the stream
+struct BufferStream {
+	std::vector<std::byte> data;
+	size_t pos = 0;
+};
+
+
+
+// Helper functions
+static uint32_t read_u32(const std::byte *ptr) {
+	uint32_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return SDL_Swap32LE(value);
+}
+
+static uint64_t read_u64(const std::byte *ptr) {
+	uint64_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return SDL_Swap64LE(value);
+}
+
+static void write_u32(std::vector<std::byte> &buffer, const uint32_t value) {
+	const uint32_t swapped = SDL_Swap32LE(value);
+	const std::byte *ptr = reinterpret_cast<const std::byte*>(&swapped);
+	buffer.insert(buffer.end(), ptr, ptr + sizeof(swapped));
+}
+
+static void write_u64(std::vector<std::byte> &buffer, const uint64_t value) {
+	const uint64_t swapped = SDL_Swap64LE(value);
+	const std::byte *ptr = reinterpret_cast<const std::byte*>(&swapped);
+	buffer.insert(buffer.end(), ptr, ptr + sizeof(swapped));
+}
+
+static void write_length(std::vector<std::byte> &output, size_t length) {
+	// Lengths which don't fit in the token are continued in bytes of 255
+	// until a smaller byte ends them
+	for (; length >= 255; length -= 255)
+		output.push_back(std::byte{255});
+	output.push_back(static_cast<std::byte>(length));
+}
+
+static void write_sequence(
+	std::vector<std::byte> &output,
+	const std::byte *literals,
+	const size_t literal_length,
+	const size_t offset,
+	const size_t match_length
+) {
+	// A match length of 0 marks the last sequence which only has literals
+	const size_t match_code = (match_length)? match_length - MIN_MATCH : 0;
+	output.push_back(static_cast<std::byte>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15)));
+	if (literal_length >= 15)
+		write_length(output, literal_length - 15);
+	output.insert(output.end(), literals, literals + literal_length);
+
+	if (match_length) {
+		output.push_back(static_cast<std::byte>(offset & 0xff));
+		output.push_back(static_cast<std::byte>(offset >> 8));
+		if (match_code >= 15)
+			write_length(output, match_code - 15);
+	}
+}
+
+static bool read_length(const std::byte *&ptr, const std::byte *end, size_t &length) {
+	std::byte value;
+	do {
+		if (ptr == end)
+			return false;
+		value = *ptr++;
+		length += static_cast<size_t>(value);
+	} while (value == std::byte{255});
+
+	return true;
+}
+
+uint64_t hash_asset_name(std::string_view name) {
+	// 64 bit FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (const char c: name) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+std::vector<std::byte> compress_asset(std::span<const std::byte> data) {
+	std::vector<std::byte> output;
+	output.reserve(data.size()/2 + 16);
+
+	const std::byte *src = data.data();
+	const size_t size = data.size();
+	// The last position where each hashed group of 4 bytes was seen
+	std::vector<int64_t> table(size_t(1) << HASH_BITS, -1);
+
+	size_t anchor = 0, pos = 0;
+	while (pos + MIN_MATCH <= size) {
+		const uint32_t group = read_u32(src + pos);
+		const uint32_t hash = (group*2654435761u) >> (32 - HASH_BITS);
+		const int64_t candidate = table[hash];
+		table[hash] = pos;
+
+		if (candidate < 0 || pos - candidate > MAX_OFFSET || read_u32(src + candidate) != group) {
+			pos++;
+			continue;
+		}
+
+		size_t length = MIN_MATCH;
+		while (pos + length < size && src[candidate + length] == src[pos + length])
+			length++;
+
+		write_sequence(output, src + anchor, pos - anchor, pos - candidate, length);
+		pos += length;
+		anchor = pos;
+	}
+	write_sequence(output, src + anchor, size - anchor, 0, 0);
+
+	return output;
+}
+
+bool decompress_asset(std::span<const std::byte> data, std::span<std::byte> output) {
+	// Returns false if the data is corrupted or doesn't decompress to the
+	// exact size of output
+	const std::byte *ptr = data.data();
+	const std::byte *end = ptr + data.size();
+	size_t pos = 0;
+
+	while (ptr < end) {
+		const uint8_t token = static_cast<uint8_t>(*ptr++);
+
+		size_t literal_length = token >> 4;
+		if (literal_length == 15 && !read_length(ptr, end, literal_length))
+			return false;
+		if (literal_length > size_t(end - ptr) || literal_length > output.size() - pos)
+			return false;
+		if (literal_length > 0)
+			memcpy(output.data() + pos, ptr, literal_length);
+		ptr += literal_length;
+		pos += literal_length;
+
+		// The last sequence only has literals
+		if (ptr == end)
+			break;
+
+		if (end - ptr < 2)
+			return false;
+		const size_t offset = static_cast<size_t>(ptr[0]) | (static_cast<size_t>(ptr[1]) << 8);
+		ptr += 2;
+
+		size_t match_length = token & 15;
+		if (match_length == 15 && !read_length(ptr, end, match_length))
+			return false;
+		match_length += MIN_MATCH;
+		if (offset == 0 || offset > pos || match_length > output.size() - pos)
+			return false;
+
+		// Byte by byte since the match can overlap the bytes it produces
+		for (size_t i = 0; i < match_length; i++, pos++)
+			output[pos] = output[pos - offset];
+	}
+
+	return pos == output.size();
+}
+
+
+static Sint64 buffer_stream_size(void *userdata) {
+	return static_cast<BufferStream*>(userdata)->data.size();
+}
+
+static Sint64 buffer_stream_seek(void *userdata, Sint64 offset, SDL_IOWhence whence) {
+	BufferStream *stream = static_cast<BufferStream*>(userdata);
+	Sint64 base = 0;
+	if (whence == SDL_IO_SEEK_CUR)
+		base = stream->pos;
+	else if (whence == SDL_IO_SEEK_END)
+		base = stream->data.size();
+
+	const Sint64 pos = base + offset;
+	if (pos < 0) {
+		SDL_SetError("Seek before the start of the stream");
+		return -1;
+	}
+	stream->pos = std::min<size_t>(pos, stream->data.size());
+
+	return stream->pos;
+}
+
+static size_t buffer_stream_read(void *userdata, void *ptr, size_t size, SDL_IOStatus *status) {
+	BufferStream *stream = static_cast<BufferStream*>(userdata);
+	const size_t count = std::min(size, stream->data.size() - stream->pos);
+	memcpy(ptr, stream->data.data() + stream->pos, count);
+	stream->pos += count;
+	if (count < size)
+		*status = SDL_IO_STATUS_EOF;
+
+	return count;
+}
+
+static size_t buffer_stream_write(void*, const void*, size_t, SDL_IOStatus *status) {
+	*status = SDL_IO_STATUS_READONLY;
+	return 0;
+}
+
+static bool buffer_stream_close(void *userdata) {
+	delete static_cast<BufferStream*>(userdata);
+	return true;
+}
+
+
+
+// Classes
+void AssetPackWriter::add(const string &name, std::vector<std::byte> data, const bool compress) {
+	auto it = indices.find(name);
+	if (it != indices.end()) {
+		FLOG_WARN(LOG_IO, "Asset added twice, replacing the earlier one! ({})", name);
+		entries[it->second] = {name, std::move(data), compress};
+		return;
+	}
+
+	indices.emplace(name, entries.size());
+	entries.push_back({name, std::move(data), compress});
+}
+
+bool AssetPackWriter::add_file(const string &file, const string &name, const bool compress) {
+	// Returns false if the file couldn't be read
+	MappedFile mapped(file);
+	if (!mapped.is_loaded())
+		return false;
+
+	const std::span<const std::byte> bytes = mapped.get_bytes();
+	add(name, std::vector<std::byte>(bytes.begin(), bytes.end()), compress);
+	return true;
+}
+
+bool AssetPackWriter::save(const string &file, const uint32_t alignment) {
+	if (alignment == 0 || (alignment & (alignment - 1))) {
+		FLOG_ERROR(LOG_IO, "The alignment of an asset pack must be a power of two!");
+		return false;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const PendingEntry &entry1, const PendingEntry &entry2) {
+		return hash_asset_name(entry1.name) < hash_asset_name(entry2.name);
+	});
+	for (size_t i = 0; i < entries.size(); i++)
+		indices[entries[i].name] = i;
+
+	std::vector<AssetPackEntry> index;
+	std::vector<std::byte> names;
+	for (PendingEntry &entry: entries) {
+		AssetPackEntry info = {
+			hash_asset_name(entry.name), 0, entry.data.size(), entry.data.size(),
+			static_cast<uint32_t>(names.size()), static_cast<uint32_t>(entry.name.size()), 0
+		};
+
+		if (entry.compress && !entry.data.empty()) {
+			std::vector<std::byte> compressed = compress_asset(entry.data);
+			if (compressed.size() < entry.data.size()) {
+				entry.data = std::move(compressed);
+				info.size = entry.data.size();
+				info.flags |= ASSET_COMPRESSED;
+			}
+		}
+
+		const std::byte *name = reinterpret_cast<const std::byte*>(entry.name.data());
+		names.insert(names.end(), name, name + entry.name.size());
+		index.push_back(info);
+	}
+
+	auto align = [alignment](const uint64_t offset) {
+		return (offset + alignment - 1) & ~uint64_t(alignment - 1);
+	};
+
+	const uint64_t names_offset = ASSET_PACK_HEADER_SIZE + index.size()*ASSET_PACK_ENTRY_SIZE;
+	uint64_t offset = names_offset + names.size();
+	for (AssetPackEntry &info: index) {
+		info.offset = align(offset);
+		offset = info.offset + info.size;
+	}
+
+	std::vector<std::byte> header;
+	header.reserve(names_offset);
+	const std::byte *magic = reinterpret_cast<const std::byte*>(ASSET_PACK_MAGIC);
+	header.insert(header.end(), magic, magic + sizeof(ASSET_PACK_MAGIC));
+	write_u32(header, ASSET_PACK_VERSION);
+	write_u32(header, index.size());
+	write_u32(header, alignment);
+	write_u64(header, names_offset);
+	write_u32(header, names.size());
+	write_u32(header, 0);
+	for (const AssetPackEntry &info: index) {
+		write_u64(header, info.hash);
+		write_u64(header, info.offset);
+		write_u64(header, info.size);
+		write_u64(header, info.original_size);
+		write_u32(header, info.name_offset);
+		write_u32(header, info.name_length);
+		write_u32(header, info.flags);
+		write_u32(header, 0);
+	}
+
+	SDL_IOStream *io = SDL_IOFromFile(file.c_str(), "wb");
+	if (io == nullptr) {
+		FLOG_ERROR(LOG_IO, "Failed to open asset pack for writing! ({}): {}", file, SDL_GetError());
+		return false;
+	}
+
+	// A full disk only shows up as a short write or a failed close
+	auto write = [io](const void *ptr, const size_t size) {
+		return size == 0 || SDL_WriteIO(io, ptr, size) == size;
+	};
+	bool success = write(header.data(), header.size()) && write(names.data(), names.size());
+	uint64_t written = names_offset + names.size();
+	const std::byte padding[256] = {};
+	for (size_t i = 0; i < index.size() && success; i++) {
+		for (uint64_t pad = index[i].offset - written; pad > 0 && success;) {
+			const size_t count = std::min<uint64_t>(pad, sizeof(padding));
+			success = write(padding, count);
+			pad -= count;
+		}
+		success = success && write(entries[i].data.data(), entries[i].data.size());
+		written = index[i].offset + index[i].size;
+	}
+	if (!success)
+		FLOG_ERROR(LOG_IO, "Failed to write asset pack! ({}): {}", file, SDL_GetError());
+	if (!SDL_CloseIO(io) && success) {
+		FLOG_ERROR(LOG_IO, "Failed to close asset pack! ({}): {}", file, SDL_GetError());
+		success = false;
+	}
+	if (!success) {
+		SDL_RemovePath(file.c_str());
+		return false;
+	}
+
+	FLOG_INFO(LOG_IO, "Asset pack saved successfully! ({} entries)", index.size());
+	return true;
+}
+
+
+AssetPack::AssetPack(const string &file): file(file) {
+	if (!this->file.is_loaded())
+		return;
+
+	loaded = load_index();
+	if (loaded)
+		FLOG_INFO(LOG_IO, "Asset pack loaded successfully! ({} entries)", entries.size());
+	else {
+		FLOG_ERROR(LOG_IO, "Invalid asset pack! ({})", file);
+		entries.clear();
+	}
+}
+
+bool AssetPack::load_index() {
+	const std::span<const std::byte> bytes = file.get_bytes();
+	if (bytes.size() < ASSET_PACK_HEADER_SIZE || memcmp(bytes.data(), ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC)))
+		return false;
+
+	const std::byte *header = bytes.data();
+	if (read_u32(header + 4) != ASSET_PACK_VERSION)
+		return false;
+
+	const uint64_t count = read_u32(header + 8);
+	const uint64_t names_offset = read_u64(header + 16);
+	const uint64_t names_size = read_u32(header + 24);
+	if (names_offset != ASSET_PACK_HEADER_SIZE + count*ASSET_PACK_ENTRY_SIZE || names_offset + names_size > bytes.size())
+		return false;
+	names = {reinterpret_cast<const char*>(header + names_offset), names_size};
+
+	entries.reserve(count);
+	for (uint64_t i = 0; i < count; i++) {
+		const std::byte *ptr = header + ASSET_PACK_HEADER_SIZE + i*ASSET_PACK_ENTRY_SIZE;
+		const AssetPackEntry entry = {
+			read_u64(ptr), read_u64(ptr + 8), read_u64(ptr + 16), read_u64(ptr + 24),
+			read_u32(ptr + 32), read_u32(ptr + 36), read_u32(ptr + 40)
+		};
+		if (entry.offset > bytes.size() || entry.size > bytes.size() - entry.offset)
+			return false;
+		if (uint64_t(entry.name_offset) + entry.name_length > names_size)
+			return false;
+
+		entries.push_back(entry);
+	}
+
+	return std::is_sorted(entries.begin(), entries.end(), [](const AssetPackEntry &entry1, const AssetPackEntry &entry2) {
+		return entry1.hash < entry2.hash;
+	});
+}
+
+bool AssetPack::is_loaded() const {
+	return loaded;
+}
+
+const AssetPackEntry* AssetPack::find(std::string_view name) const {
+	// Returns nullptr if the pack has no entry with the name
+	const uint64_t hash = hash_asset_name(name);
+	auto it = std::lower_bound(entries.begin(), entries.end(), hash, [](const AssetPackEntry &entry, const uint64_t hash) {
+		return entry.hash < hash;
+	});
+
+	// Names are compared as well in case of hash collisions
+	for (; it != entries.end() && it->hash == hash; it++) {
+		if (get_name(*it) == name)
+			return &*it;
+	}
+
+	return nullptr;
+}
+
+bool AssetPack::contains(std::string_view name) const {
+	return find(name) != nullptr;
+}
+
+std::vector<string> AssetPack::get_names() const {
+	std::vector<string> result;
+	result.reserve(entries.size());
+	for (const AssetPackEntry &entry: entries)
+		result.emplace_back(get_name(entry));
+
+	return result;
+}
+
+std::string_view AssetPack::get_name(const AssetPackEntry &entry) const {
+	return names.substr(entry.name_offset, entry.name_length);
+}
+
+std::span<const std::byte> AssetPack::get_bytes(const AssetPackEntry &entry) const {
+	return file.get_bytes().subspan(entry.offset, entry.size);
+}
+
+std::span<const std::byte> AssetPack::get_bytes(std::string_view name) const {
+	// Only usable as is for entries which aren't compressed
+	const AssetPackEntry *entry = find(name);
+	if (entry == nullptr)
+		return {};
+
+	return get_bytes(*entry);
+}
+
+std::vector<std::byte> AssetPack::read(std::string_view name) const {
+	// Returns the original data, decompressing it if needed
+	const AssetPackEntry *entry = find(name);
+	if (entry == nullptr) {
+		FLOG_ERROR(LOG_IO, "Asset not found in the pack! ({})", name);
+		return {};
+	}
+
+	const std::span<const std::byte> bytes = get_bytes(*entry);
+	if (!(entry->flags & ASSET_COMPRESSED))
+		return std::vector<std::byte>(bytes.begin(), bytes.end());
+
+	std::vector<std::byte> data(entry->original_size);
+	if (!decompress_asset(bytes, data)) {
+		FLOG_ERROR(LOG_IO, "Failed to decompress asset! ({})", name);
+		return {};
+	}
+
+	return data;
+}
+
+SDL_IOStream* AssetPack::open_io(std::string_view name) const {
+	// Returns nullptr if the entry doesn't exist or can't be decompressed
+	const AssetPackEntry *entry = find(name);
+	if (entry == nullptr) {
+		FLOG_ERROR(LOG_IO, "Asset not found in the pack! ({})", name);
+		return nullptr;
+	}
+
+	if (!(entry->flags & ASSET_COMPRESSED)) {
+		// SDL doesn't allow constant memory streams of size 0
+		if (entry->size == 0)
+			return SDL_IOFromDynamicMem();
+		return SDL_IOFromConstMem(get_bytes(*entry).data(), entry->size);
+	}
+
+	BufferStream *stream = new BufferStream{std::vector<std::byte>(entry->original_size)};
+	if (!decompress_asset(get_bytes(*entry), stream->data)) {
+		FLOG_ERROR(LOG_IO, "Failed to decompress asset! ({})", name);
+		delete stream;
+		return nullptr;
+	}
+
+	SDL_IOStreamInterface stream_interface;
+	SDL_INIT_INTERFACE(&stream_interface);
+	stream_interface.size = buffer_stream_size;
+	stream_interface.seek = buffer_stream_seek;
+	stream_interface.read = buffer_stream_read;
+	stream_interface.write = buffer_stream_write;
+	stream_interface.close = buffer_stream_close;
+
+	SDL_IOStream *io = SDL_OpenIO(&stream_interface, stream);
+	if (io == nullptr) {
+		FLOG_ERROR(LOG_IO, "Failed to open stream over asset: {}", SDL_GetError());
+		delete stream;
+	}
+
+	return io;
+}
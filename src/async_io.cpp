@@ -0,0 +1,266 @@
+#include "async_io.h"
+
+#include "logging.h"
+
+
+
+// Helper functions
+static void* to_userdata(const uint64_t id) {
+	return reinterpret_cast<void*>(static_cast<uintptr_t>(id));
+}
+
+static uint64_t from_userdata(void *userdata) {
+	return reinterpret_cast<uintptr_t>(userdata);
+}
+
+static string get_temp_file(const string &file) {
+	return file + ".tmp";
+}
+
+
+
+// Structs
+std::span<const std::byte> AsyncIOResult::get_bytes() const {
+	return {static_cast<const std::byte*>(buffer.get()), size};
+}
+
+std::string_view AsyncIOResult::get_view() const {
+	return {static_cast<const char*>(buffer.get()), size};
+}
+
+
+
+// Classes
+AsyncIOQueue::AsyncIOQueue(const int max_in_flight): queue(SDL_CreateAsyncIOQueue()), max_in_flight(max_in_flight) {
+	if (queue == nullptr)
+		FLOG_ERROR(LOG_IO, "Failed to create async I/O queue: {}", SDL_GetError());
+}
+
+AsyncIOQueue::~AsyncIOQueue() {
+	// Blocks until every request is finished
+	if (queue != nullptr) {
+		wait_all();
+		SDL_DestroyAsyncIOQueue(queue);
+	}
+}
+
+uint64_t AsyncIOQueue::add(Request &&request) {
+	const uint64_t id = next_id++;
+	requests.emplace(id, std::move(request));
+	waiting.push_back(id);
+	start_waiting();
+
+	return id;
+}
+
+void AsyncIOQueue::start_waiting() {
+	auto it = waiting.begin();
+	while (it != waiting.end() && in_flight < std::max(max_in_flight, 1)) {
+		const uint64_t id = *it;
+		Request &request = requests.at(id);
+		// A write waits for the one in flight to the same file as both use
+		// the same temporary file
+		if (request.type == AsyncIOResult::WRITE && writing.contains(request.file)) {
+			it++;
+			continue;
+		}
+		it = waiting.erase(it);
+
+		if (request.type == AsyncIOResult::WRITE)
+			writing.insert(request.file);
+		if (start(id, request))
+			in_flight++;
+		else {
+			request.success = false;
+			finish(id, request);
+		}
+	}
+}
+
+bool AsyncIOQueue::start(const uint64_t id, Request &request) {
+	// Returns false if the request couldn't be started
+	if (queue == nullptr)
+		return false;
+
+	if (request.type == AsyncIOResult::READ && request.size == 0) {
+		// Whole files are loaded in a single task
+		request.stage = LOADING;
+		if (!SDL_LoadFileAsync(request.file.c_str(), queue, to_userdata(id))) {
+			FLOG_ERROR(LOG_IO, "Failed to start reading file! ({}): {}", request.file, SDL_GetError());
+			return false;
+		}
+		return true;
+	}
+
+	const bool reading = (request.type == AsyncIOResult::READ);
+	const string file = (reading)? request.file : get_temp_file(request.file);
+	request.asyncio = SDL_AsyncIOFromFile(file.c_str(), (reading)? "r" : "w");
+	if (request.asyncio == nullptr) {
+		FLOG_ERROR(LOG_IO, "Failed to open file! ({}): {}", file, SDL_GetError());
+		return false;
+	}
+
+	request.stage = TRANSFERRING;
+	bool started;
+	if (reading) {
+		request.buffer.reset(SDL_malloc(request.size));
+		started = SDL_ReadAsyncIO(request.asyncio, request.buffer.get(), request.offset, request.size, queue, to_userdata(id));
+	} else
+		started = SDL_WriteAsyncIO(request.asyncio, request.data.data(), 0, request.data.size(), queue, to_userdata(id));
+
+	if (!started) {
+		FLOG_ERROR(LOG_IO, "Failed to start transferring file! ({}): {}", request.file, SDL_GetError());
+		// The handle still has to be closed, which finishes the request
+		request.success = false;
+		request.stage = CLOSING;
+		if (!SDL_CloseAsyncIO(request.asyncio, false, queue, to_userdata(id))) {
+			FLOG_ERROR(LOG_IO, "Failed to close file! ({}): {}", request.file, SDL_GetError());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void AsyncIOQueue::handle(const SDL_AsyncIOOutcome &outcome) {
+	const uint64_t id = from_userdata(outcome.userdata);
+	auto it = requests.find(id);
+	if (it == requests.end())
+		return;
+
+	Request &request = it->second;
+	const bool complete = (outcome.result == SDL_ASYNCIO_COMPLETE);
+	switch (request.stage) {
+		case LOADING:
+			request.success = complete;
+			request.buffer.reset(outcome.buffer);
+			request.transferred = outcome.bytes_transferred;
+			in_flight--;
+			finish(id, request);
+			break;
+		case TRANSFERRING:
+			request.success = complete;
+			request.transferred = outcome.bytes_transferred;
+			// Writes are flushed so that the rename doesn't replace the old
+			// file with one which isn't on the disk yet
+			request.stage = CLOSING;
+			if (!SDL_CloseAsyncIO(request.asyncio, request.type == AsyncIOResult::WRITE && complete, queue, outcome.userdata)) {
+				FLOG_ERROR(LOG_IO, "Failed to close file! ({}): {}", request.file, SDL_GetError());
+				request.success = false;
+				in_flight--;
+				finish(id, request);
+			}
+			break;
+		case CLOSING:
+			request.success = request.success && complete;
+			if (request.type == AsyncIOResult::WRITE && request.success) {
+				const string temp = get_temp_file(request.file);
+				if (!SDL_RenamePath(temp.c_str(), request.file.c_str())) {
+					FLOG_ERROR(LOG_IO, "Failed to replace file! ({}): {}", request.file, SDL_GetError());
+					request.success = false;
+				}
+			}
+			in_flight--;
+			finish(id, request);
+			break;
+		case WAITING:
+			break;
+	}
+}
+
+void AsyncIOQueue::finish(const uint64_t id, Request &request) {
+	if (!request.success)
+		FLOG_WARN(LOG_IO, "Async I/O request failed! ({})", request.file);
+	if (request.type == AsyncIOResult::WRITE) {
+		// A failed write leaves the old file as it was
+		if (!request.success)
+			SDL_RemovePath(get_temp_file(request.file).c_str());
+		writing.erase(request.file);
+	}
+
+	AsyncIOResult result = {id, request.type, std::move(request.file), request.success};
+	if (request.type == AsyncIOResult::READ && request.success) {
+		result.buffer = std::move(request.buffer);
+		result.size = request.transferred;
+	}
+	finished.push_back(std::move(result));
+	requests.erase(id);
+}
+
+uint64_t AsyncIOQueue::read(const string &file) {
+	// Reads the whole file
+	Request request;
+	request.type = AsyncIOResult::READ;
+	request.file = file;
+
+	return add(std::move(request));
+}
+
+uint64_t AsyncIOQueue::read(const string &file, const uint64_t offset, const uint64_t size) {
+	// Reads size bytes starting at offset
+	if (size == 0) {
+		FLOG_WARN(LOG_IO, "Async read of 0 bytes, reading the whole file instead.");
+		return read(file);
+	}
+
+	Request request;
+	request.type = AsyncIOResult::READ;
+	request.file = file;
+	request.offset = offset;
+	request.size = size;
+
+	return add(std::move(request));
+}
+
+std::vector<uint64_t> AsyncIOQueue::read(const std::vector<string> &files) {
+	std::vector<uint64_t> ids;
+	ids.reserve(files.size());
+	for (const string &file: files)
+		ids.push_back(read(file));
+
+	return ids;
+}
+
+uint64_t AsyncIOQueue::write(const string &file, std::vector<std::byte> data) {
+	Request request;
+	request.type = AsyncIOResult::WRITE;
+	request.file = file;
+	request.data = std::move(data);
+
+	return add(std::move(request));
+}
+
+uint64_t AsyncIOQueue::write(const string &file, const string &data) {
+	const std::byte *bytes = reinterpret_cast<const std::byte*>(data.data());
+	return write(file, std::vector<std::byte>(bytes, bytes + data.size()));
+}
+
+std::vector<AsyncIOResult> AsyncIOQueue::poll() {
+	// Returns the requests which finished since the last call
+	SDL_AsyncIOOutcome outcome;
+	while (queue != nullptr && SDL_GetAsyncIOResult(queue, &outcome)) {
+		handle(outcome);
+		start_waiting();
+	}
+
+	std::vector<AsyncIOResult> results;
+	results.swap(finished);
+	return results;
+}
+
+std::vector<AsyncIOResult> AsyncIOQueue::wait_all() {
+	// Blocks until every request is finished and returns them
+	SDL_AsyncIOOutcome outcome;
+	while (queue != nullptr && in_flight > 0 && SDL_WaitAsyncIOResult(queue, &outcome, -1)) {
+		handle(outcome);
+		start_waiting();
+	}
+
+	std::vector<AsyncIOResult> results;
+	results.swap(finished);
+	return results;
+}
+
+int AsyncIOQueue::get_pending() const {
+	return requests.size() + finished.size();
+}
@@ -0,0 +1,498 @@
+#include "binary_log.h"
+
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <shared_mutex>
+#include <variant>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MMAP_ENABLED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* __unix__ || __APPLE__ */
+
+
+
+// Structs
+// The file which is being written, only used while holding log_mutex
+// The writers reserve their space in the mapping through used, everything
+// else is only changed while holding log_mutex exclusively
+struct BinaryLogFile {
+#ifdef MMAP_ENABLED
+	int fd = -1;
+	std::byte *data = nullptr;
+	size_t capacity = 0;
+#else
+	std::unique_ptr<BufferedWriter> writer;
+#endif /* MMAP_ENABLED */
+	std::atomic<size_t> used = 0;
+	size_t chunk_size = 0;
+};
+
+
+typedef std::variant<int64_t, uint64_t, double, bool, char, std::string_view, const void*> BinaryLogValue;
+
+
+
+// Globals
+// Held shared while messages are copied into the mapping and exclusively
+// while the mapping changes
+static std::shared_mutex log_mutex;
+static BinaryLogFile log_file;
+static std::atomic<bool> binary_logging = false;
+// Changes every time a log is opened, so that space reserved in an earlier
+// log isn't written to the new one
+static uint64_t log_generation = 0;
+
+
+
+// Helper functions
+static std::vector<string>& get_formats() {
+	// The text format is always the first one
+	static std::vector<string> formats = {"{}"};
+	return formats;
+}
+
+template<typename T>
+static T decode_value(const std::byte *ptr) {
+	T value;
+	memcpy(&value, ptr, sizeof(T));
+	return swap_le(value);
+}
+
+#ifdef MMAP_ENABLED
+static bool grow_log_file(const size_t end) {
+	// Remaps the file with enough space for the bytes before end, must be
+	// called while holding log_mutex exclusively
+	size_t capacity = log_file.capacity;
+	while (capacity < end)
+		capacity += log_file.chunk_size;
+
+	if (ftruncate(log_file.fd, capacity) != 0)
+		return false;
+	if (log_file.data != nullptr)
+		munmap(log_file.data, log_file.capacity);
+
+	void *address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, log_file.fd, 0);
+	if (address == MAP_FAILED) {
+		log_file.data = nullptr;
+		log_file.capacity = 0;
+		return false;
+	}
+
+	log_file.data = static_cast<std::byte*>(address);
+	log_file.capacity = capacity;
+	return true;
+}
+#endif /* MMAP_ENABLED */
+
+#ifdef MMAP_ENABLED
+static void write_to_log(const size_t pos, std::span<const std::byte> header, std::span<const std::byte> body) {
+	// Copies a record into space which was reserved and mapped
+	memcpy(log_file.data + pos, header.data(), header.size());
+	if (!body.empty())
+		memcpy(log_file.data + pos + header.size(), body.data(), body.size());
+}
+#endif /* MMAP_ENABLED */
+
+static bool append_to_log(std::span<const std::byte> header, std::span<const std::byte> body) {
+	// Must be called while holding log_mutex exclusively
+	const size_t size = header.size() + body.size();
+#ifdef MMAP_ENABLED
+	const size_t pos = log_file.used.fetch_add(size, std::memory_order_relaxed);
+	if (pos + size > log_file.capacity && !grow_log_file(pos + size))
+		return false;
+
+	write_to_log(pos, header, body);
+#else
+	log_file.writer->write(header.data(), header.size());
+	log_file.writer->write(body.data(), body.size());
+	log_file.used += size;
+#endif /* MMAP_ENABLED */
+
+	return true;
+}
+
+static bool append_format(const uint32_t id, std::string_view format) {
+	std::byte header[BINARY_LOG_FORMAT_HEADER_SIZE];
+	std::byte *ptr = header;
+	encode_binary_log_value<uint32_t>(ptr, BINARY_LOG_FORMAT_HEADER_SIZE + format.size());
+	*ptr++ = std::byte(BINARY_LOG_FORMAT);
+	encode_binary_log_value<uint32_t>(ptr, id);
+
+	return append_to_log(header, std::as_bytes(std::span(format)));
+}
+
+static void release_log_file() {
+	// Must be called while holding log_mutex exclusively
+#ifdef MMAP_ENABLED
+	if (log_file.data != nullptr)
+		munmap(log_file.data, log_file.capacity);
+	if (log_file.fd >= 0) {
+		// Removes the unused part of the last chunk
+		if (ftruncate(log_file.fd, std::min<size_t>(log_file.used, log_file.capacity)) != 0)
+			FLOG_WARN(LOG_IO, "Failed to truncate the binary log");
+		::close(log_file.fd);
+	}
+	log_file.fd = -1;
+	log_file.data = nullptr;
+	log_file.capacity = 0;
+#else
+	log_file.writer.reset();
+#endif /* MMAP_ENABLED */
+	log_file.used = 0;
+	log_file.chunk_size = 0;
+}
+
+static void fail_binary_log() {
+	// Stops logging after a failed write, must be called while holding
+	// log_mutex exclusively
+	binary_logging = false;
+	release_log_file();
+}
+
+static bool decode_args(std::span<const std::byte> args, std::vector<BinaryLogValue> &values) {
+	const std::byte *ptr = args.data();
+	const std::byte *end = ptr + args.size();
+	while (ptr < end) {
+		const BINARY_LOG_ARG type = static_cast<BINARY_LOG_ARG>(*ptr++);
+		const size_t left = end - ptr;
+		switch (type) {
+			case BINARY_LOG_BOOL:
+			case BINARY_LOG_CHAR:
+				if (left < 1)
+					return false;
+				if (type == BINARY_LOG_BOOL)
+					values.push_back(*ptr != std::byte(0));
+				else
+					values.push_back(static_cast<char>(*ptr));
+				ptr++;
+				break;
+			case BINARY_LOG_INT:
+			case BINARY_LOG_UINT:
+			case BINARY_LOG_FLOAT:
+			case BINARY_LOG_POINTER:
+				if (left < 8)
+					return false;
+				if (type == BINARY_LOG_INT)
+					values.push_back(decode_value<int64_t>(ptr));
+				else if (type == BINARY_LOG_UINT)
+					values.push_back(decode_value<uint64_t>(ptr));
+				else if (type == BINARY_LOG_FLOAT)
+					values.push_back(decode_value<double>(ptr));
+				else
+					values.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(decode_value<uint64_t>(ptr))));
+				ptr += 8;
+				break;
+			case BINARY_LOG_STRING: {
+				if (left < 4)
+					return false;
+				const uint32_t length = decode_value<uint32_t>(ptr);
+				ptr += 4;
+				if (length > left - 4)
+					return false;
+				values.push_back(std::string_view(reinterpret_cast<const char*>(ptr), length));
+				ptr += length;
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+// Classes
+void BinaryLogSink::write(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	const uint64_t time,
+	std::string_view message
+) {
+	if (!is_binary_logging())
+		return;
+
+	std::vector<std::byte> &buffer = get_binary_log_buffer();
+	buffer.resize(get_binary_log_arg_size(message));
+	std::byte *ptr = buffer.data();
+	encode_binary_log_arg(ptr, message);
+	write_binary_log_record(level, category, BINARY_LOG_TEXT_FORMAT, time, buffer);
+}
+
+
+BinaryLogReader::BinaryLogReader(const string &file): file(file) {
+	if (!this->file.is_loaded())
+		return;
+
+	const std::span<const std::byte> bytes = this->file.get_bytes();
+	if (bytes.size() < BINARY_LOG_HEADER_SIZE || memcmp(bytes.data(), BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC)) != 0) {
+		FLOG_ERROR(LOG_IO, "Not a binary log ({})", file);
+		return;
+	}
+
+	const uint32_t version = decode_value<uint32_t>(bytes.data() + 4);
+	if (version != BINARY_LOG_VERSION) {
+		FLOG_ERROR(LOG_IO, "Unsupported binary log version {} ({})", version, file);
+		return;
+	}
+
+	loaded = true;
+}
+
+bool BinaryLogReader::is_loaded() const {
+	return loaded;
+}
+
+bool BinaryLogReader::next(BinaryLogMessage &message) {
+	// Returns false at the end of the log
+	if (!loaded)
+		return false;
+
+	const std::span<const std::byte> bytes = file.get_bytes();
+	while (pos + 5 <= bytes.size()) {
+		const std::byte *record = bytes.data() + pos;
+		const uint32_t size = decode_value<uint32_t>(record);
+		// The rest of the last chunk is zeroed if the log wasn't closed
+		if (size == 0)
+			return false;
+		if (size < 5 || size > bytes.size() - pos) {
+			FLOG_WARN(LOG_IO, "The binary log is truncated at offset {}", pos);
+			return false;
+		}
+		pos += size;
+
+		const BINARY_LOG_RECORD type = static_cast<BINARY_LOG_RECORD>(record[4]);
+		if (type == BINARY_LOG_FORMAT && size >= BINARY_LOG_FORMAT_HEADER_SIZE) {
+			const uint32_t id = decode_value<uint32_t>(record + 5);
+			if (id >= formats.size())
+				formats.resize(id + 1);
+			formats[id] = {
+				reinterpret_cast<const char*>(record + BINARY_LOG_FORMAT_HEADER_SIZE),
+				size - BINARY_LOG_FORMAT_HEADER_SIZE
+			};
+		} else if (type == BINARY_LOG_MESSAGE && size >= BINARY_LOG_MESSAGE_HEADER_SIZE) {
+			message.level = static_cast<LOGLEVEL>(record[5]);
+			message.category = static_cast<LOGCATEGORY>(record[6]);
+			message.format_id = decode_value<uint32_t>(record + 7);
+			message.time = decode_value<uint64_t>(record + 11);
+			message.format = (message.format_id < formats.size())? formats[message.format_id] : std::string_view();
+			message.args = {record + BINARY_LOG_MESSAGE_HEADER_SIZE, size - BINARY_LOG_MESSAGE_HEADER_SIZE};
+			return true;
+		}
+		// Unknown records are skipped
+	}
+
+	return false;
+}
+
+
+
+// Functions
+bool open_binary_log(const string &file, const size_t chunk_size) {
+	// Maps the file and starts writing to it, closing the previous log
+	close_binary_log();
+
+	std::lock_guard<std::shared_mutex> lock(log_mutex);
+	log_generation++;
+	log_file.chunk_size = std::max<size_t>(chunk_size, 4096);
+#ifdef MMAP_ENABLED
+	log_file.fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (log_file.fd < 0) {
+		FLOG_ERROR(LOG_IO, "Failed to open binary log ({})", file);
+		return false;
+	}
+#else
+	log_file.writer = std::make_unique<BufferedWriter>(file);
+#endif /* MMAP_ENABLED */
+
+	std::byte header[BINARY_LOG_HEADER_SIZE] = {};
+	std::byte *ptr = header;
+	memcpy(ptr, BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC));
+	ptr += sizeof(BINARY_LOG_MAGIC);
+	encode_binary_log_value<uint32_t>(ptr, BINARY_LOG_VERSION);
+
+	bool success = append_to_log(header, {});
+	// The formats which were registered before the log was opened
+	const std::vector<string> &formats = get_formats();
+	for (size_t i = 0; i < formats.size() && success; i++)
+		success = append_format(i, formats[i]);
+
+	if (!success) {
+		release_log_file();
+		FLOG_ERROR(LOG_IO, "Failed to write binary log ({})", file);
+		return false;
+	}
+
+	binary_logging = true;
+	return true;
+}
+
+void close_binary_log() {
+	std::lock_guard<std::shared_mutex> lock(log_mutex);
+	binary_logging = false;
+	release_log_file();
+}
+
+bool is_binary_logging() {
+	return binary_logging.load(std::memory_order_relaxed);
+}
+
+uint32_t register_binary_log_format(std::string_view format) {
+	// Returns the id of the format string and stores it in the open log
+	bool failed = false;
+	uint32_t id;
+	{
+		std::lock_guard<std::shared_mutex> lock(log_mutex);
+		std::vector<string> &formats = get_formats();
+		id = formats.size();
+		formats.emplace_back(format);
+
+		if (binary_logging && !append_format(id, format)) {
+			fail_binary_log();
+			failed = true;
+		}
+	}
+
+	// Logged outside of the lock since a BinaryLogSink might receive it
+	if (failed)
+		FLOG_ERROR(LOG_IO, "Failed to write binary log, closing it");
+
+	return id;
+}
+
+void write_binary_log_record(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	const uint32_t format_id,
+	const uint64_t time,
+	std::span<const std::byte> args
+) {
+	std::byte header[BINARY_LOG_MESSAGE_HEADER_SIZE];
+	std::byte *ptr = header;
+	encode_binary_log_value<uint32_t>(ptr, BINARY_LOG_MESSAGE_HEADER_SIZE + args.size());
+	*ptr++ = std::byte(BINARY_LOG_MESSAGE);
+	*ptr++ = std::byte(level);
+	*ptr++ = std::byte(category);
+	encode_binary_log_value<uint32_t>(ptr, format_id);
+	encode_binary_log_value<uint64_t>(ptr, time);
+
+	bool failed = false;
+#ifdef MMAP_ENABLED
+	// The threads only share the lock while they copy into the space they
+	// reserved, it's only taken exclusively when the mapping has to grow
+	const size_t size = BINARY_LOG_MESSAGE_HEADER_SIZE + args.size();
+	size_t pos;
+	uint64_t generation;
+	{
+		std::shared_lock<std::shared_mutex> lock(log_mutex);
+		// The log might have been closed since the caller checked
+		if (!binary_logging)
+			return;
+		pos = log_file.used.fetch_add(size, std::memory_order_relaxed);
+		if (pos + size <= log_file.capacity) {
+			write_to_log(pos, header, args);
+			return;
+		}
+		generation = log_generation;
+	}
+
+	{
+		std::lock_guard<std::shared_mutex> lock(log_mutex);
+		// The space belongs to another log if it was reopened in between
+		if (!binary_logging || generation != log_generation)
+			return;
+		if (pos + size > log_file.capacity && !grow_log_file(pos + size)) {
+			fail_binary_log();
+			failed = true;
+		} else
+			write_to_log(pos, header, args);
+	}
+#else
+	{
+		std::lock_guard<std::shared_mutex> lock(log_mutex);
+		// The log might have been closed since the caller checked
+		if (!binary_logging)
+			return;
+		if (!append_to_log(header, args)) {
+			fail_binary_log();
+			failed = true;
+		}
+	}
+#endif /* MMAP_ENABLED */
+
+	if (failed)
+		FLOG_ERROR(LOG_IO, "Failed to write binary log, closing it");
+}
+
+std::vector<std::byte>& get_binary_log_buffer() {
+	// Returns a buffer of the calling thread to encode the arguments into
+	thread_local std::vector<std::byte> buffer;
+	return buffer;
+}
+
+bool format_binary_log_message(const BinaryLogMessage &message, std::string &output) {
+	// Returns false if the arguments don't match the format string
+	output.clear();
+	std::vector<BinaryLogValue> values;
+	if (!decode_args(message.args, values))
+		return false;
+
+	const std::string_view format = message.format;
+	size_t next_arg = 0;
+	for (size_t i = 0; i < format.size(); i++) {
+		const char c = format[i];
+		if (c == '}') {
+			// Escaped as "}}"
+			if (i + 1 < format.size() && format[i + 1] == '}')
+				i++;
+			output += '}';
+			continue;
+		}
+		if (c != '{') {
+			output += c;
+			continue;
+		}
+		if (i + 1 < format.size() && format[i + 1] == '{') {
+			output += '{';
+			i++;
+			continue;
+		}
+
+		const size_t close = format.find('}', i);
+		if (close == std::string_view::npos)
+			return false;
+		const std::string_view field = format.substr(i + 1, close - i - 1);
+		i = close;
+
+		// Nested fields like dynamic widths aren't supported
+		const size_t colon = field.find(':');
+		const std::string_view index = field.substr(0, colon);
+		const std::string_view spec = (colon == std::string_view::npos)? std::string_view() : field.substr(colon + 1);
+		if (spec.find('{') != std::string_view::npos)
+			return false;
+
+		size_t arg = next_arg++;
+		if (!index.empty() && std::from_chars(index.data(), index.data() + index.size(), arg).ec != std::errc())
+			return false;
+		if (arg >= values.size())
+			return false;
+
+		// The specs were checked against the original types at compile time,
+		// but a corrupted log can still pair a spec with the wrong value
+		const string field_format = spec.empty()? string("{}") : "{:" + string(spec) + "}";
+		try {
+			std::visit([&](const auto &value) {
+				output += std::vformat(field_format, std::make_format_args(value));
+			}, values[arg]);
+		} catch (const std::format_error&) {
+			return false;
+		}
+	}
+
+	return true;
+}
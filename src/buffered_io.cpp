@@ -0,0 +1,197 @@
+#include "buffered_io.h"
+
+#include <cctype>
+
+#include "logging.h"
+
+
+
+// Classes
+BufferedReader::BufferedReader(IO &io, const size_t buffer_size):
+	io(&io), buffer(std::max<size_t>(buffer_size, 16)) {}
+
+BufferedReader::BufferedReader(const string &file, const size_t buffer_size):
+	owned_io(std::make_unique<IO>(file, "rb")), io(owned_io.get()), buffer(std::max<size_t>(buffer_size, 16)) {}
+
+bool BufferedReader::fill() {
+	// Moves the unread data to the front and reads more after it
+	if (eof)
+		return false;
+
+	if (start > 0) {
+		memmove(buffer.data(), buffer.data() + start, end - start);
+		end -= start;
+		start = 0;
+	}
+	if (end == buffer.size())
+		buffer.resize(buffer.size()*2);
+
+	const int count = io->read(buffer.data() + end, buffer.size() - end);
+	if (count <= 0) {
+		eof = true;
+		return false;
+	}
+	end += count;
+
+	return true;
+}
+
+bool BufferedReader::read_line(std::string_view &line) {
+	// Returns false at the end of the file
+	size_t scanned = 0;
+	while (true) {
+		const char *data = buffer.data() + start;
+		const char *newline = static_cast<const char*>(memchr(data + scanned, '\n', end - start - scanned));
+
+		// Only the new data has to be searched after filling
+		const size_t pending = end - start;
+		size_t length;
+		if (newline != nullptr)
+			length = newline - data;
+		else if (eof || !fill()) {
+			// The last line might not end with a newline
+			if (start == end)
+				return false;
+			length = end - start;
+		} else {
+			scanned = pending;
+			continue;
+		}
+
+		line = {buffer.data() + start, length};
+		start = std::min(start + length + 1, end);
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+
+		return true;
+	}
+}
+
+size_t BufferedReader::read(void *ptr, const size_t size) {
+	// Returns the number of bytes read
+	char *dst = static_cast<char*>(ptr);
+	size_t copied = std::min(size, end - start);
+	memcpy(dst, buffer.data() + start, copied);
+	start += copied;
+
+	while (copied < size) {
+		const size_t left = size - copied;
+		if (left >= buffer.size()) {
+			// Large reads skip the buffer
+			const int count = io->read(dst + copied, left);
+			if (count <= 0) {
+				eof = true;
+				break;
+			}
+			copied += count;
+		} else {
+			if (!fill())
+				break;
+			const size_t count = std::min(left, end - start);
+			memcpy(dst + copied, buffer.data() + start, count);
+			start += count;
+			copied += count;
+		}
+	}
+
+	return copied;
+}
+
+bool BufferedReader::is_eof() const {
+	return eof && start == end;
+}
+
+
+BufferedWriter::BufferedWriter(IO &io, const size_t buffer_size):
+	io(&io), buffer(std::max<size_t>(buffer_size, 16)) {}
+
+BufferedWriter::BufferedWriter(const string &file, const size_t buffer_size):
+	owned_io(std::make_unique<IO>(file, "wb")), io(owned_io.get()), buffer(std::max<size_t>(buffer_size, 16)) {}
+
+BufferedWriter::~BufferedWriter() {
+	flush();
+}
+
+void BufferedWriter::write(const void *ptr, const size_t size) {
+	if (this->size + size > buffer.size())
+		flush();
+
+	if (size >= buffer.size()) {
+		// Large writes skip the buffer
+		io->write(ptr, size);
+		return;
+	}
+
+	memcpy(buffer.data() + this->size, ptr, size);
+	this->size += size;
+}
+
+void BufferedWriter::write(std::string_view data) {
+	write(data.data(), data.size());
+}
+
+void BufferedWriter::write_line(std::string_view line) {
+	// Appends a '\n' after the line
+	write(line.data(), line.size());
+	write("\n", 1);
+}
+
+void BufferedWriter::flush() {
+	if (size > 0) {
+		io->write(buffer.data(), size);
+		size = 0;
+	}
+}
+
+
+Tokenizer::Tokenizer(std::string_view text, const char delimiter): text(text), delimiter(delimiter) {}
+
+bool Tokenizer::next(std::string_view &token) {
+	// Returns false if there are no more tokens
+	if (delimiter == ' ') {
+		while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+			pos++;
+		if (pos == text.size())
+			return false;
+
+		const size_t begin = pos;
+		while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])))
+			pos++;
+		token = text.substr(begin, pos - begin);
+		return true;
+	}
+
+	// One position past the end marks that the last field was returned
+	if (pos > text.size())
+		return false;
+
+	if (pos < text.size() && text[pos] == '"') {
+		// Doubled quotes are skipped over but not unescaped
+		size_t close = pos + 1;
+		while ((close = text.find('"', close)) != std::string_view::npos && close + 1 < text.size() && text[close + 1] == '"')
+			close += 2;
+		if (close != std::string_view::npos) {
+			token = text.substr(pos + 1, close - pos - 1);
+			const size_t separator = text.find(delimiter, close + 1);
+			pos = (separator == std::string_view::npos)? text.size() + 1 : separator + 1;
+			return true;
+		}
+		FLOG_WARN(LOG_IO, "Unterminated quoted field, reading it as a plain field.");
+	}
+
+	const size_t separator = text.find(delimiter, pos);
+	if (separator == std::string_view::npos) {
+		token = text.substr(pos);
+		pos = text.size() + 1;
+	} else {
+		token = text.substr(pos, separator - pos);
+		pos = separator + 1;
+	}
+
+	return true;
+}
+
+std::string_view Tokenizer::get_remaining() const {
+	// Returns the text which hasn't been tokenized yet
+	return (pos < text.size())? text.substr(pos) : std::string_view();
+}
@@ -0,0 +1,211 @@
+#include "camera.h"
+
+#include <algorithm>
+
+#include "logging.h"
+
+
+
+// Helper functions
+static uint64_t get_frame_ns(const float fps) {
+	return static_cast<uint64_t>(1e9/std::max(fps, 0.001f));
+}
+
+static bool is_frame_due(uint64_t &next_ns, const uint64_t frame_ns, uint64_t &time_stamp) {
+	const uint64_t now = SDL_GetTicksNS();
+	if (now < next_ns)
+		return false;
+
+	// Frames missed while the worker was busy are skipped instead of being
+	// produced in a burst
+	next_ns = std::max(next_ns + frame_ns, now);
+	time_stamp = now;
+	return true;
+}
+
+static void draw_test_frame(Surface &frame, const uint64_t index) {
+	const uint8_t shade = index % 256;
+	frame.fill({shade, static_cast<uint8_t>(255 - shade), 128});
+
+	const int bar_w = std::max(frame.w/16, 1);
+	const int bar_x = (index*4) % (frame.w + bar_w) - bar_w;
+	frame.fill_rect({bar_x, 0, bar_w, frame.h}, {255, 255, 255});
+}
+
+
+
+// Classes
+CameraSource::CameraSource(const int id): camera(id) {}
+
+IVector CameraSource::get_size() {
+	return camera.size;
+}
+
+Surface* CameraSource::acquire_frame(uint64_t &time_stamp) {
+	if (!camera.is_new_frame_available())
+		return nullptr;
+
+	time_stamp = camera.time_stamp;
+	return &camera.acquire_frame();
+}
+
+void CameraSource::release_frame() {
+	camera.release_frame();
+}
+
+
+SyntheticSource::SyntheticSource(const IVector &size, const float fps, Generator generator, const SDL_PixelFormat format):
+	frame(size, format), frame_ns(get_frame_ns(fps)), generator(generator) {
+	if (this->generator == nullptr)
+		this->generator = draw_test_frame;
+}
+
+IVector SyntheticSource::get_size() {
+	return {frame.w, frame.h};
+}
+
+Surface* SyntheticSource::acquire_frame(uint64_t &time_stamp) {
+	if (!is_frame_due(next_ns, frame_ns, time_stamp))
+		return nullptr;
+
+	generator(frame, index++);
+	return &frame;
+}
+
+void SyntheticSource::release_frame() {}
+
+
+FileSource::FileSource(const std::vector<string> &files, const float fps): frame_ns(get_frame_ns(fps)) {
+	frames.reserve(files.size());
+	for (const string &file: files) {
+		Surface frame(file);
+		if (frame.surface != nullptr)
+			frames.push_back(std::move(frame));
+	}
+
+	if (frames.empty())
+		FLOG_ERROR(LOG_CORE, "No frames could be loaded for the file source!");
+}
+
+IVector FileSource::get_size() {
+	if (frames.empty())
+		return {0, 0};
+
+	return {frames[0].w, frames[0].h};
+}
+
+Surface* FileSource::acquire_frame(uint64_t &time_stamp) {
+	if (frames.empty() || !is_frame_due(next_ns, frame_ns, time_stamp))
+		return nullptr;
+
+	Surface *frame = &frames[index];
+	index = (index + 1) % frames.size();
+	return frame;
+}
+
+void FileSource::release_frame() {}
+
+
+CameraPipeline::CameraPipeline(std::unique_ptr<FrameSource> source, const SDL_PixelFormat format, const int ring_size):
+	source(std::move(source)), format(format) {
+	size = this->source->get_size();
+
+	const int count = std::max(ring_size, 3);
+	frames.reserve(count);
+	for (int i = 0; i < count; i++)
+		frames.emplace_back(size, format);
+	time_stamps.resize(count, 0);
+
+	worker = std::thread(&CameraPipeline::capture_loop, this);
+	FLOG_INFO(LOG_CORE, "Camera pipeline started! ({} frames)", count);
+}
+
+CameraPipeline::CameraPipeline(std::unique_ptr<FrameSource> source, Renderer &renderer, const int ring_size):
+	CameraPipeline(std::move(source), renderer.get_preferred_format(), ring_size) {}
+
+CameraPipeline::~CameraPipeline() {
+	running = false;
+	worker.join();
+}
+
+int CameraPipeline::get_free_slot() const {
+	for (int i = 0; i < static_cast<int>(frames.size()); i++) {
+		if (i != latest && i != reading)
+			return i;
+	}
+
+	return -1;
+}
+
+void CameraPipeline::capture_loop() {
+	while (running) {
+		uint64_t frame_time_stamp = 0;
+		Surface *frame = source->acquire_frame(frame_time_stamp);
+		if (frame == nullptr) {
+			SDL_Delay(1);
+			continue;
+		}
+
+		int slot;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot = get_free_slot();
+		}
+
+		// The slot is neither published nor being read, so only this
+		// thread touches it until it's published
+		const IVector frame_size = {frame->w, frame->h};
+		const bool resized = (frame_size.x != frames[slot].w || frame_size.y != frames[slot].h);
+		if (resized) {
+			FLOG_WARN(LOG_CORE, "Camera frame size changed, reallocating the frame.");
+			frames[slot] = Surface(frame_size, format);
+		}
+
+		const uint64_t start = SDL_GetTicksNS();
+		frame->convert_format(frames[slot]);
+		const uint64_t conversion_ns = SDL_GetTicksNS() - start;
+		source->release_frame();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		// Latest frame wins, the previous one is dropped if it wasn't
+		// acquired yet
+		if (fresh)
+			stats.dropped++;
+		stats.captured++;
+		stats.conversion_ns = conversion_ns;
+		if (resized)
+			size = frame_size;
+		time_stamps[slot] = frame_time_stamp;
+		latest = slot;
+		fresh = true;
+	}
+}
+
+IVector CameraPipeline::get_size() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return size;
+}
+
+bool CameraPipeline::is_new_frame_available() {
+	// This function must be called before acquire_frame()
+	// Otherwise acquire_frame() will keep returning the old frame
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!fresh)
+		return false;
+
+	reading = latest;
+	time_stamp = time_stamps[reading];
+	fresh = false;
+	stats.delivered++;
+	return true;
+}
+
+const Surface& CameraPipeline::acquire_frame() {
+	// The frame stays valid until the next call to is_new_frame_available()
+	return frames[reading];
+}
+
+CameraPipelineStats CameraPipeline::get_stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
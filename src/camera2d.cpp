@@ -0,0 +1,109 @@
+#include "core.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logging.h"
+
+
+
+// Classes
+Camera2D::Camera2D(const Rect &viewport): viewport(viewport) {
+	update();
+}
+
+void Camera2D::update() {
+	// Caches the rotation and the world rect inside the viewport
+	cos_rot = std::cos(radians(rotation));
+	sin_rot = std::sin(radians(rotation));
+
+	const Vector corners[4] = {
+		screen_to_world({viewport.x, viewport.y}),
+		screen_to_world({viewport.x + viewport.w, viewport.y}),
+		screen_to_world({viewport.x + viewport.w, viewport.y + viewport.h}),
+		screen_to_world({viewport.x, viewport.y + viewport.h})
+	};
+	float left = corners[0].x, right = corners[0].x, top = corners[0].y, bottom = corners[0].y;
+	for (const Vector &corner: corners) {
+		left = std::min(left, corner.x);
+		right = std::max(right, corner.x);
+		top = std::min(top, corner.y);
+		bottom = std::max(bottom, corner.y);
+	}
+	view_rect = {left, top, right - left, bottom - top};
+}
+
+void Camera2D::set_position(const Vector &position) {
+	this->position = position;
+	update();
+}
+
+Vector Camera2D::get_position() const {
+	return position;
+}
+
+void Camera2D::move(const Vector &offset) {
+	set_position({position.x + offset.x, position.y + offset.y});
+}
+
+void Camera2D::set_zoom(const float zoom) {
+	if (zoom <= 0) {
+		FLOG_WARN(LOG_RENDER, "The zoom of a camera has to be positive, got {}", zoom);
+		return;
+	}
+
+	this->zoom = zoom;
+	update();
+}
+
+float Camera2D::get_zoom() const {
+	return zoom;
+}
+
+void Camera2D::set_rotation(const float rotation) {
+	this->rotation = std::fmod(rotation, 360.0f);
+	update();
+}
+
+float Camera2D::get_rotation() const {
+	return rotation;
+}
+
+void Camera2D::set_viewport(const Rect &viewport) {
+	this->viewport = viewport;
+	update();
+}
+
+const Rect& Camera2D::get_viewport() const {
+	return viewport;
+}
+
+Vector Camera2D::world_to_screen(const Vector &pos) const {
+	// The world is rotated the opposite way of the camera
+	const float x = (pos.x - position.x)*zoom, y = (pos.y - position.y)*zoom;
+	return {
+		viewport.x + viewport.w*0.5f + x*cos_rot + y*sin_rot,
+		viewport.y + viewport.h*0.5f - x*sin_rot + y*cos_rot
+	};
+}
+
+Vector Camera2D::screen_to_world(const Vector &pos) const {
+	const float x = pos.x - viewport.x - viewport.w*0.5f, y = pos.y - viewport.y - viewport.h*0.5f;
+	return {
+		position.x + (x*cos_rot - y*sin_rot)/zoom,
+		position.y + (x*sin_rot + y*cos_rot)/zoom
+	};
+}
+
+const Rect& Camera2D::get_view_rect() const {
+	return view_rect;
+}
+
+bool Camera2D::is_visible(const Rect &rect) const {
+	// AABB test against the view rect
+	return rect.x < view_rect.x + view_rect.w && rect.x + rect.w > view_rect.x && rect.y < view_rect.y + view_rect.h && rect.y + rect.h > view_rect.y;
+}
+
+bool Camera2D::is_visible(const Circle &circle) const {
+	return is_visible(Rect(circle.x - circle.r, circle.y - circle.r, 2*circle.r, 2*circle.r));
+}
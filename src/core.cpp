@@ -1,5 +1,7 @@
 #include "core.h"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cmath>
 #include <ctime>
@@ -53,7 +55,7 @@ int randint(const int start, const int end) {
 }
 
 void image_function_not_implemented(const string &str) {
-	flog_error("Engine was not built with SDL_image support! {} not available.", str);
+	FLOG_ERROR(LOG_CORE, "Engine was not built with SDL_image support! {} not available.", str);
 	assert(0);
 }
 
@@ -68,7 +70,7 @@ void trigger_back_button() {
 void* get_activity() {
 	void *activity;
 	if ((activity = SDL_AndroidGetActivity()) == NULL) {
-		flog_error("Failed to get the android activity: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to get the android activity: {}", SDL_GetError());
 	}
 
 	return activity;
@@ -81,7 +83,7 @@ string get_external_storage_path() {
 int get_external_storage_state() {
 	uint32_t state;
 	if (SDL_AndroidGetExternalStorageState(&state) < 0) {
-		flog_error("Failed to get external storage state: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to get external storage state: {}", SDL_GetError());
 	}
 	return state;
 }
@@ -93,7 +95,7 @@ string get_internal_storage_path() {
 void* get_jni_env() {
 	void *jni;
 	if ((jni = SDL_AndroidGetJNIEnv()) == 0) {
-		flog_error("Failed to get JNIEnv: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to get JNIEnv: {}", SDL_GetError());
 	}
 
 	return jni;
@@ -115,7 +117,7 @@ void show_toast(const string message, const bool duration, const int gravity, co
 
 // Structs
 std::ostream& operator<<(std::ostream &os, Colour const &colour) {
-	std::cout << colour.to_str();
+	os << colour.to_str();
 		return os;
 }
 
@@ -151,6 +153,10 @@ void operator/=(Colour &colour, const float val) {
 	colour.a /= val;
 }
 
+bool operator==(const Colour &colour1, const Colour &colour2) {
+	return colour1.r == colour2.r && colour1.g == colour2.g && colour1.b == colour2.b && colour1.a == colour2.a;
+}
+
 Colour::operator FColour() const{
 	return {
 		static_cast<float>(r/255.0f),
@@ -188,7 +194,7 @@ Colour Colour::modulate(const float mod_r, const float mod_g, const float mod_b,
 
 
 std::ostream& operator<<(std::ostream &os, const FColour &fcolour) {
-	std::cout << fcolour.to_str();
+	os << fcolour.to_str();
 		return os;
 }
 
@@ -252,7 +258,7 @@ FColour FColour::modulate(const float mod_r, const float mod_g, const float mod_
 
 
 std::ostream& operator<<(std::ostream &os, IVector const &ivector) {
-	std::cout << ivector.to_str();
+	os << ivector.to_str();
 		return os;
 }
 
@@ -341,7 +347,7 @@ Vector IRect::half_size() const {
 
 
 std::ostream& operator<<(std::ostream &os, const Vector &vector) {
-	std::cout << vector.to_str();
+	os << vector.to_str();
 	return os;
 }
 
@@ -514,7 +520,7 @@ IRect::IRect(const IVector &pos, const IVector &size) {
 }
 
 std::ostream& operator<<(std::ostream &os, IRect const &IRect) {
-	std::cout << IRect.to_str();
+	os << IRect.to_str();
 	return os;
 }
 
@@ -546,7 +552,7 @@ Rect::Rect(const Vector &pos, const Vector &size) {
 }
 
 std::ostream& operator<<(std::ostream &os, Rect const &rect) {
-	std::cout << rect.to_str();
+	os << rect.to_str();
 	return os;
 }
 
@@ -790,7 +796,7 @@ Circle::Circle(const Vector &vec, const float radius) {
 }
 
 std::ostream& operator<<(std::ostream &os, const Circle &circle) {
-	std::cout << circle.to_str();
+	os << circle.to_str();
 	return os;
 }
 
@@ -863,23 +869,28 @@ void Circle::move_ip(const Vector &vec) {
 
 
 // Classes
-Engine::Engine(const unsigned int init_flags) {
+Engine::Engine(const unsigned int init_flags, const bool headless) {
+	if (headless) {
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+		SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+	}
 	if (!SDL_Init(init_flags))
-		flog_error("Failed to initialize SDL: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to initialize SDL: {}", SDL_GetError());
 #ifdef MIXER_ENABLED
 	if (!MIX_Init())
-		flog_error("Failed to initialize SDL_mixer: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to initialize SDL_mixer: {}", SDL_GetError());
 #endif /* MIXER_ENABLED */
 #ifdef TTF_ENABLED
 	if (!TTF_Init())
-		flog_error("Failed to initialize SDL_ttf: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to initialize SDL_ttf: {}", SDL_GetError());
 #endif /* TTF_ENABLED */
 #ifdef NET_ENABLED
 	if (!NET_Init())
-		flog_error("Failed to initialize SDL_net: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to initialize SDL_net: {}", SDL_GetError());
 #endif /* TTF_ENABLED */
 	srand((unsigned) time(NULL)); // Create a seed for random number generation
-	flog_info("Engine started!");
+	FLOG_INFO(LOG_CORE, "Engine started!");
 }
 
 Engine::~Engine() {
@@ -893,7 +904,7 @@ Engine::~Engine() {
 	NET_Quit();
 #endif /* NET_ENABLED */
 	SDL_Quit();
-	flog_info("Engine stopped!");
+	FLOG_INFO(LOG_CORE, "Engine stopped!");
 }
 
 
@@ -965,7 +976,7 @@ IO::IO(const string &file, const string access_mode) {
 	io = SDL_IOFromFile(file.c_str(), access_mode.c_str());
 
 	if (io == NULL)
-		flog_error("Failed to load file! ({}): {}", file, SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to load file! ({}): {}", file, SDL_GetError());
 	else
 		IS_LOADED = true;
 }
@@ -987,42 +998,69 @@ int IO::read(void *ptr, const int max) {
 	// Returns the number of objects read or -1 on error
 	if (IS_LOADED)
 		return SDL_ReadIO(io, ptr, max);
-	flog_warn("Failed to read: file not loaded successfully!");
+	FLOG_WARN(LOG_CORE, "Failed to read: file not loaded successfully!");
 	return -1;
 }
 
 string IO::read() {
 	// Reads the whole file at once to a string
-	int size;
-	Sint64 file_size = get_file_size();
-	std::vector<char> buffer(file_size + 1);
-
-	if ((size = read(buffer.data(), file_size)) == file_size) {
-		buffer[size] = '\0';
-		return string(buffer.data());
+	// Returns an empty string on error
+	const int64_t file_size = get_file_size();
+	if (file_size < 0)
+		return "";
+
+	// Read straight into the string instead of going through a buffer
+	string data(file_size, '\0');
+	const int size = read(data.data(), file_size);
+	if (size != file_size) {
+		FLOG_WARN(LOG_CORE, "Failed to read the whole file: {}", SDL_GetError());
+		return "";
 	}
-	return NULL;
+
+	return data;
 }
 
 string IO::read(const int max) {
 	// Reads the next max number of chars from the file to a string
-	int size;
-	std::vector<char> buffer(max + 1);
+	string data(max, '\0');
+	const int size = read(data.data(), max);
+	if (size < 0)
+		return "";
+
+	data.resize(size);
+	return data;
+}
+
+std::pmr::string IO::read(std::pmr::memory_resource *resource) {
+	const int64_t file_size = get_file_size();
+	if (file_size < 0)
+		return std::pmr::string(resource);
 
-	if ((size = read(buffer.data(), max)) >= 0) {
-		buffer[size] = '\0';
-		return string(buffer.data());
+	std::pmr::string data(file_size, '\0', resource);
+	const int size = read(data.data(), file_size);
+	if (size != file_size) {
+		FLOG_WARN(LOG_CORE, "Failed to read the whole file: {}", SDL_GetError());
+		data.clear();
 	}
-	return NULL;
+
+	return data;
+}
+
+std::pmr::string IO::read(const int max, std::pmr::memory_resource *resource) {
+	std::pmr::string data(max, '\0', resource);
+	const int size = read(data.data(), max);
+	data.resize(std::max(size, 0));
+
+	return data;
 }
 
 void IO::write(const void *ptr, const size_t num) {
 	// The num parameter takes the number of objects to write
 	// Returns the numer of objects written
 	if (!IS_LOADED)
-		flog_warn("Failed to write: file not loaded successfully!");
+		FLOG_WARN(LOG_CORE, "Failed to write: file not loaded successfully!");
 	else if (SDL_WriteIO(io, ptr, num) < num)
-		flog_warn("Failed to write all the objects: {}", SDL_GetError());
+		FLOG_WARN(LOG_CORE, "Failed to write all the objects: {}", SDL_GetError());
 }
 
 void IO::write(const string &data) {
@@ -1032,14 +1070,14 @@ void IO::write(const string &data) {
 int64_t IO::tell() {
 	if (IS_LOADED)
 		return SDL_TellIO(io);
-	flog_warn("Failed to tell: file not loaded successfully!");
+	FLOG_WARN(LOG_CORE, "Failed to tell: file not loaded successfully!");
 	return -1;
 }
 
 int64_t IO::seek(int64_t offset, SDL_IOWhence whence) {
 	if (IS_LOADED)
 		return SDL_SeekIO(io, offset, whence);
-	flog_warn("Failed to seek: file not loaded successfully!");
+	FLOG_WARN(LOG_CORE, "Failed to seek: file not loaded successfully!");
 	return -1;
 }
 
@@ -1055,9 +1093,9 @@ void IO::close() {
 Window::Window(const string &title, const IVector &size, const uint32_t flags):
 	window(managed_ptr<SDL_Window>(SDL_CreateWindow(title.c_str(), size.x,size.y, flags), destroy)) {
 	if (window.get() == NULL)
-		flog_error("Failed to create window: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to create window: {}", SDL_GetError());
 	else
-		flog_info("Window created successfully!");
+		FLOG_INFO(LOG_CORE, "Window created successfully!");
 }
 
 IVector Window::size() const {
@@ -1093,29 +1131,60 @@ void Window::start_text_input() {
 
 void Window::destroy(SDL_Window *window) {
 	SDL_DestroyWindow(window);
-	flog_info("Window closed successfully!");
+	FLOG_INFO(LOG_CORE, "Window closed successfully!");
 }
 
 
 Renderer::Renderer(Window &window, const string &driver):
-		renderer(managed_ptr<SDL_Renderer>((driver == "")? SDL_CreateRenderer(window.window.get(), NULL) : SDL_CreateRenderer(window.window.get(), driver.c_str()),destroy)) {
+		renderer(managed_ptr<SDL_Renderer>((driver == "")? SDL_CreateRenderer(window.window.get(), NULL) : SDL_CreateRenderer(window.window.get(), driver.c_str()),destroy)), queue(*this) {
+	if (renderer.get() == NULL)
+		FLOG_ERROR(LOG_RENDER, "Failed to create renderer: {}", SDL_GetError());
+	else
+		FLOG_INFO(LOG_RENDER, "Renderer created successfully!");
+}
+
+bool Renderer::count_state_change(const bool changed) {
+	if (changed) {
+		issued_state_changes++;
+		frame_stats.state_changes++;
+	} else {
+		skipped_state_changes++;
+		frame_stats.skipped_state_changes++;
+	}
+
+	return changed;
+}
+
+Renderer::Renderer(Surface &surface):
+		renderer(managed_ptr<SDL_Renderer>(SDL_CreateSoftwareRenderer(surface.surface.get()), destroy)), queue(*this) {
 	if (renderer.get() == NULL)
-		flog_error("Failed to create renderer: {}", SDL_GetError());
+		FLOG_ERROR(LOG_RENDER, "Failed to create software renderer: {}", SDL_GetError());
 	else
-		flog_info("Renderer created successfully!");
+		FLOG_INFO(LOG_RENDER, "Software renderer created successfully!");
 }
 
 void Renderer::set_colour(const Colour &colour) {
+	if (!count_state_change(!colour_known || colour != this->colour))
+		return;
+
 	SDL_SetRenderDrawColor(renderer.get(), colour.r, colour.g, colour.b, colour.a);
+	this->colour = colour;
+	colour_known = true;
 }
 
 void Renderer::clear(const Colour &colour) {
 	set_colour(colour);
 	SDL_RenderClear(renderer.get());
+	count_draw(nullptr, 0);
 }
 
 void Renderer::present() {
+	queue.flush();
 	SDL_RenderPresent(renderer.get());
+	// Nothing from the frame is needed anymore
+	get_frame_arena().reset();
+	last_stats = frame_stats;
+	frame_stats = {};
 }
 
 void Renderer::flush() {
@@ -1123,15 +1192,143 @@ void Renderer::flush() {
 }
 
 void Renderer::set_blend_mode(const SDL_BlendMode blendmode) {
+	if (!count_state_change(!blend_mode_known || blendmode != blend_mode))
+		return;
+
 	SDL_SetRenderDrawBlendMode(renderer.get(), blendmode);
+	blend_mode = blendmode;
+	blend_mode_known = true;
+}
+
+SDL_BlendMode Renderer::get_blend_mode() {
+	if (!blend_mode_known)
+		blend_mode_known = SDL_GetRenderDrawBlendMode(renderer.get(), &blend_mode);
+
+	return blend_mode;
 }
 
 void Renderer::set_target() {
-	SDL_SetRenderTarget(renderer.get(), NULL);
+	set_target(static_cast<SDL_Texture*>(nullptr));
 }
 
 void Renderer::set_target(Texture &tex) {
-	SDL_SetRenderTarget(renderer.get(), tex.texture.get());
+	set_target(tex.texture.get());
+}
+
+void Renderer::set_target(SDL_Texture *target) {
+	if (!count_state_change(!target_known || target != this->target))
+		return;
+
+	SDL_SetRenderTarget(renderer.get(), target);
+	this->target = target;
+	target_known = true;
+	frame_stats.target_switches++;
+	// Every target has its own clip rect and scale
+	clip_known = scale_known = false;
+}
+
+SDL_Texture* Renderer::get_target() {
+	if (!target_known) {
+		target = SDL_GetRenderTarget(renderer.get());
+		target_known = true;
+	}
+
+	return target;
+}
+
+void Renderer::set_clip_rect(const IRect &rect) {
+	const SDL_Rect clip = rect;
+	const bool changed = !clip_known || !clip_enabled || clip.x != clip_rect.x || clip.y != clip_rect.y || clip.w != clip_rect.w || clip.h != clip_rect.h;
+	if (!count_state_change(changed))
+		return;
+
+	SDL_SetRenderClipRect(renderer.get(), &clip);
+	clip_rect = clip;
+	clip_enabled = clip_known = true;
+}
+
+void Renderer::reset_clip_rect() {
+	if (!count_state_change(!clip_known || clip_enabled))
+		return;
+
+	SDL_SetRenderClipRect(renderer.get(), NULL);
+	clip_enabled = false;
+	clip_known = true;
+}
+
+bool Renderer::get_clip_rect(IRect &rect) {
+	if (!clip_known) {
+		clip_enabled = SDL_RenderClipEnabled(renderer.get());
+		if (clip_enabled)
+			SDL_GetRenderClipRect(renderer.get(), &clip_rect);
+		clip_known = true;
+	}
+
+	if (clip_enabled)
+		rect = {clip_rect.x, clip_rect.y, clip_rect.w, clip_rect.h};
+	return clip_enabled;
+}
+
+void Renderer::set_scale(const Vector &scale) {
+	if (!count_state_change(!scale_known || scale.x != this->scale.x || scale.y != this->scale.y))
+		return;
+
+	SDL_SetRenderScale(renderer.get(), scale.x, scale.y);
+	this->scale = scale;
+	scale_known = true;
+}
+
+Vector Renderer::get_scale() {
+	if (!scale_known)
+		scale_known = SDL_GetRenderScale(renderer.get(), &scale.x, &scale.y);
+
+	return scale;
+}
+
+void Renderer::invalidate_state() {
+	colour_known = blend_mode_known = target_known = clip_known = scale_known = false;
+}
+
+int Renderer::get_issued_state_changes() const {
+	return issued_state_changes;
+}
+
+int Renderer::get_skipped_state_changes() const {
+	return skipped_state_changes;
+}
+
+void Renderer::reset_state_changes() {
+	issued_state_changes = skipped_state_changes = 0;
+}
+
+const RenderStats& Renderer::get_stats() const {
+	return last_stats;
+}
+
+void Renderer::count_draw(SDL_Texture *texture, const int vertices, const int draw_calls) {
+	frame_stats.draw_calls += draw_calls;
+	frame_stats.vertices += vertices;
+	if (texture != nullptr && texture != last_texture) {
+		frame_stats.texture_binds++;
+		last_texture = texture;
+	}
+}
+
+void Renderer::count_batch(const int quads) {
+	frame_stats.batches++;
+	frame_stats.batched_quads += quads;
+}
+
+void Renderer::set_camera(const Camera2D &camera) {
+	this->camera = &camera;
+}
+
+void Renderer::reset_camera() {
+	camera = nullptr;
+}
+
+const Camera2D* Renderer::get_camera() const {
+	return camera;
 }
 
 void Renderer::set_logical_presentation(const IVector &size, const SDL_RendererLogicalPresentation mode) {
@@ -1148,8 +1345,20 @@ string Renderer::get_driver_name() {
 	return string(SDL_GetRendererName(renderer.get()));
 }
 
+SDL_PixelFormat Renderer::get_preferred_format() {
+	// Returns the first texture format supported by the renderer
+	const SDL_PixelFormat *formats = static_cast<const SDL_PixelFormat*>(SDL_GetPointerProperty(
+		SDL_GetRendererProperties(renderer.get()), SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER, NULL
+	));
+	if (formats == nullptr || *formats == SDL_PIXELFORMAT_UNKNOWN)
+		return SDL_PIXELFORMAT_RGBA32;
+
+	return formats[0];
+}
+
 void Renderer::draw_point_raw(const Vector &point_pos) {
 	SDL_RenderPoint(renderer.get(), point_pos.x, point_pos.y);
+	count_draw(nullptr, 1);
 }
 
 void Renderer::draw_point(const Vector &point_pos, const Colour &colour) {
@@ -1159,6 +1368,7 @@ void Renderer::draw_point(const Vector &point_pos, const Colour &colour) {
 
 void Renderer::draw_line_raw(const Vector &v1, const Vector &v2) {
 	SDL_RenderLine(renderer.get(), v1.x, v1.y, v2.x, v2.y);
+	count_draw(nullptr, 2);
 }
 
 void Renderer::draw_line(const Vector &v1, const Vector &v2, const Colour &colour) {
@@ -1182,15 +1392,18 @@ void Renderer::draw_line(const Vector &v1, const Vector &v2, const Colour &colou
 	int indices[6] = {0, 1, 2, 0, 2, 3};
 
 	SDL_RenderGeometry(renderer.get(), NULL, vertices, 4, indices, 6);
+	count_draw(nullptr, 4);
 }
 
 void Renderer::draw_rect_raw(const Rect &rect, float width) {
 	if (width == 0) {
 		SDL_FRect r = rect;
 		SDL_RenderFillRect(renderer.get(), &r);
+		count_draw(nullptr, 4);
 	} else if (width == 1) {
 		SDL_FRect r = rect;
 		SDL_RenderRect(renderer.get(), &r);
+		count_draw(nullptr, 4);
 	} else {
 		SDL_FRect r1 = {rect.x - width, rect.y - width, rect.w + 2*width, width};
 		SDL_FRect r2 = {rect.x - width, rect.y + rect.h, rect.w + 2*width, width};
@@ -1200,6 +1413,7 @@ void Renderer::draw_rect_raw(const Rect &rect, float width) {
 		SDL_RenderFillRect(renderer.get(), &r2);
 		SDL_RenderFillRect(renderer.get(), &r3);
 		SDL_RenderFillRect(renderer.get(), &r4);
+		count_draw(nullptr, 16, 4);
 	}
 }
 
@@ -1235,6 +1449,7 @@ void Renderer::draw_circle(const Circle &circle, const Colour &colour, const boo
 		}
 
 		SDL_RenderGeometry(renderer.get(), NULL, vertices, tris - 3, NULL, tris - 3);
+		count_draw(nullptr, tris - 3);
 
 	} else {
 		int x = circle.r, y = 0;
@@ -1244,6 +1459,7 @@ void Renderer::draw_circle(const Circle &circle, const Colour &colour, const boo
 		// Printing the initial point on the axes
 		// after translation
 		SDL_RenderPoint(renderer.get(), x + circle.x, circle.y);
+		int points = 1;
 
 		// When radius is zero only a single
 		// point will be printed
@@ -1251,6 +1467,7 @@ void Renderer::draw_circle(const Circle &circle, const Colour &colour, const boo
 			SDL_RenderPoint(renderer.get(), -x + circle.x, circle.y);
 			SDL_RenderPoint(renderer.get(), circle.x, -x + circle.y);
 			SDL_RenderPoint(renderer.get(), circle.x, x + circle.y);
+			points += 3;
 		}
 
 		// Initialising the value of P
@@ -1277,6 +1494,7 @@ void Renderer::draw_circle(const Circle &circle, const Colour &colour, const boo
 			SDL_RenderPoint(renderer.get(), -x + circle.x, y + circle.y);
 			SDL_RenderPoint(renderer.get(), x + circle.x, -y + circle.y);
 			SDL_RenderPoint(renderer.get(), -x + circle.x, -y + circle.y);
+			points += 4;
 
 			// If the generated point is on the line x = y then
 			// the perimeter points have already been printed
@@ -1285,31 +1503,46 @@ void Renderer::draw_circle(const Circle &circle, const Colour &colour, const boo
 				SDL_RenderPoint(renderer.get(), -y + circle.x, x + circle.y);
 				SDL_RenderPoint(renderer.get(), y + circle.x, -x + circle.y);
 				SDL_RenderPoint(renderer.get(), -y + circle.x, -x + circle.y);
+				points += 4;
 			}
 		}
+		count_draw(nullptr, points, points);
+	}
+}
+
+// Triangulates a convex polygon as a fan around the first vertex
+// The indices are allocated from the frame arena
+static std::pmr::vector<int> get_fan_indices(const int n) {
+	std::pmr::vector<int> indices(&get_frame_arena());
+	if (n < 3)
+		return indices;
+
+	indices.resize((n-2)*3);
+	for (int i=1; i < n - 1; i++) {
+		indices[3*(i-1)] = 0;
+		indices[3*i - 2] = i;
+		indices[3*i - 1] = i+1;
 	}
+
+	return indices;
 }
 
 void Renderer::draw_polygon(const std::vector<Vector> &vertices, const Colour colour, const bool filled) {
 	int n = vertices.size();
 
 	if (filled) {
-		std::vector<SDL_Vertex> verts(n);
+		if (n < 3)
+			return;
+
+		std::pmr::vector<SDL_Vertex> verts(n, &get_frame_arena());
 		for (int i=0; i < n; i++) {
 			verts[i].position = vertices[i];
 			verts[i].color = (FColour)colour;
 		}
 
-		std::vector<int> indices((n-2)*3);
-		for (int i=1; i < n - 1; i++) {
-			indices[3*(i-1)] = 0;
-			indices[3*i - 2] = i;
-			indices[3*i - 1] = i+1;
-		}
-
-		SDL_RenderGeometry(renderer.get(), NULL, verts.data(), n, indices.data(), (n-2)*3);
-
-
+		const std::pmr::vector<int> indices = get_fan_indices(n);
+		SDL_RenderGeometry(renderer.get(), NULL, verts.data(), n, indices.data(), indices.size());
+		count_draw(nullptr, n);
 	} else {
 		set_colour(colour);
 
@@ -1318,15 +1551,18 @@ void Renderer::draw_polygon(const std::vector<Vector> &vertices, const Colour co
 			SDL_RenderLine(renderer.get(), vertices[j].x, vertices[j].y, vertices[i].x, vertices[i].y);
 			j = i;
 		}
+		count_draw(nullptr, 2*n, n);
 	}
 }
 
 void Renderer::render_geometry_raw(const int num_vertices, const SDL_Vertex *vertices, const int num_indices, const int *indices) {
 	SDL_RenderGeometry(renderer.get(), NULL, vertices, num_vertices, indices, num_indices);
+	count_draw(nullptr, num_vertices);
 }
 
 void Renderer::render_geometry_raw(const int num_vertices, const SDL_Vertex *vertices, const int num_indices, const int *indices, Texture &texture) {
 	SDL_RenderGeometry(renderer.get(), texture.texture.get(), vertices, num_vertices, indices, num_indices);
+	count_draw(texture.texture.get(), num_vertices);
 }
 
 void Renderer::render_geometry(const std::vector<SDL_Vertex> &vertices) {
@@ -1347,29 +1583,27 @@ void Renderer::render_geometry(const std::vector<SDL_Vertex> &vertices, const st
 
 void Renderer::render_geometry_sorted(const std::vector<SDL_Vertex> &vertices) {
 	int n = vertices.size();
-	std::vector<int> indices((n-2)*3);
-	for (int i=1; i < n - 1; i++) {
-		indices[3*(i-1)] = 0;
-		indices[3*i - 2] = i;
-		indices[3*i - 1] = i+1;
-	}
-	SDL_RenderGeometry(renderer.get(), NULL, vertices.data(), n, indices.data(), (n-2)*3);
+	if (n < 3)
+		return;
+
+	const std::pmr::vector<int> indices = get_fan_indices(n);
+	SDL_RenderGeometry(renderer.get(), NULL, vertices.data(), n, indices.data(), indices.size());
+	count_draw(nullptr, n);
 }
 
 void Renderer::render_geometry_sorted(const std::vector<SDL_Vertex> &vertices, Texture &texture) {
 	int n = vertices.size();
-	std::vector<int> indices((n-2)*3);
-	for (int i=1; i < n - 1; i++) {
-		indices[3*(i-1)] = 0;
-		indices[3*i - 2] = i;
-		indices[3*i - 1] = i+1;
-	}
-	SDL_RenderGeometry(renderer.get(), texture.texture.get(), vertices.data(), n, indices.data(), (n-2)*3);
+	if (n < 3)
+		return;
+
+	const std::pmr::vector<int> indices = get_fan_indices(n);
+	SDL_RenderGeometry(renderer.get(), texture.texture.get(), vertices.data(), n, indices.data(), indices.size());
+	count_draw(texture.texture.get(), n);
 }
 
 void Renderer::destroy(SDL_Renderer *renderer) {
 	SDL_DestroyRenderer(renderer);
-	flog_info("Renderer destroyed successfully!");
+	FLOG_INFO(LOG_RENDER, "Renderer destroyed successfully!");
 }
 
 
@@ -1518,13 +1752,15 @@ bool Events::process_events(EventArgs event_args) {
 }
 
 
+Surface::Surface(): id(0), surface(nullptr, SDL_DestroySurface), w(0), h(0) {}
+
 Surface::Surface(const IVector &size, const SDL_PixelFormat format):
 	surface(managed_ptr<SDL_Surface>(SDL_CreateSurface(size.x, size.y, format), SDL_DestroySurface)) {
 	if (surface.get() == nullptr)
-		flog_error("Failed to create surface: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to create surface: {}", SDL_GetError());
 	else {
 		id = SURF_ID;
-		flog_info("Surface created successfully![{}]", id);
+		FLOG_INFO(LOG_CORE, "Surface created successfully![{}]", id);
 		SURF_ID++;
 
 		w = size.x;
@@ -1535,10 +1771,10 @@ Surface::Surface(const IVector &size, const SDL_PixelFormat format):
 Surface::Surface(const IVector &size, void *pixel, const int pitch,const SDL_PixelFormat format):
 	surface(managed_ptr<SDL_Surface>(SDL_CreateSurfaceFrom(size.x, size.y, format, pixel, pitch), SDL_DestroySurface)) {
 	if (surface.get() == nullptr)
-		flog_error("Failed to create surface: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to create surface: {}", SDL_GetError());
 	else {
 		id = SURF_ID;
-		flog_info("Surface created successfully![{}]", id);
+		FLOG_INFO(LOG_CORE, "Surface created successfully![{}]", id);
 		SURF_ID++;
 
 		w = size.x;
@@ -1548,7 +1784,7 @@ Surface::Surface(const IVector &size, void *pixel, const int pitch,const SDL_Pix
 
 Surface::Surface(SDL_Surface *_surface): surface(managed_ptr<SDL_Surface>(_surface, SDL_DestroySurface)) {
 	if (surface.get() == nullptr) {
-		flog_error("Invalid surface");
+		FLOG_ERROR(LOG_CORE, "Invalid surface");
 	} else {
 		w = surface.get()->w;
 		h = surface.get()->h;	
@@ -1559,10 +1795,10 @@ Surface::Surface(SDL_Surface *_surface): surface(managed_ptr<SDL_Surface>(_surfa
 Surface::Surface(const string &file):
 	surface(managed_ptr<SDL_Surface>(IMG_Load(file.c_str()), SDL_DestroySurface)) {
 	if (surface.get() == nullptr)
-		flog_error("Failed to load surface: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to load surface: {}", SDL_GetError());
 	else {
 		id = SURF_ID;
-		flog_info("Surface loaded successfully![{}]", id);
+		FLOG_INFO(LOG_CORE, "Surface loaded successfully![{}]", id);
 		SURF_ID++;
 
 		w = surface.get()->w;
@@ -1588,35 +1824,6 @@ void Surface::flip(const SDL_FlipMode flip_mode) {
 	SDL_FlipSurface(surface.get(), flip_mode);
 }
 
-Surface Surface::convert_format(const SDL_PixelFormat format) {
-	return SDL_ConvertSurface(surface.get(), format);
-}
-
-void Surface::convert_format_ip(const SDL_PixelFormat format) {
-	surface = managed_ptr<SDL_Surface>(SDL_ConvertSurface(surface.get(), format), SDL_DestroySurface);
-}
-
-void Surface::blit(Surface &dst_surface, const IVector &ivec) {
-	SDL_Rect src_rect = {0, 0, surface.get()->w, surface.get()->h};
-	SDL_Rect dst_rect = {ivec.x, ivec.y, dst_surface.surface.get()->w, dst_surface.surface.get()->h};
-
-	SDL_BlitSurface(surface.get(), &src_rect, dst_surface.surface.get(), &dst_rect);
-}
-
-void Surface::blit(Surface &dst_surface, const IRect &dst_rect) {
-	SDL_Rect src_rect = {0, 0, surface.get()->w, surface.get()->h};
-	SDL_Rect _dst_rect = dst_rect;
-
-	SDL_BlitSurface(surface.get(), &src_rect, dst_surface.surface.get(), &_dst_rect);
-}
-
-void Surface::blit(Surface &dst_surface, const IRect &dst_rect, const IRect &src_rect) {
-	SDL_Rect _src_rect = src_rect;
-	SDL_Rect _dst_rect = dst_rect;
-
-	SDL_BlitSurface(surface.get(), &_src_rect, dst_surface.surface.get(), &_dst_rect);
-}
-
 #ifdef IMAGE_ENABLED
 void Surface::save(const string &file) {
 	// This function saves the surface as png
@@ -1644,9 +1851,278 @@ void Surface::save(
 #endif /* IMAGE_ENABLED */
 
 
+// Fills the rows of the mask from a surface in the RGBA32 format
+// Only the part of src_rect inside the surface is read, the rest of the mask
+// stays unset
+static void fill_mask_from_rgba32(
+	std::vector<uint64_t> &bits,
+	const int stride,
+	SDL_Surface *surface,
+	const IRect &src_rect,
+	const uint8_t threshold
+) {
+	const int left = std::max(src_rect.x, 0), right = std::min(src_rect.x + src_rect.w, surface->w);
+	const int top = std::max(src_rect.y, 0), bottom = std::min(src_rect.y + src_rect.h, surface->h);
+	if (left >= right || top >= bottom)
+		return;
+
+	const bool must_lock = SDL_MUSTLOCK(surface);
+	if (must_lock)
+		SDL_LockSurface(surface);
+
+	const uint8_t *pixels = static_cast<const uint8_t*>(surface->pixels);
+	for (int y = top; y < bottom; y++) {
+		// The alpha channel is the fourth byte of every RGBA32 pixel
+		const uint8_t *row = pixels + y*surface->pitch + left*4 + 3;
+		uint64_t *dst = &bits[(y - src_rect.y)*stride];
+		for (int x = 0; x < right - left; x++) {
+			const int bit = left - src_rect.x + x;
+			if (row[x*4] > threshold)
+				dst[bit >> 6] |= uint64_t(1) << (bit & 63);
+		}
+	}
+
+	if (must_lock)
+		SDL_UnlockSurface(surface);
+}
+
+// Returns the surface itself if it's already usable for building masks
+// otherwise a converted copy which also turns the colour key into alpha
+static managed_ptr<SDL_Surface> get_mask_source(const Surface &surface) {
+	SDL_Surface *surf = surface.surface.get();
+	if ((surf->format == SDL_PIXELFORMAT_RGBA32) && !SDL_SurfaceHasColorKey(surf))
+		return managed_ptr<SDL_Surface>(surf, [](SDL_Surface*) {});
+
+	SDL_Surface *converted = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_RGBA32);
+	if (converted == nullptr)
+		FLOG_ERROR(LOG_CORE, "Failed to convert surface for collision mask: {}", SDL_GetError());
+	return managed_ptr<SDL_Surface>(converted, SDL_DestroySurface);
+}
+
+
+CollisionMask::CollisionMask(const IVector &size, const bool filled):
+	stride((std::max(size.x, 0) + 63) >> 6), bits(stride*std::max(size.y, 0), 0),
+	w(std::max(size.x, 0)), h(std::max(size.y, 0)) {
+	if (filled)
+		fill();
+}
+
+CollisionMask::CollisionMask(const Surface &surface, const uint8_t threshold):
+	CollisionMask(surface, {0, 0, surface.w, surface.h}, threshold) {}
+
+CollisionMask::CollisionMask(const Surface &surface, const IRect &src_rect, const uint8_t threshold):
+	CollisionMask(src_rect.size()) {
+	managed_ptr<SDL_Surface> source = get_mask_source(surface);
+	if (source != nullptr) {
+		fill_mask_from_rgba32(bits, stride, source.get(), src_rect, threshold);
+		update_bounds();
+	}
+}
+
+std::vector<CollisionMask> CollisionMask::from_grid(const Surface &surface, const IRect &src_rect, const int columns, const int rows, const uint8_t threshold) {
+	// Creates a mask for every cell of the grid in row major order
+	if (columns <= 0 || rows <= 0) {
+		FLOG_ERROR(LOG_CORE, "Invalid grid of {}x{} for collision masks!", columns, rows);
+		return {};
+	}
+
+	const IVector cell = {src_rect.w/columns, src_rect.h/rows};
+	std::vector<CollisionMask> masks;
+	masks.reserve(columns*rows);
+
+	managed_ptr<SDL_Surface> source = get_mask_source(surface);
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns; column++) {
+			CollisionMask &mask = masks.emplace_back(cell);
+			if (source != nullptr) {
+				fill_mask_from_rgba32(
+					mask.bits,
+					mask.stride,
+					source.get(),
+					{src_rect.x + cell.x*column, src_rect.y + cell.y*row, cell.x, cell.y},
+					threshold
+				);
+				mask.update_bounds();
+			}
+		}
+	}
+
+	return masks;
+}
+
+uint64_t CollisionMask::get_word(const int row, const int bit) const {
+	// Returns the 64 bits of the row starting at the given bit with the
+	// bits outside of the mask being zero
+	const int index = bit >> 6; // Floor division for negative bits too
+	const int shift = bit & 63;
+
+	const uint64_t *words = &bits[row*stride];
+	const uint64_t lo = (index >= 0 && index < stride)? words[index] : 0;
+	if (shift == 0)
+		return lo;
+	const uint64_t hi = (index + 1 >= 0 && index + 1 < stride)? words[index + 1] : 0;
+
+	return (lo >> shift) | (hi << (64 - shift));
+}
+
+void CollisionMask::update_bounds() {
+	int top = h, bottom = -1, left = w, right = -1;
+
+	for (int y = 0; y < h; y++) {
+		const uint64_t *words = &bits[y*stride];
+		for (int i = 0; i < stride; i++) {
+			if (words[i] == 0)
+				continue;
+			top = std::min(top, y);
+			bottom = y;
+			left = std::min(left, i*64 + std::countr_zero(words[i]));
+			right = std::max(right, i*64 + 63 - std::countl_zero(words[i]));
+		}
+	}
+
+	if (bottom < 0)
+		bounds = {0, 0, 0, 0};
+	else
+		bounds = {left, top, right - left + 1, bottom - top + 1};
+}
+
+IVector CollisionMask::size() const {
+	return {w, h};
+}
+
+bool CollisionMask::get_at(const IVector &pos) const {
+	if (pos.x < 0 || pos.y < 0 || pos.x >= w || pos.y >= h)
+		return false;
+	return (bits[pos.y*stride + (pos.x >> 6)] >> (pos.x & 63)) & 1;
+}
+
+void CollisionMask::set_at(const IVector &pos, const bool val) {
+	if (pos.x < 0 || pos.y < 0 || pos.x >= w || pos.y >= h)
+		return;
+
+	uint64_t &word = bits[pos.y*stride + (pos.x >> 6)];
+	if (val) {
+		word |= uint64_t(1) << (pos.x & 63);
+
+		if (bounds.w == 0) {
+			bounds = {pos.x, pos.y, 1, 1};
+		} else {
+			const int right = std::max(bounds.x + bounds.w, pos.x + 1);
+			const int bottom = std::max(bounds.y + bounds.h, pos.y + 1);
+			bounds.x = std::min(bounds.x, pos.x);
+			bounds.y = std::min(bounds.y, pos.y);
+			bounds.w = right - bounds.x;
+			bounds.h = bottom - bounds.y;
+		}
+	} else {
+		word &= ~(uint64_t(1) << (pos.x & 63));
+	}
+}
+
+void CollisionMask::fill() {
+	// The padding bits at the end of every row are kept unset
+	const int tail = w & 63;
+	for (int y = 0; y < h; y++) {
+		uint64_t *words = &bits[y*stride];
+		std::fill(words, words + stride, ~uint64_t(0));
+		if (tail)
+			words[stride - 1] = (uint64_t(1) << tail) - 1;
+	}
+	bounds = (w > 0 && h > 0)? IRect{0, 0, w, h} : IRect{0, 0, 0, 0};
+}
+
+void CollisionMask::clear() {
+	std::fill(bits.begin(), bits.end(), 0);
+	bounds = {0, 0, 0, 0};
+}
+
+int CollisionMask::count() const {
+	int total = 0;
+	for (const uint64_t word: bits)
+		total += std::popcount(word);
+
+	return total;
+}
+
+IRect CollisionMask::get_bounding_rect() const {
+	return bounds;
+}
+
+// Calls func(y, word_index) for every word of the first mask which lies in
+// the intersection of both the bounding rects until func returns false
+template <typename F>
+static void for_each_overlap_word(const IRect &bounds1, const IRect &bounds2, const IVector &offset, F &&func) {
+	const int left = std::max(bounds1.x, bounds2.x + offset.x);
+	const int top = std::max(bounds1.y, bounds2.y + offset.y);
+	const int right = std::min(bounds1.x + bounds1.w, bounds2.x + bounds2.w + offset.x);
+	const int bottom = std::min(bounds1.y + bounds1.h, bounds2.y + bounds2.h + offset.y);
+
+	// Bounding rect early-out
+	if (left >= right || top >= bottom)
+		return;
+
+	for (int y = top; y < bottom; y++) {
+		for (int i = left >> 6; i <= (right - 1) >> 6; i++) {
+			if (!func(y, i))
+				return;
+		}
+	}
+}
+
+bool CollisionMask::overlap(const CollisionMask &mask, const IVector &offset) const {
+	bool found = false;
+	for_each_overlap_word(bounds, mask.get_bounding_rect(), offset, [&](const int y, const int i) {
+		if (bits[y*stride + i] & mask.get_word(y - offset.y, i*64 - offset.x))
+			found = true;
+		return !found;
+	});
+
+	return found;
+}
+
+int CollisionMask::overlap_area(const CollisionMask &mask, const IVector &offset) const {
+	int area = 0;
+	for_each_overlap_word(bounds, mask.get_bounding_rect(), offset, [&](const int y, const int i) {
+		area += std::popcount(bits[y*stride + i] & mask.get_word(y - offset.y, i*64 - offset.x));
+		return true;
+	});
+
+	return area;
+}
+
+bool CollisionMask::overlap_centroid(const CollisionMask &mask, const IVector &offset, Vector &centroid) const {
+	// Returns false if the masks don't overlap
+	int64_t area = 0, sum_x = 0, sum_y = 0;
+	for_each_overlap_word(bounds, mask.get_bounding_rect(), offset, [&](const int y, const int i) {
+		uint64_t word = bits[y*stride + i] & mask.get_word(y - offset.y, i*64 - offset.x);
+		const int n = std::popcount(word);
+		area += n;
+		sum_y += int64_t(y)*n;
+		while (word) {
+			sum_x += i*64 + std::countr_zero(word);
+			word &= word - 1;
+		}
+		return true;
+	});
+
+	if (area == 0)
+		return false;
+	centroid = {
+		static_cast<float>(sum_x)/area,
+		static_cast<float>(sum_y)/area
+	};
+
+	return true;
+}
+
+
 Texture::Texture(Renderer &renderer, SDL_Texture *_texture):
 	texture(managed_ptr<SDL_Texture>(_texture, SDL_DestroyTexture)) {
 	tex_renderer = &renderer;
+	if (texture.get() == nullptr)
+		FLOG_ERROR(LOG_RENDER, "Created a texture without an SDL texture!");
+	else
+		id = TEX_ID++;
 
 	get_size();
 }
@@ -1658,6 +2134,11 @@ Texture::Texture(Texture &&_texture): texture(std::move(_texture.texture)) {
 	_texture.id = -1;
 	w = _texture.w;
 	h = _texture.h;
+	colour_mod = _texture.colour_mod;
+	colour_mod_known = _texture.colour_mod_known;
+	blend_mode = _texture.blend_mode;
+	scale_mode = _texture.scale_mode;
+	scale_mode_known = _texture.scale_mode_known;
 }
 
 #ifdef IMAGE_ENABLED
@@ -1665,11 +2146,10 @@ Texture::Texture(Renderer &renderer, const string &file):
 	texture(managed_ptr<SDL_Texture>(IMG_LoadTexture(renderer.renderer.get(), file.c_str()), SDL_DestroyTexture)) {
 	tex_renderer = &renderer;
 	if (texture.get() == nullptr)
-		flog_error("Failed to load texture! ({}): {}", file, SDL_GetError());
+		FLOG_ERROR(LOG_RENDER, "Failed to load texture! ({}): {}", file, SDL_GetError());
 	else {
-		id = TEX_ID;
-		flog_info("Texture loaded successfully![{}] ({})", id, file);
-		TEX_ID++;
+		id = TEX_ID++;
+		FLOG_INFO(LOG_RENDER, "Texture loaded successfully![{}] ({})", id, file);
 	}
 
 	get_size();
@@ -1689,11 +2169,10 @@ Texture::Texture(Renderer &renderer, const Surface &surface):
 	texture(managed_ptr<SDL_Texture>(SDL_CreateTextureFromSurface(renderer.renderer.get(), surface.surface.get()), SDL_DestroyTexture)) {
 	tex_renderer = &renderer;
 	if (texture.get() == nullptr)
-		flog_error("Failed to create texture: {}", SDL_GetError());
+		FLOG_ERROR(LOG_RENDER, "Failed to create texture: {}", SDL_GetError());
 	else {
-		id = TEX_ID;
-		flog_info("Texture created successfully![{}]", id);
-		TEX_ID++;
+		id = TEX_ID++;
+		FLOG_INFO(LOG_RENDER, "Texture created successfully![{}]", id);
 	}
 
 	get_size();
@@ -1705,11 +2184,18 @@ Texture::Texture(Renderer &renderer, const IVector &size, const SDL_PixelFormat
 	w = size.x;
 	h = size.y;
 	if (texture.get() == nullptr)
-		flog_error("Failed to created texture: {}", SDL_GetError());
+		FLOG_ERROR(LOG_RENDER, "Failed to created texture: {}", SDL_GetError());
 	else {
-		id = TEX_ID;
-		flog_info("Texture created successfully![{}]", id);
-		TEX_ID++;
+		id = TEX_ID++;
+		FLOG_INFO(LOG_RENDER, "Texture created successfully![{}]", id);
+	}
+}
+
+Texture::~Texture() {
+	if (tex_renderer != nullptr && texture.get() != nullptr && tex_renderer->target_known && tex_renderer->target == texture.get()) {
+		// The clip rect and the scale belonged to the destroyed target
+		tex_renderer->target_known = false;
+		tex_renderer->clip_known = tex_renderer->scale_known = false;
 	}
 }
 
@@ -1737,14 +2223,47 @@ int Texture::get_gl_texture_number() {
 	);
 }
 
+bool Texture::count_state_change(const bool changed) {
+	// The changes are counted by the renderer
+	if (tex_renderer == nullptr)
+		return changed;
+
+	return tex_renderer->count_state_change(changed);
+}
+
 void Texture::set_colour_mod(const Colour &colour) {
-	SDL_SetTextureColorMod(texture.get(), colour.r, colour.g, colour.b);
-	if (colour.a != 255)
+	if (count_state_change(!colour_mod_known || colour.r != colour_mod.r || colour.g != colour_mod.g || colour.b != colour_mod.b))
+		SDL_SetTextureColorMod(texture.get(), colour.r, colour.g, colour.b);
+	if (count_state_change(!colour_mod_known || colour.a != colour_mod.a))
 		SDL_SetTextureAlphaMod(texture.get(), colour.a);
+	colour_mod = colour;
+	colour_mod_known = true;
 }
 
 void Texture::set_blend_mode(SDL_BlendMode blend_mode) {
+	// The default blend mode depends on the format, so the first one is
+	// always set
+	if (!count_state_change(blend_mode != this->blend_mode))
+		return;
+
 	SDL_SetTextureBlendMode(texture.get(), blend_mode);
+	this->blend_mode = blend_mode;
+}
+
+void Texture::set_scale_mode(const SDL_ScaleMode scale_mode) {
+	if (!count_state_change(!scale_mode_known || scale_mode != this->scale_mode))
+		return;
+
+	SDL_SetTextureScaleMode(texture.get(), scale_mode);
+	this->scale_mode = scale_mode;
+	scale_mode_known = true;
+}
+
+SDL_ScaleMode Texture::get_scale_mode() {
+	if (!scale_mode_known)
+		scale_mode_known = SDL_GetTextureScaleMode(texture.get(), &scale_mode);
+
+	return scale_mode;
 }
 
 void Texture::update(const void *pixels, const int pitch) {
@@ -1772,10 +2291,48 @@ void Texture::render(const Rect &dst_rect) {
 	render(dst_rect, get_rect());
 }
 
+// Moves a destination rect and its rotation from the world coordinates of
+// the camera to the screen, center is relative to the rect
+// Returns false if the rect isn't visible
+static bool apply_camera(const Camera2D &camera, SDL_FRect &dst_rect, SDL_FPoint &center, double &angle) {
+	if (angle == 0) {
+		if (!camera.is_visible(Rect(dst_rect.x, dst_rect.y, dst_rect.w, dst_rect.h)))
+			return false;
+	} else {
+		// The rect can point anywhere around the center
+		const float dx = std::max(center.x, dst_rect.w - center.x), dy = std::max(center.y, dst_rect.h - center.y);
+		const float radius = std::sqrt(dx*dx + dy*dy);
+		if (!camera.is_visible(Circle(dst_rect.x + center.x, dst_rect.y + center.y, radius)))
+			return false;
+	}
+
+	const float zoom = camera.get_zoom();
+	const Vector pivot = camera.world_to_screen({dst_rect.x + center.x, dst_rect.y + center.y});
+	center = {center.x*zoom, center.y*zoom};
+	dst_rect = {pivot.x - center.x, pivot.y - center.y, dst_rect.w*zoom, dst_rect.h*zoom};
+	angle -= camera.get_rotation();
+	return true;
+}
+
 void Texture::render(const Rect &dst_rect, const Rect &src_rect) {
 	const SDL_FRect r1 = src_rect;
-	const SDL_FRect r2 = dst_rect;
-	SDL_RenderTexture(tex_renderer -> renderer.get(), texture.get(), &r1, &r2);
+	SDL_FRect r2 = dst_rect;
+	const Camera2D *camera = tex_renderer->get_camera();
+	if (camera == nullptr) {
+		tex_renderer->count_draw(texture.get(), 4);
+		SDL_RenderTexture(tex_renderer -> renderer.get(), texture.get(), &r1, &r2);
+		return;
+	}
+
+	SDL_FPoint p = {dst_rect.w*0.5f, dst_rect.h*0.5f};
+	double angle = 0;
+	if (!apply_camera(*camera, r2, p, angle))
+		return;
+	tex_renderer->count_draw(texture.get(), 4);
+	if (angle == 0)
+		SDL_RenderTexture(tex_renderer -> renderer.get(), texture.get(), &r1, &r2);
+	else
+		SDL_RenderTextureRotated(tex_renderer -> renderer.get(), texture.get(), &r1, &r2, angle, &p, SDL_FLIP_NONE);
 }
 
 void Texture::render_rot(const Rect &dst_rect, const float angle, const Vector &center, const SDL_FlipMode flip) {
@@ -1784,9 +2341,124 @@ void Texture::render_rot(const Rect &dst_rect, const float angle, const Vector &
 
 void Texture::render_rot(const Rect &dst_rect, const Rect &src_rect, const float angle, const Vector &center, const SDL_FlipMode flip) {
 	const SDL_FRect r1 = {src_rect.x, src_rect.y, src_rect.w, src_rect.h};
-	const SDL_FRect r2 = {dst_rect.x, dst_rect.y, dst_rect.w, dst_rect.h};
-	const SDL_FPoint p = {center.x, center.y};
-	SDL_RenderTextureRotated(tex_renderer -> renderer.get(), texture.get(), &r1, &r2, angle, &p, flip);
+	SDL_FRect r2 = {dst_rect.x, dst_rect.y, dst_rect.w, dst_rect.h};
+	SDL_FPoint p = {center.x, center.y};
+	double rotation = angle;
+	const Camera2D *camera = tex_renderer->get_camera();
+	if (camera != nullptr && !apply_camera(*camera, r2, p, rotation))
+		return;
+	tex_renderer->count_draw(texture.get(), 4);
+	SDL_RenderTextureRotated(tex_renderer -> renderer.get(), texture.get(), &r1, &r2, rotation, &p, flip);
+}
+
+
+static IRect unite_rects(const IRect &rect1, const IRect &rect2) {
+	// An empty rect is ignored
+	if (rect1.w <= 0 || rect1.h <= 0)
+		return rect2;
+	if (rect2.w <= 0 || rect2.h <= 0)
+		return rect1;
+
+	const int left = std::min(rect1.x, rect2.x);
+	const int top = std::min(rect1.y, rect2.y);
+	const int right = std::max(rect1.x + rect1.w, rect2.x + rect2.w);
+	const int bottom = std::max(rect1.y + rect1.h, rect2.y + rect2.h);
+
+	return {left, top, right - left, bottom - top};
+}
+
+
+PixelView::operator bool() const {
+	return pixels != nullptr;
+}
+
+std::span<uint8_t> PixelView::get_row(const int y) const {
+	assert(y >= 0 && y < rect.h);
+	return {pixels + y*pitch, static_cast<size_t>(row_bytes)};
+}
+
+
+StreamingTexture::StreamingTexture(Renderer &renderer, const IVector &size, const SDL_PixelFormat format, const bool double_buffered):
+	format(format), w(size.x), h(size.y) {
+	textures.reserve(2);
+	for (int i = 0; i < ((double_buffered)? 2 : 1); i++)
+		textures.emplace_back(renderer, size, format, SDL_TEXTUREACCESS_STREAMING);
+
+	mark_dirty();
+}
+
+int StreamingTexture::get_back() const {
+	return (textures.size() == 2)? 1 - front : front;
+}
+
+void StreamingTexture::mark_dirty(const IRect &rect) {
+	const int left = std::max(rect.x, 0), right = std::min(rect.x + rect.w, w);
+	const int top = std::max(rect.y, 0), bottom = std::min(rect.y + rect.h, h);
+	if (left >= right || top >= bottom)
+		return;
+
+	for (auto &area: pending)
+		area = unite_rects(area, {left, top, right - left, bottom - top});
+}
+
+void StreamingTexture::mark_dirty() {
+	mark_dirty({0, 0, w, h});
+}
+
+PixelView StreamingTexture::lock() {
+	// Returns an empty view if nothing has changed
+	PixelView view;
+	if (locked) {
+		FLOG_WARN(LOG_RENDER, "Streaming texture is already locked!");
+		return view;
+	}
+
+	IRect &area = pending[get_back()];
+	if (area.w <= 0 || area.h <= 0)
+		return view;
+
+	const SDL_Rect r = area;
+	void *pixels;
+	if (!SDL_LockTexture(textures[get_back()].texture.get(), &r, &pixels, &view.pitch)) {
+		FLOG_ERROR(LOG_RENDER, "Failed to lock texture: {}", SDL_GetError());
+		return view;
+	}
+
+	view.pixels = static_cast<uint8_t*>(pixels);
+	view.row_bytes = area.w*SDL_BYTESPERPIXEL(format);
+	view.rect = area;
+	area = {0, 0, 0, 0};
+	locked = true;
+
+	return view;
+}
+
+PixelView StreamingTexture::lock(const IRect &rect) {
+	mark_dirty(rect);
+	return lock();
+}
+
+Surface StreamingTexture::lock_surface() {
+	// The surface must not be used after unlock()
+	const PixelView view = lock();
+	if (!view)
+		return Surface();
+
+	return Surface(view.rect.size(), view.pixels, view.pitch, format);
+}
+
+void StreamingTexture::unlock() {
+	// Uploads the locked area and makes the back texture the front one
+	if (!locked)
+		return;
+
+	SDL_UnlockTexture(textures[get_back()].texture.get());
+	front = get_back();
+	locked = false;
+}
+
+Texture& StreamingTexture::get_texture() {
+	return textures[front];
 }
 
 
@@ -1794,7 +2466,7 @@ std::vector<SDL_CameraID> Camera::get_available_devices() {
 	int count;
 	SDL_CameraID *dvcs = SDL_GetCameras(&count);
 	if (!dvcs) {
-		flog_error("Failed to get camera devices: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to get camera devices: {}", SDL_GetError());
 	}
 	std::vector<SDL_CameraID> devices(dvcs, dvcs + count);
 
@@ -1804,21 +2476,21 @@ std::vector<SDL_CameraID> Camera::get_available_devices() {
 SDL_CameraID Camera::select_device(const int id) {
 	SDL_CameraID devid = get_available_devices().at(id);
 	if (!devid)
-		flog_error("No cameras available.");
+		FLOG_ERROR(LOG_CORE, "No cameras available.");
 
 	return devid;
 }
 
 Camera::Camera(const int id): camera(SDL_OpenCamera(select_device(id), NULL), SDL_CloseCamera) {
 	if (camera == nullptr) {
-		flog_error("Failed to open camera: {}", SDL_GetError());
+		FLOG_ERROR(LOG_CORE, "Failed to open camera: {}", SDL_GetError());
 	} else {
 		SDL_CameraSpec spec;
 		SDL_GetCameraFormat(camera.get(), &spec);
 		size = {spec.width, spec.height};
 		format = spec.format;
 		permission_state = get_permission_state();
-		flog_info("Camera opened successfully!");
+		FLOG_INFO(LOG_CORE, "Camera opened successfully!");
 	}
 }
 
@@ -1847,12 +2519,23 @@ bool Camera::is_new_frame_available() {
 	return (surface != nullptr);
 }
 
+static void keep_surface(SDL_Surface*) {}
+
 Surface& Camera::acquire_frame() {
-	frame = std::make_unique<Surface>(surface);
+	// The wrapper is reused for every frame and doesn't own the surface,
+	// as it belongs to the camera
+	if (frame == nullptr) {
+		frame = std::make_unique<Surface>(surface);
+		frame->surface.get_deleter() = keep_surface;
+	} else {
+		frame->surface.reset(surface);
+		frame->w = surface->w;
+		frame->h = surface->h;
+	}
+
 	return *frame.get();
 }
 
 void Camera::release_frame() {
-	frame.release();
 	SDL_ReleaseCameraFrame(camera.get(), surface);
 }
@@ -0,0 +1,217 @@
+#include "coroutine.h"
+
+#include <utility>
+
+
+
+// Globals
+// Free lists of the pooled coroutine frames, one per multiple of 64 bytes
+static const size_t FRAME_GRANULARITY = 64;
+static std::mutex frames_mutex;
+static std::vector<void*> free_frames[TASK_FRAME_POOL_LIMIT/FRAME_GRANULARITY];
+
+
+
+// Helper functions
+void* allocate_task_frame(const size_t size) {
+	// Frames above the pool limit are allocated normally
+	if (size > TASK_FRAME_POOL_LIMIT)
+		return ::operator new(size);
+
+	const size_t size_class = (size - 1)/FRAME_GRANULARITY;
+	{
+		std::lock_guard<std::mutex> lock(frames_mutex);
+		std::vector<void*> &frames = free_frames[size_class];
+		if (!frames.empty()) {
+			void *ptr = frames.back();
+			frames.pop_back();
+			return ptr;
+		}
+	}
+
+	return ::operator new((size_class + 1)*FRAME_GRANULARITY);
+}
+
+void free_task_frame(void *ptr, const size_t size) {
+	if (size > TASK_FRAME_POOL_LIMIT) {
+		::operator delete(ptr);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(frames_mutex);
+	free_frames[(size - 1)/FRAME_GRANULARITY].push_back(ptr);
+}
+
+
+
+// Structs
+void TaskQueue::push(const std::coroutine_handle<> handle) {
+	std::lock_guard<std::mutex> lock(mutex);
+	handles.push_back(handle);
+}
+
+
+
+// Classes
+Task::Task(std::coroutine_handle<TaskPromise> handle): handle(handle) {}
+
+Task::Task(Task &&task): handle(task.release()) {}
+
+Task::~Task() {
+	if (handle)
+		handle.destroy();
+}
+
+Task& Task::operator=(Task &&task) {
+	if (this != &task) {
+		if (handle)
+			handle.destroy();
+		handle = task.release();
+	}
+
+	return *this;
+}
+
+std::coroutine_handle<TaskPromise> Task::release() {
+	// Gives up the ownership of the coroutine
+	return std::exchange(handle, nullptr);
+}
+
+bool Task::is_done() const {
+	return !handle || handle.done();
+}
+
+std::coroutine_handle<> Task::Awaiter::await_suspend(std::coroutine_handle<TaskPromise> caller) {
+	// Starts the awaited task, which continues the caller when it finishes
+	handle.promise().executor = caller.promise().executor;
+	handle.promise().continuation = caller;
+	return handle;
+}
+
+
+std::coroutine_handle<> TaskPromise::FinalAwaiter::await_suspend(std::coroutine_handle<TaskPromise> handle) noexcept {
+	// Awaited tasks continue their caller and are destroyed by its Task,
+	// spawned ones are destroyed by the executor
+	TaskPromise &promise = handle.promise();
+	if (promise.continuation)
+		return promise.continuation;
+	if (promise.executor != nullptr)
+		promise.executor->finish(handle);
+
+	return std::noop_coroutine();
+}
+
+
+Executor::~Executor() {
+	clear();
+}
+
+void Executor::resume_ready() {
+	// Tasks which become ready while resuming are left for the next update
+	std::vector<std::coroutine_handle<>> handles;
+	handles.swap(ready);
+	for (const std::coroutine_handle<> handle: handles)
+		handle.resume();
+
+	handles.clear();
+	if (ready.empty())
+		ready.swap(handles);
+}
+
+void Executor::spawn(Task task) {
+	// Starts the task right away, it runs until its first suspension
+	const std::coroutine_handle<TaskPromise> handle = task.release();
+	if (!handle)
+		return;
+
+	TaskPromise &promise = handle.promise();
+	promise.executor = this;
+	promise.root_index = tasks.size();
+	tasks.push_back(handle);
+	handle.resume();
+}
+
+void Executor::update(const double dt) {
+	timers.update(dt);
+
+	{
+		std::lock_guard<std::mutex> lock(jobs->mutex);
+		ready.insert(ready.end(), jobs->handles.begin(), jobs->handles.end());
+		jobs->handles.clear();
+	}
+
+	for (size_t i = 0; i < conditions.size();) {
+		if (conditions[i].condition()) {
+			ready.push_back(conditions[i].handle);
+			conditions[i] = std::move(conditions.back());
+			conditions.pop_back();
+		} else
+			i++;
+	}
+
+	ready.insert(ready.end(), next_frame.begin(), next_frame.end());
+	next_frame.clear();
+
+	resume_ready();
+}
+
+void Executor::clear() {
+	// Destroys all the tasks which haven't finished yet
+	std::vector<std::coroutine_handle<TaskPromise>> handles;
+	handles.swap(tasks);
+	for (const std::coroutine_handle<TaskPromise> handle: handles)
+		handle.destroy();
+
+	ready.clear();
+	next_frame.clear();
+	conditions.clear();
+	timers.clear();
+	// Jobs which are still running push to the old queue
+	jobs = std::make_shared<TaskQueue>();
+}
+
+size_t Executor::size() const {
+	return tasks.size();
+}
+
+void Executor::resume_next_frame(const std::coroutine_handle<> handle) {
+	next_frame.push_back(handle);
+}
+
+void Executor::resume_after(const double seconds, const std::coroutine_handle<> handle) {
+	timers.schedule(seconds, [this, handle]() {
+		ready.push_back(handle);
+	});
+}
+
+void Executor::resume_when(std::function<bool()> condition, const std::coroutine_handle<> handle) {
+	conditions.push_back({handle, std::move(condition)});
+}
+
+std::shared_ptr<TaskQueue> Executor::get_job_queue() const {
+	return jobs;
+}
+
+void Executor::finish(const std::coroutine_handle<TaskPromise> handle) {
+	// Called when a spawned task finished
+	const size_t index = handle.promise().root_index;
+	tasks[index] = tasks.back();
+	tasks[index].promise().root_index = index;
+	tasks.pop_back();
+	handle.destroy();
+}
+
+
+
+// Functions
+NextFrameAwaitable next_frame() {
+	return {};
+}
+
+SecondsAwaitable wait_seconds(const double seconds) {
+	return {seconds};
+}
+
+ConditionAwaitable wait_until(std::function<bool()> condition) {
+	return {std::move(condition)};
+}
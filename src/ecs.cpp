@@ -0,0 +1,347 @@
+#include "ecs.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+#include "logging.h"
+
+
+
+// Globals
+static std::mutex components_mutex;
+static std::array<ComponentInfo, MAX_COMPONENTS> component_infos;
+static std::atomic<uint32_t> component_count = 0;
+
+
+
+// Structs
+ArchetypeChunk::ArchetypeChunk(const size_t size):
+	data(static_cast<std::byte*>(::operator new(size, std::align_val_t(ECS_CHUNK_ALIGNMENT)))) {}
+
+ArchetypeChunk::~ArchetypeChunk() {
+	::operator delete(data, std::align_val_t(ECS_CHUNK_ALIGNMENT));
+}
+
+
+Archetype::Archetype(const ComponentMask &mask): mask(mask) {
+	size_t row_size = sizeof(Entity);
+	for (uint32_t id = 0; id < MAX_COMPONENTS; id++) {
+		if (mask.test(id)) {
+			components.push_back(id);
+			row_size += get_component_info(id).size;
+		}
+	}
+
+	// Fits as many rows as possible into a chunk including the padding
+	// between the arrays, large components get a bigger chunk
+	chunk_capacity = std::max<size_t>(ECS_CHUNK_SIZE/row_size, 1);
+	while (true) {
+		offsets.clear();
+		size_t offset = sizeof(Entity)*chunk_capacity;
+		for (const uint32_t id: components) {
+			const ComponentInfo &info = get_component_info(id);
+			offset = (offset + info.alignment - 1) & ~(info.alignment - 1);
+			offsets.push_back(offset);
+			offset += info.size*chunk_capacity;
+		}
+
+		chunk_size = offset;
+		if (chunk_size <= ECS_CHUNK_SIZE || chunk_capacity == 1)
+			break;
+		chunk_capacity--;
+	}
+	chunk_size = std::max(chunk_size, sizeof(Entity));
+}
+
+int Archetype::get_column(const uint32_t id) const {
+	// Returns the index of the component in components or -1
+	const auto it = std::lower_bound(components.begin(), components.end(), id);
+	if (it == components.end() || *it != id)
+		return -1;
+
+	return it - components.begin();
+}
+
+Entity* Archetype::get_entities(ArchetypeChunk &chunk) const {
+	return reinterpret_cast<Entity*>(chunk.data);
+}
+
+void* Archetype::get_component(const size_t row, const int column) const {
+	ArchetypeChunk &chunk = *chunks[row/chunk_capacity];
+	return chunk.data + offsets[column] + get_component_info(components[column]).size*(row % chunk_capacity);
+}
+
+
+
+// Classes
+World::~World() {
+	for (auto &archetype: archetypes) {
+		for (size_t column = 0; column < archetype->components.size(); column++) {
+			const ComponentInfo &info = get_component_info(archetype->components[column]);
+			if (info.trivial)
+				continue;
+			for (size_t row = 0; row < archetype->size; row++)
+				info.destroy(archetype->get_component(row, column));
+		}
+	}
+}
+
+Archetype* World::get_archetype(const ComponentMask &mask) {
+	auto it = archetype_map.find(mask);
+	if (it != archetype_map.end())
+		return it->second;
+
+	archetypes.push_back(std::make_unique<Archetype>(mask));
+	archetype_map[mask] = archetypes.back().get();
+	return archetypes.back().get();
+}
+
+Archetype* World::get_add_edge(Archetype *archetype, const uint32_t id) {
+	auto it = archetype->add_edges.find(id);
+	if (it != archetype->add_edges.end())
+		return it->second;
+
+	ComponentMask mask = archetype->mask;
+	Archetype *target = get_archetype(mask.set(id));
+	archetype->add_edges[id] = target;
+	return target;
+}
+
+Archetype* World::get_remove_edge(Archetype *archetype, const uint32_t id) {
+	auto it = archetype->remove_edges.find(id);
+	if (it != archetype->remove_edges.end())
+		return it->second;
+
+	ComponentMask mask = archetype->mask;
+	Archetype *target = get_archetype(mask.reset(id));
+	archetype->remove_edges[id] = target;
+	return target;
+}
+
+const std::vector<Archetype*>& World::get_matching(const ComponentMask &mask) {
+	// Only the archetypes created since the last call are checked
+	QueryCache &query = queries[mask];
+	for (; query.checked < archetypes.size(); query.checked++) {
+		Archetype *archetype = archetypes[query.checked].get();
+		if ((archetype->mask & mask) == mask)
+			query.archetypes.push_back(archetype);
+	}
+
+	return query.archetypes;
+}
+
+Entity World::reserve_entity() {
+	// Thread safe since entities can be created from parallel iterations
+	std::lock_guard<std::mutex> lock(deferred_mutex);
+	uint32_t index;
+	if (free_indices.empty()) {
+		index = records.size();
+		records.emplace_back();
+	} else {
+		index = free_indices.back();
+		free_indices.pop_back();
+	}
+
+	EntityRecord &record = records[index];
+	record.archetype = nullptr;
+	record.alive = true;
+	alive_count++;
+
+	return {index, record.generation};
+}
+
+size_t World::allocate_row(Archetype &archetype, const Entity entity) {
+	const size_t row = archetype.size;
+	if (row/archetype.chunk_capacity >= archetype.chunks.size())
+		archetype.chunks.push_back(std::make_unique<ArchetypeChunk>(archetype.chunk_size));
+
+	ArchetypeChunk &chunk = *archetype.chunks[row/archetype.chunk_capacity];
+	archetype.get_entities(chunk)[chunk.count++] = entity;
+	archetype.size++;
+
+	return row;
+}
+
+void World::remove_row(Archetype &archetype, const size_t row, const bool destroy_components) {
+	// Fills the row with the last one so that the rows stay dense
+	const size_t last = archetype.size - 1;
+	ArchetypeChunk &last_chunk = *archetype.chunks[last/archetype.chunk_capacity];
+	for (size_t column = 0; column < archetype.components.size(); column++) {
+		const ComponentInfo &info = get_component_info(archetype.components[column]);
+		void *ptr = archetype.get_component(row, column);
+		if (destroy_components && !info.trivial)
+			info.destroy(ptr);
+		if (row == last)
+			continue;
+
+		void *last_ptr = archetype.get_component(last, column);
+		if (info.trivial)
+			memcpy(ptr, last_ptr, info.size);
+		else
+			info.move(ptr, last_ptr);
+	}
+
+	if (row != last) {
+		ArchetypeChunk &chunk = *archetype.chunks[row/archetype.chunk_capacity];
+		const Entity moved = archetype.get_entities(last_chunk)[last % archetype.chunk_capacity];
+		archetype.get_entities(chunk)[row % archetype.chunk_capacity] = moved;
+		records[moved.index].row = row;
+	}
+
+	last_chunk.count--;
+	archetype.size--;
+	// An empty chunk is kept for reuse unless there's another one before it
+	if (last_chunk.count == 0 && archetype.chunks.size() > 1 && archetype.size > 0)
+		archetype.chunks.pop_back();
+}
+
+void World::move_entity(const Entity entity, Archetype *target) {
+	// Moves the components which the target archetype has as well
+	EntityRecord &record = records[entity.index];
+	Archetype &source = *record.archetype;
+	const size_t row = record.row;
+	const size_t new_row = allocate_row(*target, entity);
+
+	for (size_t column = 0; column < source.components.size(); column++) {
+		const uint32_t id = source.components[column];
+		const ComponentInfo &info = get_component_info(id);
+		void *ptr = source.get_component(row, column);
+		const int target_column = target->get_column(id);
+		if (target_column < 0) {
+			if (!info.trivial)
+				info.destroy(ptr);
+		} else if (info.trivial)
+			memcpy(target->get_component(new_row, target_column), ptr, info.size);
+		else
+			info.move(target->get_component(new_row, target_column), ptr);
+	}
+
+	remove_row(source, row, false);
+	record.archetype = target;
+	record.row = new_row;
+}
+
+void World::begin_iteration() {
+	iterating++;
+}
+
+void World::end_iteration() {
+	if (--iterating == 0)
+		flush();
+}
+
+void World::destroy(const Entity entity) {
+	if (is_deferring()) {
+		defer([this, entity]() {
+			destroy(entity);
+		});
+		return;
+	}
+	if (!is_alive(entity))
+		return;
+
+	EntityRecord &record = records[entity.index];
+	if (record.archetype != nullptr)
+		remove_row(*record.archetype, record.row);
+
+	record.archetype = nullptr;
+	record.alive = false;
+	// Invalidates the handles of the entity
+	record.generation++;
+	free_indices.push_back(entity.index);
+	alive_count--;
+}
+
+bool World::is_alive(const Entity entity) const {
+	return entity.index < records.size() && records[entity.index].alive && records[entity.index].generation == entity.generation;
+}
+
+size_t World::size() const {
+	return alive_count;
+}
+
+bool World::is_deferring() const {
+	return iterating > 0;
+}
+
+void World::flush() {
+	// Changes made by the deferred changes are applied right away
+	while (true) {
+		std::vector<std::unique_ptr<DeferredChange>> changes;
+		{
+			std::lock_guard<std::mutex> lock(deferred_mutex);
+			changes.swap(deferred);
+		}
+		if (changes.empty())
+			break;
+
+		for (auto &change: changes)
+			change->apply();
+	}
+}
+
+void World::add_system(std::function<void(World&, double)> system) {
+	systems.push_back(std::move(system));
+}
+
+void World::run_systems(const double dt) {
+	// The changes of each system are visible to the next one
+	for (auto &system: systems) {
+		system(*this, dt);
+		flush();
+	}
+}
+
+
+
+// Helper functions
+uint32_t register_component(const ComponentInfo &info) {
+	// Returns the id of a new component type
+	std::lock_guard<std::mutex> lock(components_mutex);
+	const uint32_t id = component_count;
+	if (id >= MAX_COMPONENTS) {
+		FLOG_ERROR(LOG_CORE, "Too many component types, the limit is {}", MAX_COMPONENTS);
+		std::abort();
+	}
+
+	component_infos[id] = info;
+	component_count++;
+	return id;
+}
+
+const ComponentInfo& get_component_info(const uint32_t id) {
+	return component_infos[id];
+}
+
+
+
+// Functions
+void update_movement(World &world, const double dt) {
+	// Moves every entity with a Position and a Velocity
+	const float step = dt;
+	world.each_chunk<Position, const Velocity>([step](const size_t count, Entity*, Position *positions, const Velocity *velocities) {
+		for (size_t i = 0; i < count; i++) {
+			positions[i].x += velocities[i].x*step;
+			positions[i].y += velocities[i].y*step;
+		}
+	});
+}
+
+void update_bounds(World &world) {
+	// Moves the Bounds of every entity with a Position to it
+	world.each_chunk<Bounds, const Position>([](const size_t count, Entity*, Bounds *bounds, const Position *positions) {
+		for (size_t i = 0; i < count; i++) {
+			bounds[i].x = positions[i].x;
+			bounds[i].y = positions[i].y;
+		}
+	});
+}
+
+void update_timers(World &world, const double dt, const std::function<void(Entity, Timer&)> &on_timeout) {
+	// The finished timers are reset
+	world.each<Timer>([&](const Entity entity, Timer &timer) {
+		if (timer.update(dt) && on_timeout)
+			on_timeout(entity, timer);
+	});
+}
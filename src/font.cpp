@@ -1,5 +1,8 @@
 #include "font.h"
 
+#include <algorithm>
+#include <format>
+
 #include "logging.h"
 
 
@@ -13,10 +16,10 @@ static int FONT_ID = 0;
 Font::Font(const string &file, const int size):
 	font(managed_ptr<TTF_Font>(TTF_OpenFont(file.c_str(), size), TTF_CloseFont)) {
 	if (font.get() == nullptr)
-		flog_error("Failed to load font! ({}): {}", file, SDL_GetError());
+		FLOG_ERROR(LOG_FONT, "Failed to load font! ({}): {}", file, SDL_GetError());
 	else {
 		id = FONT_ID;
-		flog_info("Font loaded successfully![{}] ({})", id, file);
+		FLOG_INFO(LOG_FONT, "Font loaded successfully![{}] ({})", id, file);
 		FONT_ID++;
 	}
 
@@ -51,7 +54,7 @@ int Font::get_glyph_kerning(const uint32_t prev_ch, const uint32_t ch) {
 
 void Font::add_fallback(Font &fallback) {
 	if (!TTF_AddFallbackFont(font.get(), fallback.font.get())) {
-		flog_error("Failed to add fallback font: {}", SDL_GetError());
+		FLOG_ERROR(LOG_FONT, "Failed to add fallback font: {}", SDL_GetError());
 	}
 }
 void Font::remove_fallback(Font &fallback) {
@@ -263,11 +266,98 @@ void FontAtlas::draw_text_with_kerning(const string &text, const IVector &pos, c
 }
 
 
+PerformanceHUD::PerformanceHUD(FontAtlas &atlas, const SDL_Keycode toggle_key, const int history):
+	atlas(atlas), frame_times(std::max(history, 2), 0.0f), toggle_key(toggle_key) {}
+
+void PerformanceHUD::update(const double dt) {
+	frame_times[next] = dt*1000;
+	next = (next + 1) % frame_times.size();
+}
+
+void PerformanceHUD::process_event(const SDL_Event &event) {
+	if (event.type == SDL_EVENT_KEY_DOWN && !event.key.repeat && event.key.key == toggle_key)
+		visible = !visible;
+}
+
+void PerformanceHUD::set_visible(const bool visible) {
+	this->visible = visible;
+}
+
+bool PerformanceHUD::is_visible() const {
+	return visible;
+}
+
+void PerformanceHUD::draw(const IVector &pos) {
+	if (!visible)
+		return;
+
+	Renderer &renderer = *atlas.texture.tex_renderer;
+	renderer.queue.flush();
+	const Camera2D *camera = renderer.get_camera();
+	renderer.reset_camera();
+	const SDL_BlendMode blend_mode = renderer.get_blend_mode();
+	renderer.set_blend_mode(SDL_BLENDMODE_BLEND);
+
+	const RenderStats &stats = renderer.get_stats();
+	const size_t samples = frame_times.size();
+	const float last_time = frame_times[(next + samples - 1) % samples];
+	float max_time = 0, total_time = 0;
+	for (const float time: frame_times) {
+		max_time = std::max(max_time, time);
+		total_time += time;
+	}
+	const FrameArena &arena = get_frame_arena();
+	const string lines[] = {
+		std::format("FPS {:.1f}  {:.2f} ms  (max {:.2f})", (last_time > 0)? 1000/last_time : 0.0f, last_time, max_time),
+		std::format("Draw calls {}  Vertices {}", stats.draw_calls, stats.vertices),
+		std::format("Batches {}  Quads {}  Texture binds {}", stats.batches, stats.batched_quads, stats.texture_binds),
+		std::format("Target switches {}  State changes {} / {} skipped", stats.target_switches, stats.state_changes, stats.skipped_state_changes),
+		std::format("Frame arena {:.1f} / {:.1f} KB", arena.get_used()/1024.0, arena.get_capacity()/1024.0)
+	};
+
+	// The graph is scaled to the slowest frame, atleast 30 fps
+	const int line_h = atlas.texture.h;
+	const float graph_w = samples*2, graph_h = 48;
+	const float text_h = line_h*std::size(lines);
+	const float scale = graph_h/std::max(max_time, 1000/30.0f);
+	const Rect panel = {(float)pos.x, (float)pos.y, std::max(graph_w, 320.0f) + 8, text_h + graph_h + 12};
+	renderer.draw_rect(panel, {0, 0, 0, 160});
+
+	// All the bars are drawn with one draw call, the slow frames are red
+	const float base_y = panel.y + text_h + 8 + graph_h;
+	std::pmr::vector<SDL_Vertex> vertices(&get_frame_arena());
+	std::pmr::vector<int> indices(&get_frame_arena());
+	vertices.reserve(samples*4);
+	indices.reserve(samples*6);
+	for (size_t i = 0; i < samples; i++) {
+		const float time = frame_times[(next + i) % samples];
+		const float x = panel.x + 4 + i*2, h = std::min(time*scale, graph_h);
+		const SDL_FColor colour = (time > 1000/30.0f)? SDL_FColor{1, 0.2f, 0.2f, 1} : (time > 1000/60.0f)? SDL_FColor{1, 0.8f, 0.2f, 1} : SDL_FColor{0.2f, 1, 0.3f, 1};
+		const int base = vertices.size();
+		vertices.push_back({{x, base_y - h}, colour, {0, 0}});
+		vertices.push_back({{x + 2, base_y - h}, colour, {0, 0}});
+		vertices.push_back({{x + 2, base_y}, colour, {0, 0}});
+		vertices.push_back({{x, base_y}, colour, {0, 0}});
+		indices.insert(indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+	}
+	renderer.render_geometry_raw(vertices.size(), vertices.data(), indices.size(), indices.data());
+	const float target_y = base_y - (1000/60.0f)*scale;
+	renderer.draw_line({panel.x + 4, target_y}, {panel.x + 4 + graph_w, target_y}, {255, 255, 255, 96});
+
+	for (size_t i = 0; i < std::size(lines); i++)
+		atlas.draw_text(lines[i], {pos.x + 4, static_cast<int>(pos.y + 4 + i*line_h)}, WHITE);
+
+	renderer.set_blend_mode(blend_mode);
+	if (camera != nullptr)
+		renderer.set_camera(*camera);
+}
+
+
 TextEngine::TextEngine(Renderer &renderer):
 	renderer(renderer), engine(TTF_CreateRendererTextEngine(renderer.renderer.get()), TTF_DestroyRendererTextEngine)
 {
 	if (engine == nullptr) {
-		flog_error("Failed to create text engine: {}", SDL_GetError());
+		FLOG_ERROR(LOG_FONT, "Failed to create text engine: {}", SDL_GetError());
 	}
 }
 
@@ -276,7 +366,7 @@ Text::Text(Font &font, TextEngine &text_engine, const string text, const Colour
 	text_obj(TTF_CreateText(text_engine.engine.get(), font.font.get(), text.c_str(), text.size()), TTF_DestroyText)
 {
 	if (text_obj == nullptr) {
-		flog_error("Failed to create text: {}", SDL_GetError());
+		FLOG_ERROR(LOG_FONT, "Failed to create text: {}", SDL_GetError());
 	}
 	TTF_SetTextColor(text_obj.get(), colour.r, colour.g, colour.b, colour.a);
 }
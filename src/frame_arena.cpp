@@ -0,0 +1,69 @@
+#include "core.h"
+
+#include <algorithm>
+
+
+
+// Classes
+FrameArena::FrameArena(const size_t block_size): block_size(std::max<size_t>(block_size, 256)) {}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment) {
+	while (true) {
+		// Earlier blocks are skipped once something didn't fit in them
+		for (; current < blocks.size(); current++, offset = 0) {
+			Block &block = blocks[current];
+			const uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+			const size_t start = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+			if (start + bytes <= block.size) {
+				offset = start + bytes;
+				used += bytes;
+				return block.data.get() + start;
+			}
+		}
+
+		const size_t size = std::max(block_size, bytes + alignment);
+		blocks.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+		current = blocks.size() - 1;
+	}
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+	return this == &other;
+}
+
+void FrameArena::reset() {
+	// Invalidates everything which was allocated from the arena
+	peak = std::max(peak, used);
+	if (blocks.size() > 1) {
+		// The next frame probably needs as much, so it gets a single block
+		const size_t size = get_capacity();
+		blocks.clear();
+		blocks.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+	}
+
+	current = offset = used = 0;
+}
+
+size_t FrameArena::get_used() const {
+	return used;
+}
+
+size_t FrameArena::get_capacity() const {
+	size_t capacity = 0;
+	for (const Block &block: blocks)
+		capacity += block.size;
+
+	return capacity;
+}
+
+size_t FrameArena::get_peak() const {
+	return std::max(peak, used);
+}
+
+
+
+// Functions
+FrameArena& get_frame_arena() {
+	static FrameArena arena;
+	return arena;
+}
@@ -1,7 +1,30 @@
 #include "graphics.h"
 
+#include <algorithm>
 #include <cmath>
 
+#include "logging.h"
+
+
+
+// Structs
+AnimationClip::AnimationClip(const SpriteSheet &sheet, const int first, const int count, const float frame_duration, const bool loop): loop(loop) {
+	// Uses count tiles of the sheet starting at first in row major order
+	for (int i = first; i < first + count; i++) {
+		const int column = i % sheet.tile_x, row = i/sheet.tile_x;
+		frames.push_back({sheet.src_rect.x + sheet.tile_w*column, sheet.src_rect.y + sheet.tile_h*row, sheet.tile_w, sheet.tile_h});
+	}
+	durations.assign(frames.size(), frame_duration);
+}
+
+float AnimationClip::get_duration() const {
+	float duration = 0;
+	for (const float frame_duration: durations)
+		duration += frame_duration;
+
+	return duration;
+}
+
 
 
 // Classes
@@ -12,11 +35,31 @@ SpriteSheet::SpriteSheet(Renderer &renderer, const string &file, const int &colu
 	tile_w = src_rect.w/tile_x; tile_h = src_rect.h/tile_y;
 }
 
+SpriteSheet::SpriteSheet(Texture &&texture, const int &column, const int &row): texture(std::move(texture)) {
+	tile_x = column; tile_y = row;
+	total_tiles = tile_x*tile_y;
+	src_rect = {0, 0, this->texture.w, this->texture.h};
+	tile_w = src_rect.w/tile_x; tile_h = src_rect.h/tile_y;
+}
+
 void SpriteSheet::set_src_rect(const IRect &src_rect) {
 	this->src_rect = src_rect;
 	tile_w = src_rect.w/tile_x; tile_h = src_rect.h/tile_y;
 }
 
+void SpriteSheet::create_masks(const Surface &surface, const uint8_t threshold) {
+	// The surface should contain the same image as the texture
+	masks = CollisionMask::from_grid(surface, src_rect, tile_x, tile_y, threshold);
+}
+
+void SpriteSheet::create_masks(const string &file, const uint8_t threshold) {
+	create_masks(Surface(file), threshold);
+}
+
+const CollisionMask& SpriteSheet::get_mask(const int &column, const int &row) const {
+	return masks.at(row*tile_x + column);
+}
+
 void SpriteSheet::draw_sprite(const Rect &dst_rect, const int &column, const int &row) {
 	texture.render(dst_rect, IRect{src_rect.x + tile_w*column, src_rect.y + tile_h*row, tile_w, tile_h});
 }
@@ -32,10 +75,486 @@ bool AnimatedSprite::update(double dt) {
 	animation_index += animation_speed*dt;
 	if (animation_index > total_tiles) {
 		animation_index -= total_tiles;
+		completed_loops++;
 		return true;
 	} else return false;
 }
 
 void AnimatedSprite::render(const Rect &dst_rect) {
-	draw_sprite(dst_rect, std::fmod((int)animation_index, tile_x), std::floor((int)animation_index/tile_x));
+	const int index = animation_index;
+	draw_sprite(dst_rect, index % tile_x, index/tile_x);
+}
+
+
+AnimationSystem::ClipData::ClipData(const AnimationClip &clip): clip(clip) {
+	// Missing durations repeat the last one, events are sorted by frame
+	const size_t count = clip.frames.size();
+	this->clip.durations.resize(count, clip.durations.empty()? 0.1f : clip.durations.back());
+	for (float &duration: this->clip.durations)
+		duration = std::max(duration, 1e-6f);
+
+	std::vector<ClipEvent> &events = this->clip.events;
+	std::stable_sort(events.begin(), events.end(), [](const ClipEvent &a, const ClipEvent &b) {
+		return a.frame < b.frame;
+	});
+	event_offsets.resize(count + 1);
+	size_t event = 0;
+	for (size_t frame = 0; frame <= count; frame++) {
+		while (event < events.size() && events[event].frame < (int)frame)
+			event++;
+		event_offsets[frame] = event;
+	}
+}
+
+int AnimationSystem::add_clip(const AnimationClip &clip) {
+	// Returns the id of the clip
+	if (clip.frames.empty()) {
+		FLOG_ERROR(LOG_RENDER, "Animation clips need atleast one frame");
+		return -1;
+	}
+
+	clips.emplace_back(clip);
+	return clips.size() - 1;
+}
+
+const AnimationClip& AnimationSystem::get_clip(const int clip) const {
+	return clips[clip].clip;
+}
+
+bool AnimationSystem::is_valid_clip(const int clip) const {
+	return clip >= 0 && clip < (int)clips.size();
+}
+
+bool AnimationSystem::is_valid_instance(const uint32_t instance) const {
+	// Removed ids keep a stale index which points to another instance
+	return instance < indices.size() && indices[instance] < instances.size() && instances[indices[instance]] == instance;
+}
+
+uint32_t AnimationSystem::add_instance(const int clip, const float speed) {
+	if (!is_valid_clip(clip)) {
+		FLOG_ERROR(LOG_RENDER, "Invalid animation clip {}", clip);
+		return INVALID_ANIMATION_INSTANCE;
+	}
+
+	uint32_t instance;
+	if (free_instances.empty()) {
+		instance = indices.size();
+		indices.push_back(0);
+	} else {
+		instance = free_instances.back();
+		free_instances.pop_back();
+	}
+
+	indices[instance] = instances.size();
+	instances.push_back(instance);
+	clip_ids.push_back(clip);
+	frames.push_back(0);
+	times.push_back(0);
+	speeds.push_back(speed);
+	finished.push_back(false);
+	src_rects.push_back(clips[clip].clip.frames[0]);
+
+	return instance;
+}
+
+void AnimationSystem::remove_instance(const uint32_t instance) {
+	if (!is_valid_instance(instance)) {
+		FLOG_ERROR(LOG_RENDER, "Invalid animation instance {}", instance);
+		return;
+	}
+
+	// Fills the gap with the last instance so that the arrays stay dense
+	const uint32_t index = indices[instance];
+	const uint32_t last = instances.size() - 1;
+	if (index != last) {
+		instances[index] = instances[last];
+		clip_ids[index] = clip_ids[last];
+		frames[index] = frames[last];
+		times[index] = times[last];
+		speeds[index] = speeds[last];
+		finished[index] = finished[last];
+		src_rects[index] = src_rects[last];
+		indices[instances[index]] = index;
+	}
+
+	instances.pop_back();
+	clip_ids.pop_back();
+	frames.pop_back();
+	times.pop_back();
+	speeds.pop_back();
+	finished.pop_back();
+	src_rects.pop_back();
+	free_instances.push_back(instance);
+}
+
+void AnimationSystem::play(const uint32_t instance, const int clip, const bool restart) {
+	if (!is_valid_instance(instance)) {
+		FLOG_ERROR(LOG_RENDER, "Invalid animation instance {}", instance);
+		return;
+	}
+	if (!is_valid_clip(clip)) {
+		FLOG_ERROR(LOG_RENDER, "Invalid animation clip {}", clip);
+		return;
+	}
+
+	const uint32_t index = indices[instance];
+	if (clip_ids[index] == (uint32_t)clip && !restart)
+		return;
+
+	clip_ids[index] = clip;
+	frames[index] = 0;
+	times[index] = 0;
+	finished[index] = false;
+	src_rects[index] = clips[clip].clip.frames[0];
+}
+
+void AnimationSystem::set_speed(const uint32_t instance, const float speed) {
+	speeds[indices[instance]] = speed;
+}
+
+bool AnimationSystem::is_finished(const uint32_t instance) const {
+	return finished[indices[instance]];
+}
+
+int AnimationSystem::get_frame(const uint32_t instance) const {
+	return frames[indices[instance]];
+}
+
+size_t AnimationSystem::size() const {
+	return instances.size();
+}
+
+void AnimationSystem::update(const double dt) {
+	events.clear();
+	const size_t count = instances.size();
+	for (size_t i = 0; i < count; i++) {
+		if (finished[i])
+			continue;
+
+		times[i] += dt*speeds[i];
+		const ClipData &data = clips[clip_ids[i]];
+		const float *durations = data.clip.durations.data();
+		uint32_t frame = frames[i];
+		if (times[i] < durations[frame])
+			continue;
+
+		// Skips as many frames as the time covers and reports their events
+		const uint32_t frame_count = data.clip.frames.size();
+		while (times[i] >= durations[frame]) {
+			times[i] -= durations[frame];
+			if (frame + 1 < frame_count)
+				frame++;
+			else if (data.clip.loop)
+				frame = 0;
+			else {
+				finished[i] = true;
+				times[i] = 0;
+				break;
+			}
+
+			for (uint32_t event = data.event_offsets[frame]; event < data.event_offsets[frame + 1]; event++)
+				events.push_back({instances[i], data.clip.events[event].id});
+		}
+
+		frames[i] = frame;
+		src_rects[i] = data.clip.frames[frame];
+	}
+}
+
+const IRect& AnimationSystem::get_src_rect(const uint32_t instance) const {
+	return src_rects[indices[instance]];
+}
+
+const std::vector<IRect>& AnimationSystem::get_src_rects() const {
+	return src_rects;
+}
+
+const std::vector<uint32_t>& AnimationSystem::get_instances() const {
+	return instances;
+}
+
+const std::vector<AnimationEvent>& AnimationSystem::get_events() const {
+	return events;
+}
+
+
+TileMap::TileMap(Renderer &renderer, SpriteSheet &sheet, const IVector &size, const int layer_count):
+	renderer(renderer), sheet(sheet), batch(sheet.texture), columns(size.x), rows(size.y) {
+	chunk_columns = (columns + TILEMAP_CHUNK_SIZE - 1)/TILEMAP_CHUNK_SIZE;
+	chunk_rows = (rows + TILEMAP_CHUNK_SIZE - 1)/TILEMAP_CHUNK_SIZE;
+	layers.resize(layer_count);
+	for (Layer &layer: layers) {
+		layer.tiles.assign(columns*rows, EMPTY_TILE);
+		layer.chunks.resize(chunk_columns*chunk_rows);
+	}
+}
+
+TileMap::Chunk& TileMap::get_chunk(Layer &layer, const IVector &pos) {
+	return layer.chunks[(pos.y/TILEMAP_CHUNK_SIZE)*chunk_columns + pos.x/TILEMAP_CHUNK_SIZE];
+}
+
+void TileMap::add_tiles(const Layer &layer, const int chunk, const Vector &offset, const Vector &scale) {
+	// Adds the tiles of the chunk to the batch, offset is the position of
+	// the top left corner of the chunk
+	const int start_x = (chunk % chunk_columns)*TILEMAP_CHUNK_SIZE;
+	const int start_y = (chunk/chunk_columns)*TILEMAP_CHUNK_SIZE;
+	const int end_x = std::min(start_x + TILEMAP_CHUNK_SIZE, columns);
+	const int end_y = std::min(start_y + TILEMAP_CHUNK_SIZE, rows);
+	const float tile_w = sheet.tile_w*scale.x, tile_h = sheet.tile_h*scale.y;
+	for (int y = start_y; y < end_y; y++) {
+		for (int x = start_x; x < end_x; x++) {
+			const int tile = layer.tiles[y*columns + x];
+			if (tile == EMPTY_TILE)
+				continue;
+
+			const IRect src_rect = {sheet.src_rect.x + sheet.tile_w*(tile % sheet.tile_x), sheet.src_rect.y + sheet.tile_h*(tile/sheet.tile_x), sheet.tile_w, sheet.tile_h};
+			batch.add({offset.x + (x - start_x)*tile_w, offset.y + (y - start_y)*tile_h, tile_w, tile_h}, src_rect);
+		}
+	}
+}
+
+void TileMap::bake(Layer &layer, const int index) {
+	// Draws the tiles of the chunk into its texture
+	Chunk &chunk = layer.chunks[index];
+	if (chunk.texture == nullptr) {
+		if (!free_textures.empty()) {
+			chunk.texture = std::move(free_textures.back());
+			free_textures.pop_back();
+		} else {
+			chunk.texture = std::make_unique<Texture>(renderer, IVector(TILEMAP_CHUNK_SIZE*sheet.tile_w, TILEMAP_CHUNK_SIZE*sheet.tile_h));
+			chunk.texture->set_blend_mode(SDL_BLENDMODE_BLEND);
+			// Keeps the filtering of the tiles, linear filtering would
+			// otherwise show the seams between the chunks
+			chunk.texture->set_scale_mode(sheet.texture.get_scale_mode());
+		}
+		cached_chunks++;
+	}
+
+	// The tiles are drawn in the coordinates of the texture
+	SDL_Texture *target = renderer.get_target();
+	const Camera2D *camera = renderer.get_camera();
+	renderer.reset_camera();
+	renderer.set_target(*chunk.texture);
+	renderer.clear({0, 0, 0, 0});
+	add_tiles(layer, index, {0, 0}, {1, 1});
+	batch.flush();
+	renderer.set_target(target);
+	if (camera != nullptr)
+		renderer.set_camera(*camera);
+	chunk.dirty = false;
+}
+
+void TileMap::evict_chunks() {
+	// Releases the textures of the chunks which weren't drawn for the
+	// longest time until there are at most max_cached_chunks
+	while (cached_chunks > max_cached_chunks) {
+		Chunk *oldest = nullptr;
+		for (Layer &layer: layers) {
+			for (Chunk &chunk: layer.chunks) {
+				if (chunk.texture != nullptr && chunk.last_drawn < frame && (oldest == nullptr || chunk.last_drawn < oldest->last_drawn))
+					oldest = &chunk;
+			}
+		}
+		// Everything cached is on screen
+		if (oldest == nullptr)
+			break;
+
+		free_textures.push_back(std::move(oldest->texture));
+		oldest->dirty = true;
+		cached_chunks--;
+	}
+}
+
+IVector TileMap::get_size() const {
+	return {columns, rows};
+}
+
+IVector TileMap::get_tile_size() const {
+	return {sheet.tile_w, sheet.tile_h};
+}
+
+int TileMap::get_layer_count() const {
+	return layers.size();
+}
+
+int TileMap::get_tile(const int layer, const IVector &pos) const {
+	if (pos.x < 0 || pos.y < 0 || pos.x >= columns || pos.y >= rows)
+		return EMPTY_TILE;
+
+	return layers[layer].tiles[pos.y*columns + pos.x];
+}
+
+void TileMap::set_tile(const int layer, const IVector &pos, const int tile) {
+	if (pos.x < 0 || pos.y < 0 || pos.x >= columns || pos.y >= rows) {
+		FLOG_WARN(LOG_RENDER, "Tile position ({}, {}) is outside the map", pos.x, pos.y);
+		return;
+	}
+
+	int &current = layers[layer].tiles[pos.y*columns + pos.x];
+	if (current == tile)
+		return;
+
+	Chunk &chunk = get_chunk(layers[layer], pos);
+	chunk.tile_count += (tile != EMPTY_TILE) - (current != EMPTY_TILE);
+	chunk.dirty = true;
+	current = tile;
+}
+
+void TileMap::fill(const int layer, const int tile) {
+	Layer &current = layers[layer];
+	std::fill(current.tiles.begin(), current.tiles.end(), tile);
+	for (int y = 0; y < rows; y += TILEMAP_CHUNK_SIZE) {
+		for (int x = 0; x < columns; x += TILEMAP_CHUNK_SIZE) {
+			Chunk &chunk = get_chunk(current, {x, y});
+			chunk.tile_count = (tile == EMPTY_TILE)? 0 : std::min(TILEMAP_CHUNK_SIZE, columns - x)*std::min(TILEMAP_CHUNK_SIZE, rows - y);
+			chunk.dirty = true;
+		}
+	}
+}
+
+void TileMap::set_layer_static(const int layer, const bool is_static) {
+	// Dynamic layers don't need the textures of their chunks
+	Layer &current = layers[layer];
+	current.is_static = is_static;
+	if (is_static)
+		return;
+
+	for (Chunk &chunk: current.chunks) {
+		if (chunk.texture != nullptr) {
+			free_textures.push_back(std::move(chunk.texture));
+			cached_chunks--;
+		}
+		chunk.dirty = true;
+	}
+}
+
+void TileMap::set_layer_visible(const int layer, const bool visible) {
+	layers[layer].visible = visible;
+}
+
+void TileMap::invalidate() {
+	for (Layer &layer: layers) {
+		for (Chunk &chunk: layer.chunks)
+			chunk.dirty = true;
+	}
+}
+
+void TileMap::render_chunks(const Rect &view, const Rect &dst_rect, const Rect &clip) {
+	frame++;
+	drawn_chunks = 0;
+	if (view.w <= 0 || view.h <= 0)
+		return;
+
+	const float chunk_w = TILEMAP_CHUNK_SIZE*sheet.tile_w, chunk_h = TILEMAP_CHUNK_SIZE*sheet.tile_h;
+	const int first_x = std::max<int>(std::floor(view.x/chunk_w), 0);
+	const int first_y = std::max<int>(std::floor(view.y/chunk_h), 0);
+	const int last_x = std::min<int>(std::ceil((view.x + view.w)/chunk_w), chunk_columns);
+	const int last_y = std::min<int>(std::ceil((view.y + view.h)/chunk_h), chunk_rows);
+	const float scale_x = dst_rect.w/view.w, scale_y = dst_rect.h/view.h;
+
+	// Whole chunks are drawn, the parts outside the clip rect are cut off
+	IRect clip_rect;
+	const bool clipped = renderer.get_clip_rect(clip_rect);
+	renderer.set_clip_rect({(int)std::floor(clip.x), (int)std::floor(clip.y), (int)std::ceil(clip.w), (int)std::ceil(clip.h)});
+
+	for (Layer &layer: layers) {
+		if (!layer.visible)
+			continue;
+
+		for (int y = first_y; y < last_y; y++) {
+			for (int x = first_x; x < last_x; x++) {
+				const int index = y*chunk_columns + x;
+				Chunk &chunk = layer.chunks[index];
+				if (chunk.tile_count == 0)
+					continue;
+
+				const Rect chunk_rect = {dst_rect.x + (x*chunk_w - view.x)*scale_x, dst_rect.y + (y*chunk_h - view.y)*scale_y, chunk_w*scale_x, chunk_h*scale_y};
+				if (layer.is_static) {
+					if (chunk.dirty || chunk.texture == nullptr)
+						bake(layer, index);
+					chunk.texture->render(chunk_rect);
+				} else
+					add_tiles(layer, index, {chunk_rect.x, chunk_rect.y}, {scale_x, scale_y});
+				chunk.last_drawn = frame;
+				drawn_chunks++;
+			}
+		}
+		batch.flush();
+	}
+
+	if (clipped)
+		renderer.set_clip_rect(clip_rect);
+	else
+		renderer.reset_clip_rect();
+	evict_chunks();
+}
+
+void TileMap::render(const Rect &view, const Rect &dst_rect) {
+	// Draws the area of the map inside view stretched to dst_rect
+	const Camera2D *camera = renderer.get_camera();
+	renderer.reset_camera();
+	render_chunks(view, dst_rect, dst_rect);
+	if (camera != nullptr)
+		renderer.set_camera(*camera);
+}
+
+void TileMap::render(const Rect &view) {
+	render(view, {0, 0, view.w, view.h});
+}
+
+void TileMap::render(const Camera2D &camera) {
+	// The chunks are placed in world coordinates and the renderer applies
+	// the camera to them
+	const Camera2D *previous = renderer.get_camera();
+	renderer.set_camera(camera);
+	render_chunks(camera.get_view_rect(), camera.get_view_rect(), camera.get_viewport());
+	if (previous != nullptr)
+		renderer.set_camera(*previous);
+	else
+		renderer.reset_camera();
+}
+
+int TileMap::get_drawn_chunks() const {
+	return drawn_chunks;
+}
+
+
+
+// Functions
+void update_sprite_animations(World &world, const double dt) {
+	// Advances the SpriteAnimation of every entity
+	world.each<SpriteAnimation>([dt](SpriteAnimation &animation) {
+		const AnimatedSprite *sprite = animation.sprite;
+		if (sprite == nullptr || animation.finished)
+			return;
+
+		animation.animation_index += sprite->animation_speed*dt;
+		if (animation.animation_index >= sprite->total_tiles) {
+			if (sprite->loop)
+				animation.animation_index = std::fmod(animation.animation_index, sprite->total_tiles);
+			else {
+				animation.animation_index = sprite->total_tiles - 1;
+				animation.finished = true;
+			}
+		}
+	});
+}
+
+void render_sprites(World &world) {
+	// Draws the current tile of every entity with Bounds and a SpriteAnimation
+	world.each<const Bounds, const SpriteAnimation>([](const Bounds &bounds, const SpriteAnimation &animation) {
+		if (animation.sprite == nullptr)
+			return;
+
+		const int index = animation.animation_index;
+		animation.sprite->draw_sprite(bounds, index % animation.sprite->tile_x, index/animation.sprite->tile_x);
+	});
+}
+
+ConditionAwaitable wait_for_animation(AnimatedSprite &sprite) {
+	// Resumes once the sprite completed its animation
+	const int loops = sprite.completed_loops;
+	return wait_until([&sprite, loops]() {
+		return sprite.completed_loops != loops;
+	});
 }
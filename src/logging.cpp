@@ -1,26 +1,570 @@
 #include "logging.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <signal.h>
+#endif /* _WIN32 */
+
+#include "buffered_io.h"
+
+
+
+// Structs
+// Every message in a ring buffer starts with a record followed by the
+// captured arguments
+// A record without a format function only marks the skipped space at the
+// end of the buffer
+struct LogRecord {
+	uint32_t size;
+	uint16_t level;
+	uint16_t category;
+	uint64_t time;
+	void (*format)(void *payload, std::string &output);
+	void (*destroy)(void *payload);
+};
+
+
+struct alignas(16) LogBlock {
+	std::byte bytes[16];
+};
+
+
+// Single producer single consumer ring, only the owning thread writes and
+// only the thread holding drain_mutex reads
+struct LogRing {
+	std::vector<LogBlock> blocks;
+	size_t capacity;
+	alignas(64) std::atomic<size_t> head = 0;
+	alignas(64) std::atomic<size_t> tail = 0;
+	// The end of the record which is being written
+	size_t reserved = 0;
+
+	LogRing(const size_t size):
+		blocks((size + sizeof(LogBlock) - 1)/sizeof(LogBlock)), capacity(blocks.size()*sizeof(LogBlock)) {}
+
+	std::byte* get(const size_t pos) {
+		return reinterpret_cast<std::byte*>(blocks.data()) + pos;
+	}
+};
+
 
 
 // Globals
-static int log_state = INFO|WARN|ERROR;
+// The disabled levels of every category, so that every level starts enabled
+static std::atomic<int> disabled_logs[LOG_CATEGORY_COUNT] = {};
+
+static const size_t RECORD_ALIGN = 16;
+static const size_t HEADER_SIZE = (sizeof(LogRecord) + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+
+static std::atomic<bool> async_enabled = false;
+static AsyncLogConfig async_config;
+static std::atomic<uint64_t> dropped_logs = 0;
+// Changes every time the async logging is started so that threads don't
+// keep using rings from an earlier run
+static std::atomic<int> ring_generation = 0;
+
+static std::mutex rings_mutex;
+static std::vector<std::shared_ptr<LogRing>> rings;
+static thread_local std::shared_ptr<LogRing> thread_ring;
+static thread_local int thread_ring_generation = -1;
+
+// Recursive since a sink might log an error while writing
+static std::recursive_mutex sinks_mutex;
+// The number of times the thread holds sinks_mutex, see SinksLock
+static thread_local int thread_sinks_locks = 0;
+static std::mutex drain_mutex;
+
+static std::mutex thread_mutex;
+static std::condition_variable wake_logger;
+static bool stopping = false;
+// Set by blocked producers so that the logger doesn't wait for the interval
+static std::atomic<bool> drain_requested = false;
+static std::thread logger;
 
-int get_log_state() {
-	return log_state;
+static const int CRASH_SIGNALS[] = {
+	SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+	SIGBUS
+#endif /* SIGBUS */
+};
+// The handlers which were installed before the crash handler
+#ifdef _WIN32
+static void (*previous_handlers[std::size(CRASH_SIGNALS)])(int);
+#else
+static struct sigaction previous_actions[std::size(CRASH_SIGNALS)];
+#endif /* _WIN32 */
+
+
+
+// Helper functions
+// Locks the sinks and counts the locks of the thread, as the recursive
+// mutex can't tell the crash handler whether the crashing thread holds it
+struct SinksLock {
+	std::lock_guard<std::recursive_mutex> lock{sinks_mutex};
+
+	SinksLock() {
+		thread_sinks_locks++;
+	}
+	~SinksLock() {
+		thread_sinks_locks--;
+	}
+};
+
+
+static std::vector<std::unique_ptr<LogSink>>& get_sinks() {
+	static std::vector<std::unique_ptr<LogSink>> sinks = [] {
+		std::vector<std::unique_ptr<LogSink>> sinks;
+		sinks.push_back(std::make_unique<SDLLogSink>());
+		return sinks;
+	}();
+
+	return sinks;
+}
+
+static int format_log_prefix(char *buffer, const size_t size, const LOGLEVEL level, const LOGCATEGORY category, const uint64_t time) {
+	if (category == LOG_APP)
+		return snprintf(buffer, size, "[%.3f] %s: ", time/1e9, get_log_level_name(level));
+	return snprintf(buffer, size, "[%.3f] %s %s: ", time/1e9, get_log_level_name(level), get_log_category_name(category));
+}
+
+static void write_to_sinks(const LOGLEVEL level, const LOGCATEGORY category, const uint64_t time, std::string_view message) {
+	for (auto &sink: get_sinks())
+		sink->write(level, category, time, message);
+}
+
+static void flush_sinks() {
+	for (auto &sink: get_sinks())
+		sink->flush();
+}
+
+static LogRing* get_thread_ring() {
+	const int generation = ring_generation;
+	if (thread_ring_generation != generation) {
+		thread_ring = std::make_shared<LogRing>(async_config.buffer_size);
+		thread_ring_generation = generation;
+
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		rings.push_back(thread_ring);
+	}
+
+	return thread_ring.get();
+}
+
+static bool wait_for_space(LogRing &ring, const size_t head, const size_t needed) {
+	// Returns false if the message has to be dropped
+	bool waiting = false;
+	while (ring.capacity - (head - ring.tail.load(std::memory_order_acquire)) < needed) {
+		if (async_config.overflow == LOG_DROP) {
+			dropped_logs++;
+			return false;
+		}
+		if (!waiting) {
+			drain_requested = true;
+			wake_logger.notify_one();
+			waiting = true;
+		}
+		std::this_thread::yield();
+	}
+
+	return true;
+}
+
+static bool drain_ring(LogRing &ring, std::string &message) {
+	// Returns true if any message was written
+	size_t tail = ring.tail.load(std::memory_order_relaxed);
+	const size_t head = ring.head.load(std::memory_order_acquire);
+	const bool written = (tail != head);
+
+	while (tail != head) {
+		const size_t pos = tail % ring.capacity;
+		if (ring.capacity - pos < HEADER_SIZE) {
+			// Too small for a record, so the producer skipped it
+			tail += ring.capacity - pos;
+		} else {
+			LogRecord *record = reinterpret_cast<LogRecord*>(ring.get(pos));
+			if (record->format != nullptr) {
+				void *payload = ring.get(pos + HEADER_SIZE);
+				record->format(payload, message);
+				record->destroy(payload);
+				write_to_sinks(
+					static_cast<LOGLEVEL>(record->level),
+					static_cast<LOGCATEGORY>(record->category),
+					record->time, message
+				);
+			}
+			tail += record->size;
+		}
+		// Released after every message so that blocked producers continue
+		ring.tail.store(tail, std::memory_order_release);
+	}
+
+	return written;
+}
+
+static void drain_rings() {
+	// drain_mutex must be held by the caller
+	std::vector<std::shared_ptr<LogRing>> current;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		// The rings of threads which exited are removed once they're empty
+		std::erase_if(rings, [](const std::shared_ptr<LogRing> &ring) {
+			return ring.use_count() == 1 && ring->head == ring->tail;
+		});
+		current = rings;
+	}
+
+	std::string message;
+	bool written = false;
+	SinksLock lock;
+	for (auto &ring: current)
+		written |= drain_ring(*ring, message);
+	if (written)
+		flush_sinks();
+}
+
+static void run_logger() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(thread_mutex);
+			wake_logger.wait_for(lock, std::chrono::milliseconds(async_config.flush_interval_ms), [] {
+				return stopping || drain_requested;
+			});
+			if (stopping)
+				break;
+		}
+		drain_requested = false;
+
+		std::lock_guard<std::mutex> lock(drain_mutex);
+		drain_rings();
+	}
+}
+
+static void drain_after_crash() {
+	// Best effort, the formatting isn't async signal safe but the process
+	// is going down anyway
+	// Every lock is only tried and nothing is written if one is taken, as
+	// the crashing thread might hold it
+	if (!drain_mutex.try_lock())
+		return;
+
+	if (rings_mutex.try_lock()) {
+		if (thread_sinks_locks == 0 && sinks_mutex.try_lock()) {
+			std::string message;
+			for (auto &ring: rings)
+				drain_ring(*ring, message);
+			flush_sinks();
+			sinks_mutex.unlock();
+		}
+		rings_mutex.unlock();
+	}
+	drain_mutex.unlock();
+}
+
+static size_t get_crash_signal_index(const int signal) {
+	return std::find(std::begin(CRASH_SIGNALS), std::end(CRASH_SIGNALS), signal) - std::begin(CRASH_SIGNALS);
+}
+
+#ifdef _WIN32
+static void handle_crash(const int signal) {
+	drain_after_crash();
+
+	// The earlier handler is restored, so that it handles the signal as if
+	// the crash handler wasn't installed
+	void (*previous)(int) = previous_handlers[get_crash_signal_index(signal)];
+	std::signal(signal, previous);
+	if (previous == SIG_DFL)
+		std::raise(signal);
+	else if (previous != SIG_IGN)
+		previous(signal);
+}
+#else
+static void handle_crash(const int signal, siginfo_t *info, void *context) {
+	drain_after_crash();
+
+	// The earlier action is restored, so that it handles the signal as if
+	// the crash handler wasn't installed
+	const struct sigaction &previous = previous_actions[get_crash_signal_index(signal)];
+	sigaction(signal, &previous, nullptr);
+	if (previous.sa_flags & SA_SIGINFO)
+		previous.sa_sigaction(signal, info, context);
+	else if (previous.sa_handler == SIG_DFL)
+		raise(signal);
+	else if (previous.sa_handler != SIG_IGN)
+		previous.sa_handler(signal);
+}
+#endif /* _WIN32 */
+
+static void install_crash_handlers() {
+	// The handlers which were already installed, e.g. by crash reporters,
+	// are called after the logs are written
+	static bool installed = false;
+	if (installed)
+		return;
+	installed = true;
+
+	for (size_t i = 0; i < std::size(CRASH_SIGNALS); i++) {
+#ifdef _WIN32
+		previous_handlers[i] = std::signal(CRASH_SIGNALS[i], handle_crash);
+#else
+		struct sigaction action = {};
+		action.sa_sigaction = handle_crash;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		sigaction(CRASH_SIGNALS[i], &action, &previous_actions[i]);
+#endif /* _WIN32 */
+	}
+}
+
+
+
+// Classes
+void SDLLogSink::write(
+	const LOGLEVEL level,
+	[[maybe_unused]] const LOGCATEGORY category,
+	[[maybe_unused]] const uint64_t time,
+	std::string_view message
+) {
+	// SDL adds its own prefix
+	const int length = message.size();
+	switch (level) {
+		case ERROR:
+			SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%.*s", length, message.data());
+			break;
+		case WARN:
+			SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%.*s", length, message.data());
+			break;
+		default:
+			SDL_Log("%.*s", length, message.data());
+			break;
+	}
+}
+
+
+void StdoutLogSink::write(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	const uint64_t time,
+	std::string_view message
+) {
+	char prefix[64];
+	const int length = format_log_prefix(prefix, sizeof(prefix), level, category, time);
+	fwrite(prefix, 1, length, stdout);
+	fwrite(message.data(), 1, message.size(), stdout);
+	fputc('\n', stdout);
+}
+
+void StdoutLogSink::flush() {
+	fflush(stdout);
+}
+
+
+FileLogSink::FileLogSink(const std::string &file): writer(std::make_unique<BufferedWriter>(file)) {}
+
+FileLogSink::~FileLogSink() = default;
+
+void FileLogSink::write(
+	const LOGLEVEL level,
+	const LOGCATEGORY category,
+	const uint64_t time,
+	std::string_view message
+) {
+	char prefix[64];
+	const int length = format_log_prefix(prefix, sizeof(prefix), level, category, time);
+	writer->write(prefix, length);
+	writer->write_line(message);
+}
+
+void FileLogSink::flush() {
+	writer->flush();
+}
+
+
+
+// Functions
+int get_log_state(const LOGCATEGORY category) {
+	return (INFO|WARN|ERROR) & ~disabled_logs[category].load(std::memory_order_relaxed);
 }
 
 void set_log_state(const int log_level, const bool enable) {
+	for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+		set_log_state(static_cast<LOGCATEGORY>(i), log_level, enable);
+}
+
+void set_log_state(const LOGCATEGORY category, const int log_level, const bool enable) {
 	if (enable)
-		log_state |= log_level;
+		disabled_logs[category] &= ~log_level;
 	else
-		log_state &= ~log_level;
+		disabled_logs[category] |= log_level;
 }
 
 void set_log_level(const int log_level) {
+	for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+		set_log_level(static_cast<LOGCATEGORY>(i), log_level);
+}
+
+void set_log_level(const LOGCATEGORY category, const int log_level) {
 	for (int i = 1; i <= INFO; i *= 2) {
 		if (i <= log_level)
-			set_log_state(i);
+			set_log_state(category, i);
 		else
-			set_log_state(i, false);
+			set_log_state(category, i, false);
+	}
+}
+
+const char* get_log_level_name(const LOGLEVEL level) {
+	switch (level) {
+		case ERROR:
+			return "ERROR";
+		case WARN:
+			return "WARN";
+		default:
+			return "INFO";
+	}
+}
+
+const char* get_log_category_name(const LOGCATEGORY category) {
+	switch (category) {
+		case LOG_CORE:
+			return "CORE";
+		case LOG_RENDER:
+			return "RENDER";
+		case LOG_AUDIO:
+			return "AUDIO";
+		case LOG_FONT:
+			return "FONT";
+		case LOG_NET:
+			return "NET";
+		case LOG_IO:
+			return "IO";
+		default:
+			return "APP";
 	}
 }
+
+void add_log_sink(std::unique_ptr<LogSink> sink) {
+	SinksLock lock;
+	get_sinks().push_back(std::move(sink));
+}
+
+void clear_log_sinks() {
+	// Removes every sink including the default SDL one
+	SinksLock lock;
+	get_sinks().clear();
+}
+
+void start_async_logging(const AsyncLogConfig &config) {
+	if (async_enabled) {
+		log_warn("Async logging is already running!");
+		return;
+	}
+
+	async_config = config;
+	ring_generation++;
+	stopping = false;
+	logger = std::thread(run_logger);
+	async_enabled = true;
+
+	// The thread has to be joined before the globals are destroyed
+	static bool registered = false;
+	if (!registered) {
+		std::atexit(stop_async_logging);
+		registered = true;
+	}
+	if (config.flush_on_crash)
+		install_crash_handlers();
+}
+
+void stop_async_logging() {
+	// Writes the buffered messages and goes back to logging synchronously
+	// Messages from threads which are logging at this moment may be lost
+	if (!async_enabled)
+		return;
+	async_enabled = false;
+
+	{
+		std::lock_guard<std::mutex> lock(thread_mutex);
+		stopping = true;
+	}
+	wake_logger.notify_all();
+	logger.join();
+
+	std::lock_guard<std::mutex> lock(drain_mutex);
+	drain_rings();
+	std::lock_guard<std::mutex> rings_lock(rings_mutex);
+	rings.clear();
+}
+
+bool is_async_logging() {
+	return async_enabled.load(std::memory_order_relaxed);
+}
+
+void flush_logs() {
+	// Blocks until every buffered message is written
+	std::lock_guard<std::mutex> lock(drain_mutex);
+	drain_rings();
+	SinksLock sinks_lock;
+	flush_sinks();
+}
+
+uint64_t get_dropped_logs() {
+	return dropped_logs;
+}
+
+void write_log(const LOGLEVEL level, const LOGCATEGORY category, std::string_view message) {
+	SinksLock lock;
+	write_to_sinks(level, category, SDL_GetTicksNS(), message);
+}
+
+void* reserve_log_record(const size_t size, const LOGLEVEL level, const LOGCATEGORY category, void (*format)(void*, std::string&), void (*destroy)(void*)) {
+	// Returns nullptr if the message was dropped
+	LogRing &ring = *get_thread_ring();
+	const size_t total = HEADER_SIZE + ((size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1));
+	if (total > ring.capacity) {
+		dropped_logs++;
+		return nullptr;
+	}
+
+	size_t head = ring.head.load(std::memory_order_relaxed);
+	size_t pos = head % ring.capacity;
+	if (ring.capacity - pos < total) {
+		// Records are contiguous, so the space left at the end is skipped
+		const size_t skipped = ring.capacity - pos;
+		if (!wait_for_space(ring, head, skipped))
+			return nullptr;
+		if (skipped >= HEADER_SIZE)
+			new (ring.get(pos)) LogRecord{
+				static_cast<uint32_t>(skipped),
+				static_cast<uint16_t>(level), static_cast<uint16_t>(category),
+				0, nullptr, nullptr
+			};
+		head += skipped;
+		ring.head.store(head, std::memory_order_release);
+		pos = 0;
+	}
+
+	if (!wait_for_space(ring, head, total))
+		return nullptr;
+
+	new (ring.get(pos)) LogRecord{
+		static_cast<uint32_t>(total),
+		static_cast<uint16_t>(level), static_cast<uint16_t>(category),
+		SDL_GetTicksNS(), format, destroy
+	};
+	ring.reserved = head + total;
+
+	return ring.get(pos + HEADER_SIZE);
+}
+
+void commit_log_record() {
+	thread_ring->head.store(thread_ring->reserved, std::memory_order_release);
+}
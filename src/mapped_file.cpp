@@ -0,0 +1,136 @@
+#include "core.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MMAP_ENABLED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* __unix__ || __APPLE__ */
+
+#include "logging.h"
+
+
+
+// Helper functions
+#ifdef MMAP_ENABLED
+static bool map_file(const string &file, const std::byte *&data, size_t &length) {
+	const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		::close(fd);
+		return false;
+	}
+
+	length = info.st_size;
+	if (length == 0) {
+		// Empty files can't be mapped but are still valid
+		::close(fd);
+		data = nullptr;
+		return true;
+	}
+
+	void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (address == MAP_FAILED)
+		return false;
+
+	data = static_cast<const std::byte*>(address);
+	return true;
+}
+#endif /* MMAP_ENABLED */
+
+
+
+// Classes
+MappedFile::MappedFile(const string &file) {
+#ifdef MMAP_ENABLED
+	if (map_file(file, data, length)) {
+		loaded = true;
+		mapped = (data != nullptr);
+		return;
+	}
+#endif /* MMAP_ENABLED */
+
+	// Fallback for platforms without mmap and files which aren't on the
+	// regular file system
+	size_t size;
+	void *file_data = SDL_LoadFile(file.c_str(), &size);
+	if (file_data == nullptr) {
+		FLOG_ERROR(LOG_IO, "Failed to load file! ({}): {}", file, SDL_GetError());
+		return;
+	}
+
+	data = static_cast<const std::byte*>(file_data);
+	length = size;
+	loaded = true;
+}
+
+MappedFile::MappedFile(MappedFile &&file):
+	data(file.data), length(file.length), loaded(file.loaded), mapped(file.mapped) {
+	file.data = nullptr;
+	file.length = 0;
+	file.loaded = file.mapped = false;
+}
+
+MappedFile::~MappedFile() {
+	unload();
+}
+
+MappedFile& MappedFile::operator=(MappedFile &&file) {
+	if (this != &file) {
+		unload();
+		data = file.data;
+		length = file.length;
+		loaded = file.loaded;
+		mapped = file.mapped;
+		file.data = nullptr;
+		file.length = 0;
+		file.loaded = file.mapped = false;
+	}
+
+	return *this;
+}
+
+void MappedFile::unload() {
+#ifdef MMAP_ENABLED
+	if (mapped)
+		munmap(const_cast<std::byte*>(data), length);
+	else
+#endif /* MMAP_ENABLED */
+		SDL_free(const_cast<std::byte*>(data));
+
+	data = nullptr;
+	length = 0;
+	loaded = mapped = false;
+}
+
+bool MappedFile::is_loaded() const {
+	return loaded;
+}
+
+size_t MappedFile::size() const {
+	return length;
+}
+
+std::span<const std::byte> MappedFile::get_bytes() const {
+	return {data, length};
+}
+
+std::string_view MappedFile::get_view() const {
+	return {reinterpret_cast<const char*>(data), length};
+}
+
+SDL_IOStream* MappedFile::open_io() const {
+	// The stream must be closed before the file is destroyed
+	// SDL doesn't allow constant memory streams of size 0
+	SDL_IOStream *io = (length == 0)? SDL_IOFromDynamicMem() : SDL_IOFromConstMem(data, length);
+	if (io == nullptr)
+		FLOG_ERROR(LOG_IO, "Failed to open stream over mapped file: {}", SDL_GetError());
+
+	return io;
+}
@@ -17,7 +17,7 @@ Mixer::Mixer(SDL_AudioDeviceID device_id): mixer(
 	)
 ) {
 	if (!mixer)
-		flog_error("Failed to open audio device: {}", SDL_GetError());
+		FLOG_ERROR(LOG_AUDIO, "Failed to open audio device: {}", SDL_GetError());
 }
 
 
@@ -28,10 +28,10 @@ Audio::Audio(Mixer &mixer, const string &file, bool predecode): audio(
 	)
 ) {
 	if (!audio) {
-		flog_error("Failed to load audio! ({}): {}", file, SDL_GetError());
+		FLOG_ERROR(LOG_AUDIO, "Failed to load audio! ({}): {}", file, SDL_GetError());
 	} else {
 		id = AUDIO_ID;
-		flog_info("Audio loaded successfully![{}] ({})", id, file);
+		FLOG_INFO(LOG_AUDIO, "Audio loaded successfully![{}] ({})", id, file);
 		AUDIO_ID++;
 	}
 }
@@ -43,10 +43,10 @@ Track::Track(Mixer &mixer): track(
 	)
 {
 	if (!track) {
-		flog_error("Failed to create track: {}", SDL_GetError());
+		FLOG_ERROR(LOG_AUDIO, "Failed to create track: {}", SDL_GetError());
 	} else {
 		id = TRACK_ID;
-		flog_info("Track created successfully![{}]", id);
+		FLOG_INFO(LOG_AUDIO, "Track created successfully![{}]", id);
 		TRACK_ID++;
 	}
 }
@@ -72,7 +72,7 @@ void Track::volume(float volume) {
 
 void Track::pause() {
 	if (is_paused) {
-		flog_warn("Sound is already paused!");
+		FLOG_WARN(LOG_AUDIO, "Sound is already paused!");
 	} else {
 		MIX_PauseTrack(track.get());
 		is_paused = true;
@@ -84,7 +84,7 @@ void Track::resume() {
 		MIX_ResumeTrack(track.get());
 		is_paused = false;
 	} else {
-		flog_warn("Sound is not paused!");
+		FLOG_WARN(LOG_AUDIO, "Sound is not paused!");
 	}
 }
 
@@ -1,9 +1,35 @@
 #include "networking.h"
 
+#include <charconv>
+#include <cstring>
+
 #include "logging.h"
 
 
 
+// Helper functions
+// Numbers are written and parsed without going through temporary strings
+template<typename T>
+static void append_number(string &buffer, const T val) {
+	char text[32];
+	const auto result = std::to_chars(text, text + sizeof(text), val);
+	buffer.append(text, result.ptr);
+}
+
+template<typename T>
+static void parse_number(std::string_view element, T &val) {
+	// The whole element has to be a number which fits, otherwise the value
+	// is zeroed instead of being left with whatever the caller had in it
+	const char *end = element.data() + element.size();
+	const auto result = std::from_chars(element.data(), end, val);
+	if (result.ec != std::errc() || result.ptr != end) {
+		FLOG_ERROR(LOG_NET, "Failed to parse a number from packet element \"{}\"", element);
+		val = T();
+	}
+}
+
+
+
 // Classes
 string NetUtils::get_address_string(NET_Address *address) {
 	return string(NET_GetAddressString(address));
@@ -50,7 +76,7 @@ StreamSocket::State& StreamSocket::get_state() {
 		case RESOLVING_ADDRESS:
 			switch (NET_GetAddressStatus(address)) {
 				case NET_FAILURE:
-					flog_error("Failed to resolve address: {}", SDL_GetError());
+					FLOG_ERROR(LOG_NET, "Failed to resolve address: {}", SDL_GetError());
 					state = DEAD;
 					break;
 				case NET_SUCCESS:
@@ -58,10 +84,10 @@ StreamSocket::State& StreamSocket::get_state() {
 					NET_UnrefAddress(address);
 					address = nullptr;
 					if (socket == nullptr) {
-						flog_error("Failed to create stream socket: {}", SDL_GetError());
+						FLOG_ERROR(LOG_NET, "Failed to create stream socket: {}", SDL_GetError());
 						state = DEAD;
 					} else {
-						flog_info("Stream socket created successfully!");
+						FLOG_INFO(LOG_NET, "Stream socket created successfully!");
 						state = CONNECTING;
 					}
 					break;
@@ -72,7 +98,7 @@ StreamSocket::State& StreamSocket::get_state() {
 		case CONNECTING:
 			switch(NET_GetConnectionStatus(socket)) {
 				case NET_FAILURE:
-					flog_error("Failed to connect with server: {}", SDL_GetError());
+					FLOG_ERROR(LOG_NET, "Failed to connect with server: {}", SDL_GetError());
 					state = DEAD;
 					break;
 				case NET_SUCCESS:
@@ -131,7 +157,7 @@ StreamServer::State& StreamServer::get_state() {
 		case RESOLVING_ADDRESS:
 			switch (NET_GetAddressStatus(address)) {
 				case NET_FAILURE:
-					flog_error("Failed to resolve server address: {}", SDL_GetError());
+					FLOG_ERROR(LOG_NET, "Failed to resolve server address: {}", SDL_GetError());
 					state = DEAD;
 					break;
 				case NET_SUCCESS:
@@ -150,10 +176,10 @@ StreamServer::State& StreamServer::get_state() {
 				address = nullptr;
 			}
 			if (server == nullptr) {
-				flog_error("Failed to create stream server: {}", SDL_GetError());
+				FLOG_ERROR(LOG_NET, "Failed to create stream server: {}", SDL_GetError());
 				state = DEAD;
 			} else {
-				flog_info("Stream server created successfully!");
+				FLOG_INFO(LOG_NET, "Stream server created successfully!");
 				state = READY;
 			}
 			break;
@@ -179,45 +205,68 @@ StreamSocket* StreamServer::accept_client() {
 }
 
 
-string Packet::get_last_element() {
-	size_t len = buffer.size(); 
-	size_t end = len - 1;
-	while ((buffer[end - 1] != DELIMETER) && (end > 0)) {
-		end--;
-	}
+size_t Packet::get_last_element_start() const {
+	// Every element ends with the delimiter
+	if (buffer.size() < 2)
+		return 0;
+
+	const size_t start = buffer.rfind(DELIMETER, buffer.size() - 2);
+	return (start == string::npos)? 0 : start + 1;
+}
+
+std::string_view Packet::get_last_element() const {
+	// Valid until the element is popped
+	if (buffer.empty())
+		return {};
 
-	string sstr = buffer.substr(end, len - end - 1);
-	buffer.resize(end);
-	return sstr;
+	const size_t start = get_last_element_start();
+	return {buffer.data() + start, buffer.size() - start - 1};
+}
+
+void Packet::pop_last_element() {
+	buffer.resize(get_last_element_start());
 }
 
 Packet& operator<<(Packet &packet, const string &val) {
-	packet.buffer += val + packet.DELIMETER;
+	packet.buffer += val;
+	packet.buffer += packet.DELIMETER;
 	return packet;
 }
 
 Packet& operator<<(Packet &packet, const char *val) {
-	return packet << string(val);
+	packet.buffer += val;
+	packet.buffer += packet.DELIMETER;
+	return packet;
 }
 
 Packet& operator<<(Packet &packet, const bool val) {
-	return packet << std::to_string(val);
+	packet.buffer += val? '1' : '0';
+	packet.buffer += packet.DELIMETER;
+	return packet;
 }
 
 Packet& operator<<(Packet &packet, const int val) {
-	return packet << std::to_string(val);
+	append_number(packet.buffer, val);
+	packet.buffer += packet.DELIMETER;
+	return packet;
 }
 
 Packet& operator<<(Packet &packet, const float val) {
-	return packet << std::to_string(val);
+	append_number(packet.buffer, val);
+	packet.buffer += packet.DELIMETER;
+	return packet;
 }
 
 Packet& operator<<(Packet &packet, const double val) {
-	return packet << std::to_string(val);
+	append_number(packet.buffer, val);
+	packet.buffer += packet.DELIMETER;
+	return packet;
 }
 
 Packet& operator<<(Packet &packet, const uint8_t val) {
-	return packet << std::to_string(val);
+	append_number(packet.buffer, val);
+	packet.buffer += packet.DELIMETER;
+	return packet;
 }
 
 Packet& operator<<(Packet &packet, const Colour &colour) {
@@ -250,36 +299,48 @@ Packet& operator<<(Packet &packet, const Circle &circle) {
 
 Packet& operator>>(Packet &packet, string &val) {
 	val = packet.get_last_element();
+	packet.pop_last_element();
 	return packet;
 }
 
 Packet& operator>>(Packet &packet, char *val) {
-	strcpy(val, packet.get_last_element().c_str());
+	const std::string_view element = packet.get_last_element();
+	memcpy(val, element.data(), element.size());
+	val[element.size()] = '\0';
+	packet.pop_last_element();
 	return packet;
 }
 
 Packet& operator>>(Packet &packet, bool &val) {
-	val = stoi(packet.get_last_element());
+	int number = 0;
+	parse_number(packet.get_last_element(), number);
+	val = number;
+	packet.pop_last_element();
 	return packet;
 }
 
 Packet& operator>>(Packet &packet, int &val) {
-	val = stoi(packet.get_last_element());
+	parse_number(packet.get_last_element(), val);
+	packet.pop_last_element();
 	return packet;
 }
 
 Packet& operator>>(Packet &packet, float &val) {
-	val = stof(packet.get_last_element());
+	parse_number(packet.get_last_element(), val);
+	packet.pop_last_element();
 	return packet;
 }
 
 Packet& operator>>(Packet &packet, double &val) {
-	val = stod(packet.get_last_element());
+	parse_number(packet.get_last_element(), val);
+	packet.pop_last_element();
 	return packet;
 }
 
 Packet& operator>>(Packet &packet, uint8_t &val) {
-	val = packet.get_last_element()[0];
+	// Written as a number by operator<<
+	parse_number(packet.get_last_element(), val);
+	packet.pop_last_element();
 	return packet;
 }
 
@@ -331,7 +392,7 @@ Datagram::State& Datagram::get_state() {
 		case RESOLVING:
 			switch (NET_GetAddressStatus(address)) {
 				case NET_FAILURE:
-					flog_error("Failed to resolve address: {}", SDL_GetError());
+					FLOG_ERROR(LOG_NET, "Failed to resolve address: {}", SDL_GetError());
 					state = DEAD;
 					break;
 				case NET_SUCCESS:
@@ -370,7 +431,7 @@ DatagramSocket::State& DatagramSocket::get_state() {
 		case RESOLVING_ADDRESS:
 			switch (NET_GetAddressStatus(address)) {
 				case NET_FAILURE:
-					flog_error("Failed to resolve address: {}", SDL_GetError());
+					FLOG_ERROR(LOG_NET, "Failed to resolve address: {}", SDL_GetError());
 					state = DEAD;
 					break;
 				case NET_SUCCESS:
@@ -389,10 +450,10 @@ DatagramSocket::State& DatagramSocket::get_state() {
 				address = nullptr;
 			}
 			if (socket == nullptr) {
-				flog_error("Failed to create datagram socket: {}", SDL_GetError());
+				FLOG_ERROR(LOG_NET, "Failed to create datagram socket: {}", SDL_GetError());
 				state = DEAD;
 			} else {
-				flog_info("Datagram socket created successfully!");
+				FLOG_INFO(LOG_NET, "Datagram socket created successfully!");
 				state = READY;
 			}
 			break;
@@ -414,7 +475,7 @@ void DatagramSocket::send(Datagram &_datagram) {
 	_datagram.packet.clear();
 
 	if (res < 0)
-		flog_error("Failed to send packet: {}", SDL_GetError());
+		FLOG_ERROR(LOG_NET, "Failed to send packet: {}", SDL_GetError());
 }
 
 bool DatagramSocket::recv(Packet &packet) {
@@ -426,7 +487,7 @@ bool DatagramSocket::recv(Packet &packet) {
 
 		return true;
 	} else if (res < 0) {
-		flog_error("Failed to receive packet: {}", SDL_GetError());
+		FLOG_ERROR(LOG_NET, "Failed to receive packet: {}", SDL_GetError());
 	}
 
 	return false;
@@ -0,0 +1,334 @@
+#include "core.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <mutex>
+
+#include "threading.h"
+
+
+
+// Globals
+static const int PASS_SHIFT = 56;
+static const int LAYER_SHIFT = 48;
+static const int BLEND_SHIFT = 44;
+static const int TEXTURE_SHIFT = 24;
+static const uint64_t TEXTURE_MASK = 0xFFFFF;
+
+
+
+// Helper functions
+static uint64_t get_blend_index(const SDL_BlendMode blend_mode) {
+	// Maps the blend modes to 4 bits, custom ones share the last value
+	switch (blend_mode) {
+		case SDL_BLENDMODE_NONE: return 0;
+		case SDL_BLENDMODE_BLEND: return 1;
+		case SDL_BLENDMODE_BLEND_PREMULTIPLIED: return 2;
+		case SDL_BLENDMODE_ADD: return 3;
+		case SDL_BLENDMODE_ADD_PREMULTIPLIED: return 4;
+		case SDL_BLENDMODE_MOD: return 5;
+		case SDL_BLENDMODE_MUL: return 6;
+		default: return 15;
+	}
+}
+
+static uint64_t get_depth_bits(const float depth) {
+	// Maps the float to 24 bits which sort in the same order
+	uint32_t bits = std::bit_cast<uint32_t>(depth);
+	bits = (bits & 0x80000000u)? ~bits : bits | 0x80000000u;
+	return bits >> 8;
+}
+
+
+
+// Classes
+void RenderCommandBuffer::add(Command &command, const Rect &dst_rect, const float angle, const int layer, const float depth, const int texture_id) {
+	// Applies the rotation and the camera and stores the command with its key
+	if (camera != nullptr) {
+		const bool visible = (angle == 0)? camera->is_visible(dst_rect) : camera->is_visible(Circle(dst_rect.centerx(), dst_rect.centery(), std::hypot(dst_rect.w, dst_rect.h)*0.5f));
+		if (!visible)
+			return;
+	}
+
+	const float half_w = dst_rect.w*0.5f, half_h = dst_rect.h*0.5f;
+	const float cx = dst_rect.x + half_w, cy = dst_rect.y + half_h;
+	const float corners[4][2] = {{-half_w, -half_h}, {half_w, -half_h}, {half_w, half_h}, {-half_w, half_h}};
+	const float cos_a = (angle == 0)? 1 : std::cos(radians(angle)), sin_a = (angle == 0)? 0 : std::sin(radians(angle));
+	for (int i = 0; i < 4; i++) {
+		const Vector pos = {cx + corners[i][0]*cos_a - corners[i][1]*sin_a, cy + corners[i][0]*sin_a + corners[i][1]*cos_a};
+		command.positions[i] = (camera != nullptr)? camera->world_to_screen(pos) : pos;
+	}
+
+	command.target = target;
+	command.blend_mode = blend_mode;
+	keys.push_back(
+		(uint64_t(pass) << PASS_SHIFT) |
+		(uint64_t(std::clamp(layer, 0, 255)) << LAYER_SHIFT) |
+		(get_blend_index(blend_mode) << BLEND_SHIFT) |
+		((uint64_t(texture_id) & TEXTURE_MASK) << TEXTURE_SHIFT) |
+		get_depth_bits(depth)
+	);
+	commands.push_back(command);
+}
+
+void RenderCommandBuffer::set_target(SDL_Texture *target) {
+	// Draws for another target start a new pass so that they stay ordered
+	if (target != this->target && !commands.empty())
+		pass = std::min(pass + 1, 255);
+	this->target = target;
+}
+
+void RenderCommandBuffer::draw(Texture &texture, const Rect &dst_rect, const Rect &src_rect, const int layer, const float depth, const float angle, const FColour &colour, const SDL_FlipMode flip) {
+	const float inv_w = 1.0f/texture.w, inv_h = 1.0f/texture.h;
+	float u1 = src_rect.x*inv_w, u2 = (src_rect.x + src_rect.w)*inv_w;
+	float v1 = src_rect.y*inv_h, v2 = (src_rect.y + src_rect.h)*inv_h;
+	if (flip & SDL_FLIP_HORIZONTAL)
+		std::swap(u1, u2);
+	if (flip & SDL_FLIP_VERTICAL)
+		std::swap(v1, v2);
+
+	Command command = {&texture, nullptr, blend_mode, colour, {}, {{u1, v1}, {u2, v1}, {u2, v2}, {u1, v2}}};
+	// 0 is used by the draws without a texture
+	add(command, dst_rect, angle, layer, depth, texture.id + 1);
+}
+
+void RenderCommandBuffer::fill_rect(const Rect &rect, const FColour &colour, const int layer, const float depth) {
+	Command command = {nullptr, nullptr, blend_mode, colour, {}, {}};
+	add(command, rect, 0, layer, depth, 0);
+}
+
+void RenderCommandBuffer::set_camera(const Camera2D *camera) {
+	this->camera = camera;
+}
+
+void RenderCommandBuffer::set_target(Texture &target) {
+	set_target(target.texture.get());
+}
+
+void RenderCommandBuffer::set_target() {
+	set_target(nullptr);
+}
+
+void RenderCommandBuffer::set_blend_mode(const SDL_BlendMode blend_mode) {
+	this->blend_mode = blend_mode;
+}
+
+size_t RenderCommandBuffer::size() const {
+	return commands.size();
+}
+
+void RenderCommandBuffer::clear() {
+	commands.clear();
+	keys.clear();
+	target = nullptr;
+	pass = 0;
+}
+
+
+RenderQueue::RenderQueue(Renderer &renderer): renderer(renderer) {}
+
+void RenderQueue::sort(std::vector<uint32_t> &order) {
+	// Stable LSD radix sort of the command indices by key, bytes which are
+	// the same for every key are skipped
+	const std::vector<uint64_t> &keys = buffer.keys;
+	const size_t n = keys.size();
+	order.resize(n);
+	for (size_t i = 0; i < n; i++)
+		order[i] = i;
+
+	uint64_t all_set = ~uint64_t(0), any_set = 0;
+	for (const uint64_t key: keys) {
+		all_set &= key;
+		any_set |= key;
+	}
+	const uint64_t varying = all_set ^ any_set;
+
+	std::pmr::vector<uint32_t> scratch(n, &get_frame_arena());
+	for (int shift = 0; shift < 64; shift += 8) {
+		if (((varying >> shift) & 0xFF) == 0)
+			continue;
+
+		size_t offsets[256] = {};
+		for (const uint32_t index: order)
+			offsets[(keys[index] >> shift) & 0xFF]++;
+		size_t total = 0;
+		for (size_t &offset: offsets) {
+			const size_t count = offset;
+			offset = total;
+			total += count;
+		}
+		for (const uint32_t index: order)
+			scratch[offsets[(keys[index] >> shift) & 0xFF]++] = index;
+		std::copy(scratch.begin(), scratch.end(), order.begin());
+	}
+}
+
+void RenderQueue::draw(Texture &texture, const Rect &dst_rect, const Rect &src_rect, const int layer, const float depth, const float angle, const FColour &colour, const SDL_FlipMode flip) {
+	buffer.set_camera(renderer.get_camera());
+	buffer.set_target(renderer.get_target());
+	buffer.draw(texture, dst_rect, src_rect, layer, depth, angle, colour, flip);
+}
+
+void RenderQueue::fill_rect(const Rect &rect, const FColour &colour, const int layer, const float depth) {
+	buffer.set_camera(renderer.get_camera());
+	buffer.set_target(renderer.get_target());
+	buffer.fill_rect(rect, colour, layer, depth);
+}
+
+void RenderQueue::set_blend_mode(const SDL_BlendMode blend_mode) {
+	buffer.set_blend_mode(blend_mode);
+}
+
+void RenderQueue::submit(RenderCommandBuffer &other) {
+	// The passes of the buffer continue after the current one of the queue,
+	// so its draws stay after the ones already recorded for other targets
+	if (other.commands.empty()) {
+		other.clear();
+		return;
+	}
+
+	int offset = buffer.pass;
+	if (!buffer.commands.empty() && other.commands.front().target != buffer.target)
+		offset++;
+	const uint64_t pass_mask = uint64_t(0xFF) << PASS_SHIFT;
+	for (const uint64_t key: other.keys) {
+		const uint64_t pass = std::min<uint64_t>((key >> PASS_SHIFT) + offset, 255);
+		buffer.keys.push_back((key & ~pass_mask) | (pass << PASS_SHIFT));
+	}
+	buffer.commands.insert(buffer.commands.end(), other.commands.begin(), other.commands.end());
+	buffer.pass = std::min(offset + other.pass, 255);
+	buffer.target = other.commands.back().target;
+	other.clear();
+}
+
+void RenderQueue::record_parallel(const int begin, const int end, const std::function<void(RenderCommandBuffer&, int, int)> &func, const int min_band) {
+	// Every band records into a buffer of its own, they're merged in band
+	// order so the result doesn't depend on the scheduling
+	std::vector<std::pair<int, std::unique_ptr<RenderCommandBuffer>>> bands;
+	std::mutex mutex;
+	const Camera2D *camera = renderer.get_camera();
+	SDL_Texture *target = renderer.get_target();
+	ThreadPool::get_global().parallel_for(begin, end, [&](const int band_begin, const int band_end) {
+		std::unique_ptr<RenderCommandBuffer> band_buffer;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!free_buffers.empty()) {
+				band_buffer = std::move(free_buffers.back());
+				free_buffers.pop_back();
+			}
+		}
+		if (!band_buffer)
+			band_buffer = std::make_unique<RenderCommandBuffer>();
+
+		// The buffer is empty, so setting the target doesn't start a pass
+		band_buffer->set_camera(camera);
+		band_buffer->set_target(target);
+		func(*band_buffer, band_begin, band_end);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		bands.emplace_back(band_begin, std::move(band_buffer));
+	}, min_band);
+
+	std::sort(bands.begin(), bands.end(), [](const auto &a, const auto &b) {
+		return a.first < b.first;
+	});
+	size_t total = buffer.size();
+	for (const auto &band: bands)
+		total += band.second->size();
+	buffer.commands.reserve(total);
+	buffer.keys.reserve(total);
+
+	for (auto &band: bands) {
+		submit(*band.second);
+		band.second->set_blend_mode(SDL_BLENDMODE_BLEND);
+		free_buffers.push_back(std::move(band.second));
+	}
+}
+
+size_t RenderQueue::size() const {
+	return buffer.size();
+}
+
+void RenderQueue::flush() {
+	// Executes and clears the recorded draws
+	draw_calls = state_changes = 0;
+	if (buffer.commands.empty())
+		return;
+
+	const std::vector<RenderCommandBuffer::Command> &commands = buffer.commands;
+	std::vector<uint32_t> order;
+	sort(order);
+
+	// The state is set through the renderer and the textures, which skip
+	// what's already set from earlier frames
+	const int issued_state_changes = renderer.get_issued_state_changes();
+	SDL_Texture *original_target = renderer.get_target();
+	SDL_Texture *target = original_target;
+	const SDL_BlendMode original_blend_mode = renderer.get_blend_mode();
+	SDL_BlendMode draw_blend_mode = original_blend_mode;
+	Texture *blend_texture = nullptr;
+	SDL_BlendMode texture_blend_mode = SDL_BLENDMODE_INVALID;
+
+	std::pmr::vector<SDL_Vertex> vertices(&get_frame_arena());
+	for (size_t i = 0; i < order.size();) {
+		const RenderCommandBuffer::Command &first = commands[order[i]];
+		size_t end = i + 1;
+		while (end < order.size()) {
+			const RenderCommandBuffer::Command &command = commands[order[end]];
+			if (command.texture != first.texture || command.target != first.target || command.blend_mode != first.blend_mode)
+				break;
+			end++;
+		}
+
+		// Only the state which differs from the previous batch is set
+		if (first.target != target) {
+			renderer.set_target(first.target);
+			target = first.target;
+		}
+		if (first.texture != nullptr) {
+			if (first.texture != blend_texture || first.blend_mode != texture_blend_mode) {
+				first.texture->set_blend_mode(first.blend_mode);
+				blend_texture = first.texture;
+				texture_blend_mode = first.blend_mode;
+			}
+		} else if (first.blend_mode != draw_blend_mode) {
+			renderer.set_blend_mode(first.blend_mode);
+			draw_blend_mode = first.blend_mode;
+		}
+
+		vertices.clear();
+		for (size_t j = i; j < end; j++) {
+			const RenderCommandBuffer::Command &command = commands[order[j]];
+			for (int k = 0; k < 4; k++)
+				vertices.push_back({command.positions[k], command.colour, command.tex_coords[k]});
+		}
+		const size_t quads = end - i;
+		for (size_t quad = indices.size()/6; quad < quads; quad++) {
+			const int base = quad*4;
+			indices.insert(indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+		}
+		SDL_Texture *texture = (first.texture != nullptr)? first.texture->texture.get() : NULL;
+		SDL_RenderGeometry(renderer.renderer.get(), texture, vertices.data(), vertices.size(), indices.data(), quads*6);
+		renderer.count_draw(texture, vertices.size());
+		renderer.count_batch(quads);
+		draw_calls++;
+		i = end;
+	}
+
+	if (target != original_target)
+		renderer.set_target(original_target);
+	if (draw_blend_mode != original_blend_mode)
+		renderer.set_blend_mode(original_blend_mode);
+	state_changes = renderer.get_issued_state_changes() - issued_state_changes;
+
+	buffer.clear();
+}
+
+int RenderQueue::get_draw_calls() const {
+	return draw_calls;
+}
+
+int RenderQueue::get_state_changes() const {
+	return state_changes;
+}
@@ -0,0 +1,79 @@
+#include "core.h"
+
+
+
+// Classes
+SpriteBatch::SpriteBatch(Texture &texture, const size_t capacity): texture(&texture) {
+	vertices.reserve(capacity*4);
+}
+
+void SpriteBatch::set_texture(Texture &texture) {
+	// Renders the current quads first if the texture changes
+	if (&texture != this->texture)
+		flush();
+	this->texture = &texture;
+}
+
+Texture& SpriteBatch::get_texture() {
+	return *texture;
+}
+
+void SpriteBatch::add(const Rect &dst_rect, const IRect &src_rect) {
+	add(dst_rect, src_rect, {1, 1, 1, 1});
+}
+
+void SpriteBatch::add(const Rect &dst_rect, const IRect &src_rect, const FColour &colour, const SDL_FlipMode flip) {
+	const float inv_w = 1.0f/texture->w, inv_h = 1.0f/texture->h;
+	float u1 = src_rect.x*inv_w, u2 = (src_rect.x + src_rect.w)*inv_w;
+	float v1 = src_rect.y*inv_h, v2 = (src_rect.y + src_rect.h)*inv_h;
+	if (flip & SDL_FLIP_HORIZONTAL)
+		std::swap(u1, u2);
+	if (flip & SDL_FLIP_VERTICAL)
+		std::swap(v1, v2);
+
+	const SDL_FColor color = colour;
+	const float x2 = dst_rect.x + dst_rect.w, y2 = dst_rect.y + dst_rect.h;
+	const Camera2D *camera = texture->tex_renderer->get_camera();
+	if (camera == nullptr) {
+		vertices.push_back({{dst_rect.x, dst_rect.y}, color, {u1, v1}});
+		vertices.push_back({{x2, dst_rect.y}, color, {u2, v1}});
+		vertices.push_back({{x2, y2}, color, {u2, v2}});
+		vertices.push_back({{dst_rect.x, y2}, color, {u1, v2}});
+		return;
+	}
+
+	// Quads outside the view never reach SDL
+	if (!camera->is_visible(dst_rect))
+		return;
+	vertices.push_back({camera->world_to_screen({dst_rect.x, dst_rect.y}), color, {u1, v1}});
+	vertices.push_back({camera->world_to_screen({x2, dst_rect.y}), color, {u2, v1}});
+	vertices.push_back({camera->world_to_screen({x2, y2}), color, {u2, v2}});
+	vertices.push_back({camera->world_to_screen({dst_rect.x, y2}), color, {u1, v2}});
+}
+
+size_t SpriteBatch::size() const {
+	return vertices.size()/4;
+}
+
+void SpriteBatch::clear() {
+	vertices.clear();
+}
+
+void SpriteBatch::render() {
+	// Draws the quads and keeps them
+	const size_t quads = size();
+	if (quads == 0)
+		return;
+
+	for (size_t i = indices.size()/6; i < quads; i++) {
+		const int base = i*4;
+		indices.insert(indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+	}
+	texture->tex_renderer->render_geometry_raw(vertices.size(), vertices.data(), quads*6, indices.data(), *texture);
+	texture->tex_renderer->count_batch(quads);
+}
+
+void SpriteBatch::flush() {
+	render();
+	clear();
+}
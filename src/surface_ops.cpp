@@ -0,0 +1,754 @@
+#include "core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "logging.h"
+#include "threading.h"
+
+
+
+// Globals
+// Surfaces with fewer pixels than this are processed on the calling thread
+static constexpr int64_t PARALLEL_PIXELS = 256*256;
+// Minimum amount of pixels handled by a single job
+static constexpr int MIN_BAND_PIXELS = 128*128;
+
+
+
+// Structs
+// Bit offsets of the channels inside a 32 bit pixel
+struct PixelLayout {
+	int r, g, b, a;
+	bool has_alpha;
+	// Bits which are not touched by operations on the colour channels
+	uint32_t colour_keep_mask;
+};
+
+
+// Every operation below is written once as a generic lambda over one of these
+// structs, so the same code runs on full registers and on the leftover pixels
+struct ScalarOps {
+	typedef uint32_t V;
+	static constexpr int WIDTH = 1;
+
+	static V load(const uint32_t *p) {return *p;}
+	static void store(uint32_t *p, const V v) {*p = v;}
+	static V splat(const uint32_t v) {return v;}
+	static V add(const V a, const V b) {return a + b;}
+	static V sub(const V a, const V b) {return a - b;}
+	static V band(const V a, const V b) {return a & b;}
+	static V bor(const V a, const V b) {return a | b;}
+	static V shr(const V a, const int n) {return a >> n;}
+	static V shl(const V a, const int n) {return a << n;}
+	// Only valid when both the operands and the product fit in 16 bits
+	static V mul16(const V a, const V b) {return a*b;}
+};
+
+
+#if defined(__AVX2__)
+#define SIMD_ENABLED
+struct SimdOps {
+	typedef __m256i V;
+	static constexpr int WIDTH = 8;
+
+	static V load(const uint32_t *p) {return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));}
+	static void store(uint32_t *p, const V v) {_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);}
+	static V splat(const uint32_t v) {return _mm256_set1_epi32(v);}
+	static V add(const V a, const V b) {return _mm256_add_epi32(a, b);}
+	static V sub(const V a, const V b) {return _mm256_sub_epi32(a, b);}
+	static V band(const V a, const V b) {return _mm256_and_si256(a, b);}
+	static V bor(const V a, const V b) {return _mm256_or_si256(a, b);}
+	static V shr(const V a, const int n) {return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n));}
+	static V shl(const V a, const int n) {return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n));}
+	static V mul16(const V a, const V b) {return _mm256_mullo_epi16(a, b);}
+};
+#elif defined(__SSE2__) || defined(_M_X64)
+#define SIMD_ENABLED
+struct SimdOps {
+	typedef __m128i V;
+	static constexpr int WIDTH = 4;
+
+	static V load(const uint32_t *p) {return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));}
+	static void store(uint32_t *p, const V v) {_mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);}
+	static V splat(const uint32_t v) {return _mm_set1_epi32(v);}
+	static V add(const V a, const V b) {return _mm_add_epi32(a, b);}
+	static V sub(const V a, const V b) {return _mm_sub_epi32(a, b);}
+	static V band(const V a, const V b) {return _mm_and_si128(a, b);}
+	static V bor(const V a, const V b) {return _mm_or_si128(a, b);}
+	static V shr(const V a, const int n) {return _mm_srl_epi32(a, _mm_cvtsi32_si128(n));}
+	static V shl(const V a, const int n) {return _mm_sll_epi32(a, _mm_cvtsi32_si128(n));}
+	// The upper 16 bits of every lane are zero so this is a 32 bit multiply
+	static V mul16(const V a, const V b) {return _mm_mullo_epi16(a, b);}
+};
+#elif defined(__ARM_NEON)
+#define SIMD_ENABLED
+struct SimdOps {
+	typedef uint32x4_t V;
+	static constexpr int WIDTH = 4;
+
+	static V load(const uint32_t *p) {return vld1q_u32(p);}
+	static void store(uint32_t *p, const V v) {vst1q_u32(p, v);}
+	static V splat(const uint32_t v) {return vdupq_n_u32(v);}
+	static V add(const V a, const V b) {return vaddq_u32(a, b);}
+	static V sub(const V a, const V b) {return vsubq_u32(a, b);}
+	static V band(const V a, const V b) {return vandq_u32(a, b);}
+	static V bor(const V a, const V b) {return vorrq_u32(a, b);}
+	static V shr(const V a, const int n) {return vshlq_u32(a, vdupq_n_s32(-n));}
+	static V shl(const V a, const int n) {return vshlq_u32(a, vdupq_n_s32(n));}
+	static V mul16(const V a, const V b) {return vmulq_u32(a, b);}
+};
+#endif /* __AVX2__ */
+
+
+
+// Helper functions
+template <typename O>
+static inline typename O::V get_channel(const typename O::V px, const int shift) {
+	return O::band(O::shr(px, shift), O::splat(255));
+}
+
+// Rounded division by 255 for values upto 65535
+template <typename O>
+static inline typename O::V div255(typename O::V x) {
+	x = O::add(x, O::splat(128));
+	return O::shr(O::add(x, O::shr(x, 8)), 8);
+}
+
+// Runs the kernel over n pixels using full registers first
+template <typename K, typename... P>
+static inline void process_row(const int n, K &kernel, P*... rows) {
+	int x = 0;
+#ifdef SIMD_ENABLED
+	for (; x + SimdOps::WIDTH <= n; x += SimdOps::WIDTH)
+		kernel(SimdOps{}, (rows + x)...);
+#endif /* SIMD_ENABLED */
+	for (; x < n; x++)
+		kernel(ScalarOps{}, (rows + x)...);
+}
+
+static inline uint32_t* get_row(SDL_Surface *surface, const int y) {
+	return reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(surface->pixels) + y*surface->pitch);
+}
+
+// Calls func(begin, end) on the calling thread for small amounts of work and
+// splits the range across the global thread pool for large ones
+static void split_work(const int count, const int pixels_per_item, const std::function<void(int, int)> &func) {
+	if (int64_t(count)*pixels_per_item < PARALLEL_PIXELS) {
+		func(0, count);
+	} else {
+		ThreadPool::get_global().parallel_for(
+			0, count, func, std::max(1, MIN_BAND_PIXELS/std::max(pixels_per_item, 1))
+		);
+	}
+}
+
+static bool get_layout(SDL_Surface *surface, PixelLayout &layout, const char *func_name) {
+	const SDL_PixelFormatDetails *details = SDL_GetPixelFormatDetails(surface->format);
+	if (details == nullptr || details->bytes_per_pixel != 4) {
+		FLOG_ERROR(LOG_CORE, "Surface::{} only supports 32 bit pixel formats!", func_name);
+		return false;
+	}
+
+	layout.r = details->Rshift;
+	layout.g = details->Gshift;
+	layout.b = details->Bshift;
+	layout.a = details->Ashift;
+	layout.has_alpha = details->Amask != 0;
+	layout.colour_keep_mask = ~(details->Rmask | details->Gmask | details->Bmask);
+
+	return true;
+}
+
+// Box sizes for approximating a gaussian blur with three box blurs
+static void get_gaussian_boxes(const float sigma, int radii[3]) {
+	const float ideal = std::sqrt(12*sigma*sigma/3 + 1);
+	int lower = static_cast<int>(std::floor(ideal));
+	if (lower % 2 == 0)
+		lower--;
+	const int upper = lower + 2;
+	const float m_ideal = (12*sigma*sigma - 3*lower*lower - 12*lower - 9)/(-4.0f*lower - 4);
+	const int m = static_cast<int>(std::round(m_ideal));
+
+	for (int i = 0; i < 3; i++)
+		radii[i] = (((i < m)? lower : upper) - 1)/2;
+}
+
+
+// Formats where every row can be converted on its own, which excludes the
+// planar YUV formats and the ones with less than a byte per pixel
+static bool is_row_independent(const SDL_PixelFormat format) {
+	if (SDL_ISPIXELFORMAT_FOURCC(format)) {
+		return (
+			format == SDL_PIXELFORMAT_YUY2 ||
+			format == SDL_PIXELFORMAT_UYVY ||
+			format == SDL_PIXELFORMAT_YVYU
+		);
+	}
+
+	const SDL_PixelFormatDetails *details = SDL_GetPixelFormatDetails(format);
+	return (details != nullptr) && (details->bits_per_pixel >= 8);
+}
+
+// Copies the state used for blitting which SDL_ConvertSurface keeps, the
+// colorspace is only copied between formats of the same kind
+static void copy_surface_state(SDL_Surface *src, SDL_Surface *dst) {
+	if (SDL_ISPIXELFORMAT_FOURCC(src->format) == SDL_ISPIXELFORMAT_FOURCC(dst->format))
+		SDL_SetSurfaceColorspace(dst, SDL_GetSurfaceColorspace(src));
+
+	SDL_BlendMode blend_mode;
+	SDL_GetSurfaceBlendMode(src, &blend_mode);
+	SDL_SetSurfaceBlendMode(dst, blend_mode);
+
+	uint8_t r, g, b, a;
+	SDL_GetSurfaceColorMod(src, &r, &g, &b);
+	SDL_SetSurfaceColorMod(dst, r, g, b);
+	SDL_GetSurfaceAlphaMod(src, &a);
+	SDL_SetSurfaceAlphaMod(dst, a);
+}
+
+// Creates a surface which shares the pixels of an area of the given surface
+// along with the state used for blitting, so that every thread blits with
+// its own blit mapping
+// Palettes and colour keys aren't copied, surfaces with them are blitted on
+// one thread as the reference count of a palette isn't thread safe
+static SDL_Surface* create_view(SDL_Surface *surface, const SDL_Rect &rect) {
+	const int bytes_per_pixel = SDL_GetPixelFormatDetails(surface->format)->bytes_per_pixel;
+	uint8_t *pixels = static_cast<uint8_t*>(surface->pixels) + rect.y*surface->pitch + rect.x*bytes_per_pixel;
+
+	SDL_Surface *view = SDL_CreateSurfaceFrom(rect.w, rect.h, surface->format, pixels, surface->pitch);
+	if (view != nullptr)
+		copy_surface_state(surface, view);
+
+	return view;
+}
+
+// Blits like SDL_BlitSurface but splits large blits into row bands
+// SDL_BlitSurface stores per-blit state inside the source surface so every
+// band is blitted between views with their own state instead
+static void blit_surface(SDL_Surface *src, SDL_Rect src_rect, SDL_Surface *dst, SDL_Point pos) {
+	// Clipping the same way SDL does, so that the bands can be computed
+	if (src_rect.x < 0) {
+		pos.x -= src_rect.x;
+		src_rect.w += src_rect.x;
+		src_rect.x = 0;
+	}
+	if (src_rect.y < 0) {
+		pos.y -= src_rect.y;
+		src_rect.h += src_rect.y;
+		src_rect.y = 0;
+	}
+	src_rect.w = std::min(src_rect.w, src->w - src_rect.x);
+	src_rect.h = std::min(src_rect.h, src->h - src_rect.y);
+
+	SDL_Rect clip;
+	SDL_GetSurfaceClipRect(dst, &clip);
+	const int dx = std::max(clip.x - pos.x, 0);
+	const int dy = std::max(clip.y - pos.y, 0);
+	src_rect.x += dx;
+	src_rect.y += dy;
+	pos.x += dx;
+	pos.y += dy;
+	src_rect.w = std::min(src_rect.w - dx, clip.x + clip.w - pos.x);
+	src_rect.h = std::min(src_rect.h - dy, clip.y + clip.h - pos.y);
+
+	if (src_rect.w <= 0 || src_rect.h <= 0)
+		return;
+
+	if (
+		int64_t(src_rect.w)*src_rect.h < PARALLEL_PIXELS ||
+		SDL_MUSTLOCK(src) || SDL_MUSTLOCK(dst) ||
+		!is_row_independent(src->format) || SDL_ISPIXELFORMAT_FOURCC(src->format) ||
+		!is_row_independent(dst->format) || SDL_ISPIXELFORMAT_FOURCC(dst->format) ||
+		SDL_ISPIXELFORMAT_INDEXED(src->format) || SDL_ISPIXELFORMAT_INDEXED(dst->format) ||
+		SDL_SurfaceHasColorKey(src)
+	) {
+		SDL_Rect dst_rect = {pos.x, pos.y, src_rect.w, src_rect.h};
+		SDL_BlitSurface(src, &src_rect, dst, &dst_rect);
+		return;
+	}
+
+	split_work(src_rect.h, src_rect.w, [&](const int begin, const int end) {
+		SDL_Surface *src_view = create_view(src, {src_rect.x, src_rect.y + begin, src_rect.w, end - begin});
+		SDL_Surface *dst_view = create_view(dst, {pos.x, pos.y + begin, src_rect.w, end - begin});
+
+		if (src_view == nullptr || dst_view == nullptr)
+			FLOG_ERROR(LOG_CORE, "Failed to create surface views for blitting: {}", SDL_GetError());
+		else if (!SDL_BlitSurface(src_view, nullptr, dst_view, nullptr))
+			FLOG_ERROR(LOG_CORE, "Failed to blit surface: {}", SDL_GetError());
+
+		SDL_DestroySurface(src_view);
+		SDL_DestroySurface(dst_view);
+	});
+}
+
+
+// Classes
+class SurfaceLock {
+private:
+	SDL_Surface *surface;
+	bool locked;
+
+public:
+	SurfaceLock(SDL_Surface *_surface): surface(_surface), locked(SDL_MUSTLOCK(_surface)) {
+		if (locked)
+			SDL_LockSurface(surface);
+	}
+	~SurfaceLock() {
+		if (locked)
+			SDL_UnlockSurface(surface);
+	}
+};
+
+
+Surface Surface::convert_format(const SDL_PixelFormat format) {
+	// SDL_ConvertSurface also takes care of the palettes and colour keys
+	SDL_Surface *surf = surface.get();
+	if (SDL_SurfaceHasColorKey(surf) || SDL_ISPIXELFORMAT_INDEXED(surf->format) || SDL_ISPIXELFORMAT_INDEXED(format))
+		return SDL_ConvertSurface(surf, format);
+
+	// The state is copied first so that the colorspace is kept
+	Surface converted(IVector{surf->w, surf->h}, format);
+	if (converted.surface != nullptr) {
+		copy_surface_state(surf, converted.surface.get());
+		convert_format(converted);
+	}
+
+	return converted;
+}
+
+void Surface::convert_format(Surface &dst) const {
+	// Both the surfaces should have the same size
+	SDL_Surface *src_surf = surface.get();
+	SDL_Surface *dst_surf = dst.surface.get();
+	if (src_surf->w != dst_surf->w || src_surf->h != dst_surf->h) {
+		FLOG_ERROR(LOG_CORE, "Surface::convert_format needs surfaces of the same size!");
+		return;
+	}
+
+	if (SDL_SurfaceHasColorKey(src_surf) || SDL_ISPIXELFORMAT_INDEXED(src_surf->format) || SDL_ISPIXELFORMAT_INDEXED(dst_surf->format)) {
+		// Only this path allocates, as the conversion needs SDL_ConvertSurface
+		// Indexed pixels are mapped to the palette of dst, which gets the
+		// generated palette if it has none
+		SDL_Palette *palette = SDL_GetSurfacePalette(dst_surf);
+		managed_ptr<SDL_Surface> converted(
+			SDL_ConvertSurfaceAndColorspace(src_surf, dst_surf->format, palette, SDL_GetSurfaceColorspace(dst_surf), 0),
+			SDL_DestroySurface
+		);
+		if (converted == nullptr) {
+			FLOG_ERROR(LOG_CORE, "Failed to convert surface: {}", SDL_GetError());
+			return;
+		}
+		if (palette == nullptr && SDL_GetSurfacePalette(converted.get()) != nullptr)
+			SDL_SetSurfacePalette(dst_surf, SDL_GetSurfacePalette(converted.get()));
+		SurfaceLock lock(dst_surf);
+		SDL_ConvertPixels(
+			dst_surf->w, dst_surf->h,
+			dst_surf->format, converted->pixels, converted->pitch,
+			dst_surf->format, dst_surf->pixels, dst_surf->pitch
+		);
+		return;
+	}
+
+	SurfaceLock src_lock(src_surf), dst_lock(dst_surf);
+	const SDL_Colorspace src_colorspace = SDL_GetSurfaceColorspace(src_surf);
+	const SDL_Colorspace dst_colorspace = SDL_GetSurfaceColorspace(dst_surf);
+
+	auto convert_rows = [&](const int begin, const int end) {
+		const bool converted = SDL_ConvertPixelsAndColorspace(
+			src_surf->w, end - begin,
+			src_surf->format, src_colorspace, 0,
+			static_cast<const uint8_t*>(src_surf->pixels) + begin*src_surf->pitch, src_surf->pitch,
+			dst_surf->format, dst_colorspace, 0,
+			static_cast<uint8_t*>(dst_surf->pixels) + begin*dst_surf->pitch, dst_surf->pitch
+		);
+		if (!converted)
+			FLOG_ERROR(LOG_CORE, "Failed to convert surface: {}", SDL_GetError());
+	};
+
+	if (is_row_independent(src_surf->format) && is_row_independent(dst_surf->format))
+		split_work(h, w, convert_rows);
+	else
+		convert_rows(0, h);
+}
+
+void Surface::convert_format_ip(const SDL_PixelFormat format) {
+	surface = std::move(convert_format(format).surface);
+}
+
+void Surface::blit(Surface &dst_surface, const IVector &ivec) {
+	blit_surface(surface.get(), {0, 0, surface->w, surface->h}, dst_surface.surface.get(), {ivec.x, ivec.y});
+}
+
+void Surface::blit(Surface &dst_surface, const IRect &dst_rect) {
+	blit_surface(surface.get(), {0, 0, surface->w, surface->h}, dst_surface.surface.get(), {dst_rect.x, dst_rect.y});
+}
+
+void Surface::blit(Surface &dst_surface, const IRect &dst_rect, const IRect &src_rect) {
+	blit_surface(surface.get(), src_rect, dst_surface.surface.get(), {dst_rect.x, dst_rect.y});
+}
+
+void Surface::fill(const Colour &colour) {
+	fill_rect({0, 0, w, h}, colour);
+}
+
+void Surface::fill_rect(const IRect &rect, const Colour &colour) {
+	// SDL already uses vectorised stores for filling
+	SDL_Surface *surf = surface.get();
+	const SDL_Rect r = rect;
+	SDL_FillSurfaceRect(surf, &r, SDL_MapSurfaceRGBA(surf, colour.r, colour.g, colour.b, colour.a));
+}
+
+void Surface::blend(const Surface &src, const IVector &pos) {
+	// Blends the src surface over this surface using the alpha of src
+	SDL_Surface *dst_surf = surface.get();
+	PixelLayout layout;
+	if (!get_layout(dst_surf, layout, "blend"))
+		return;
+	if (!layout.has_alpha) {
+		FLOG_ERROR(LOG_CORE, "Surface::blend needs a pixel format with alpha!");
+		return;
+	}
+
+	managed_ptr<SDL_Surface> converted(nullptr, SDL_DestroySurface);
+	SDL_Surface *src_surf = src.surface.get();
+	if (src_surf->format != dst_surf->format) {
+		converted.reset(SDL_ConvertSurface(src_surf, dst_surf->format));
+		if (converted == nullptr) {
+			FLOG_ERROR(LOG_CORE, "Failed to convert surface for blending: {}", SDL_GetError());
+			return;
+		}
+		src_surf = converted.get();
+	}
+
+	const int left = std::max(pos.x, 0), right = std::min(pos.x + src_surf->w, dst_surf->w);
+	const int top = std::max(pos.y, 0), bottom = std::min(pos.y + src_surf->h, dst_surf->h);
+	if (left >= right || top >= bottom)
+		return;
+
+	SurfaceLock dst_lock(dst_surf), src_lock(src_surf);
+
+	auto kernel = [&layout](auto ops, uint32_t *dst, const uint32_t *src) {
+		using O = decltype(ops);
+		const typename O::V s = O::load(src), d = O::load(dst);
+		const typename O::V sa = get_channel<O>(s, layout.a);
+		const typename O::V inv_sa = O::sub(O::splat(255), sa);
+
+		typename O::V out = O::shl(
+			O::add(sa, div255<O>(O::mul16(get_channel<O>(d, layout.a), inv_sa))),
+			layout.a
+		);
+		for (const int shift: {layout.r, layout.g, layout.b}) {
+			const typename O::V c = div255<O>(O::add(
+				O::mul16(get_channel<O>(s, shift), sa),
+				O::mul16(get_channel<O>(d, shift), inv_sa)
+			));
+			out = O::bor(out, O::shl(c, shift));
+		}
+		O::store(dst, out);
+	};
+
+	split_work(bottom - top, right - left, [&](const int begin, const int end) {
+		for (int y = top + begin; y < top + end; y++) {
+			process_row(
+				right - left, kernel,
+				get_row(dst_surf, y) + left,
+				get_row(src_surf, y - pos.y) + left - pos.x
+			);
+		}
+	});
+}
+
+void Surface::premultiply() {
+	SDL_Surface *surf = surface.get();
+	PixelLayout layout;
+	if (!get_layout(surf, layout, "premultiply") || !layout.has_alpha)
+		return;
+
+	SurfaceLock lock(surf);
+
+	auto kernel = [&layout](auto ops, uint32_t *px) {
+		using O = decltype(ops);
+		const typename O::V p = O::load(px);
+		const typename O::V a = get_channel<O>(p, layout.a);
+
+		typename O::V out = O::band(p, O::splat(layout.colour_keep_mask));
+		for (const int shift: {layout.r, layout.g, layout.b})
+			out = O::bor(out, O::shl(div255<O>(O::mul16(get_channel<O>(p, shift), a)), shift));
+		O::store(px, out);
+	};
+
+	split_work(h, w, [&](const int begin, const int end) {
+		for (int y = begin; y < end; y++)
+			process_row(w, kernel, get_row(surf, y));
+	});
+}
+
+void Surface::unpremultiply() {
+	// Division doesn't vectorise without gathers so this uses a table of
+	// fixed point reciprocals instead
+	SDL_Surface *surf = surface.get();
+	PixelLayout layout;
+	if (!get_layout(surf, layout, "unpremultiply") || !layout.has_alpha)
+		return;
+
+	uint32_t reciprocals[256] = {0};
+	for (uint32_t a = 1; a < 256; a++)
+		reciprocals[a] = (255*65536 + a/2)/a;
+
+	SurfaceLock lock(surf);
+
+	split_work(h, w, [&](const int begin, const int end) {
+		for (int y = begin; y < end; y++) {
+			uint32_t *row = get_row(surf, y);
+			for (int x = 0; x < w; x++) {
+				const uint32_t p = row[x];
+				const uint32_t reciprocal = reciprocals[(p >> layout.a) & 255];
+
+				uint32_t out = p & layout.colour_keep_mask;
+				for (const int shift: {layout.r, layout.g, layout.b}) {
+					const uint32_t c = (((p >> shift) & 255)*reciprocal + 32768) >> 16;
+					out |= std::min(c, 255u) << shift;
+				}
+				row[x] = out;
+			}
+		}
+	});
+}
+
+void Surface::modulate(const Colour &colour) {
+	// Multiplies every channel with the respective channel of the colour
+	SDL_Surface *surf = surface.get();
+	PixelLayout layout;
+	if (!get_layout(surf, layout, "modulate"))
+		return;
+
+	const uint32_t keep_mask = layout.colour_keep_mask & ((layout.has_alpha)? ~(255u << layout.a) : ~0u);
+	const int shifts[4] = {layout.r, layout.g, layout.b, layout.a};
+	const uint32_t mods[4] = {colour.r, colour.g, colour.b, colour.a};
+	const int channels = (layout.has_alpha)? 4 : 3;
+
+	SurfaceLock lock(surf);
+
+	auto kernel = [&](auto ops, uint32_t *px) {
+		using O = decltype(ops);
+		const typename O::V p = O::load(px);
+
+		typename O::V out = O::band(p, O::splat(keep_mask));
+		for (int i = 0; i < channels; i++) {
+			const typename O::V c = div255<O>(O::mul16(get_channel<O>(p, shifts[i]), O::splat(mods[i])));
+			out = O::bor(out, O::shl(c, shifts[i]));
+		}
+		O::store(px, out);
+	};
+
+	split_work(h, w, [&](const int begin, const int end) {
+		for (int y = begin; y < end; y++)
+			process_row(w, kernel, get_row(surf, y));
+	});
+}
+
+void Surface::greyscale() {
+	SDL_Surface *surf = surface.get();
+	PixelLayout layout;
+	if (!get_layout(surf, layout, "greyscale"))
+		return;
+
+	SurfaceLock lock(surf);
+
+	auto kernel = [&layout](auto ops, uint32_t *px) {
+		using O = decltype(ops);
+		const typename O::V p = O::load(px);
+
+		// Rec. 601 luma weights scaled to sum upto 256
+		typename O::V luma = O::mul16(get_channel<O>(p, layout.r), O::splat(77));
+		luma = O::add(luma, O::mul16(get_channel<O>(p, layout.g), O::splat(150)));
+		luma = O::add(luma, O::mul16(get_channel<O>(p, layout.b), O::splat(29)));
+		luma = O::shr(O::add(luma, O::splat(128)), 8);
+
+		typename O::V out = O::band(p, O::splat(layout.colour_keep_mask));
+		for (const int shift: {layout.r, layout.g, layout.b})
+			out = O::bor(out, O::shl(luma, shift));
+		O::store(px, out);
+	};
+
+	split_work(h, w, [&](const int begin, const int end) {
+		for (int y = begin; y < end; y++)
+			process_row(w, kernel, get_row(surf, y));
+	});
+}
+
+void Surface::box_blur(const int radius) {
+	// The blur treats all the four bytes of a pixel the same way so it
+	// doesn't depend on the channel order
+	SDL_Surface *surf = surface.get();
+	PixelLayout layout;
+	if (radius <= 0 || w <= 0 || h <= 0 || !get_layout(surf, layout, "box_blur"))
+		return;
+
+	const uint32_t window = 2*radius + 1;
+	// Fixed point reciprocal so that the running sums are divided with
+	// a multiplication
+	const uint64_t reciprocal = ((uint64_t(1) << 32) + window/2)/window;
+	auto divide = [reciprocal](const uint32_t sum) {
+		return static_cast<uint8_t>((sum*reciprocal + (uint64_t(1) << 31)) >> 32);
+	};
+
+	SurfaceLock lock(surf);
+
+	// Horizontal pass, every row keeps a running sum of the window
+	split_work(h, w, [&](const int begin, const int end) {
+		std::vector<uint8_t> src(w*4);
+		for (int y = begin; y < end; y++) {
+			uint8_t *row = reinterpret_cast<uint8_t*>(get_row(surf, y));
+			std::memcpy(src.data(), row, w*4);
+
+			uint32_t sums[4] = {0, 0, 0, 0};
+			for (int i = -radius; i <= radius; i++) {
+				const uint8_t *p = &src[std::clamp(i, 0, w - 1)*4];
+				for (int c = 0; c < 4; c++)
+					sums[c] += p[c];
+			}
+
+			for (int x = 0; x < w; x++) {
+				const uint8_t *add = &src[std::min(x + radius + 1, w - 1)*4];
+				const uint8_t *sub = &src[std::max(x - radius, 0)*4];
+				for (int c = 0; c < 4; c++) {
+					row[x*4 + c] = divide(sums[c]);
+					sums[c] += add[c] - sub[c];
+				}
+			}
+		}
+	});
+
+	// Vertical pass, the columns are split into bands which walk down the
+	// rows so that the memory is still accessed row by row
+	std::vector<uint8_t> copy(size_t(w)*h*4);
+	for (int y = 0; y < h; y++)
+		std::memcpy(&copy[size_t(y)*w*4], get_row(surf, y), w*4);
+
+	split_work(w, h, [&](const int begin, const int end) {
+		const int n = (end - begin)*4;
+		std::vector<uint32_t> sums(n, 0);
+		auto src_row = [&](const int y) {
+			return &copy[(size_t(std::clamp(y, 0, h - 1))*w + begin)*4];
+		};
+
+		for (int i = -radius; i <= radius; i++) {
+			const uint8_t *p = src_row(i);
+			for (int j = 0; j < n; j++)
+				sums[j] += p[j];
+		}
+
+		for (int y = 0; y < h; y++) {
+			uint8_t *row = reinterpret_cast<uint8_t*>(get_row(surf, y)) + begin*4;
+			const uint8_t *add = src_row(y + radius + 1);
+			const uint8_t *sub = src_row(y - radius);
+			for (int j = 0; j < n; j++) {
+				row[j] = divide(sums[j]);
+				sums[j] += add[j] - sub[j];
+			}
+		}
+	});
+}
+
+void Surface::gaussian_blur(const float sigma) {
+	// Approximated by three successive box blurs
+	if (sigma <= 0)
+		return;
+
+	int radii[3];
+	get_gaussian_boxes(sigma, radii);
+	for (const int radius: radii)
+		box_blur(radius);
+}
+
+Surface Surface::scale(const IVector &size, const SDL_ScaleMode mode) const {
+	SDL_Surface *src = surface.get();
+	const SDL_PixelFormatDetails *details = SDL_GetPixelFormatDetails(src->format);
+	if (
+		details == nullptr || details->bytes_per_pixel != 4 ||
+		(mode != SDL_SCALEMODE_NEAREST && mode != SDL_SCALEMODE_LINEAR) ||
+		size.x <= 0 || size.y <= 0
+	) {
+		// Let SDL handle everything which isn't implemented here
+		return SDL_ScaleSurface(src, size.x, size.y, mode);
+	}
+
+	Surface scaled(size, src->format);
+	if (scaled.surface == nullptr)
+		return scaled;
+	SDL_Surface *dst = scaled.surface.get();
+
+	SurfaceLock lock(src);
+
+	if (mode == SDL_SCALEMODE_NEAREST) {
+		std::vector<int> columns(size.x);
+		for (int x = 0; x < size.x; x++)
+			columns[x] = (int64_t(2*x + 1)*src->w)/(2*size.x);
+
+		split_work(size.y, size.x, [&](const int begin, const int end) {
+			for (int y = begin; y < end; y++) {
+				const uint32_t *src_row = get_row(src, (int64_t(2*y + 1)*src->h)/(2*size.y));
+				uint32_t *dst_row = get_row(dst, y);
+				for (int x = 0; x < size.x; x++)
+					dst_row[x] = src_row[columns[x]];
+			}
+		});
+
+		return scaled;
+	}
+
+	// Sample positions and 8 bit weights for every column and row
+	struct Sample {
+		int i0, i1;
+		uint32_t weight;
+	};
+	auto get_samples = [](const int src_size, const int dst_size) {
+		std::vector<Sample> samples(dst_size);
+		const double ratio = static_cast<double>(src_size)/dst_size;
+		for (int i = 0; i < dst_size; i++) {
+			const double pos = std::clamp((i + 0.5)*ratio - 0.5, 0.0, src_size - 1.0);
+			const int i0 = static_cast<int>(pos);
+			samples[i] = {
+				i0,
+				std::min(i0 + 1, src_size - 1),
+				static_cast<uint32_t>(std::lround((pos - i0)*256))
+			};
+		}
+		return samples;
+	};
+	const std::vector<Sample> columns = get_samples(src->w, size.x);
+	const std::vector<Sample> rows = get_samples(src->h, size.y);
+
+	split_work(size.y, size.x, [&](const int begin, const int end) {
+		for (int y = begin; y < end; y++) {
+			const Sample &row = rows[y];
+			const uint8_t *top = reinterpret_cast<const uint8_t*>(get_row(src, row.i0));
+			const uint8_t *bottom = reinterpret_cast<const uint8_t*>(get_row(src, row.i1));
+			uint8_t *dst_row = reinterpret_cast<uint8_t*>(get_row(dst, y));
+
+			for (int x = 0; x < size.x; x++) {
+				const Sample &column = columns[x];
+				const int c0 = column.i0*4, c1 = column.i1*4;
+				for (int c = 0; c < 4; c++) {
+					const uint32_t t = top[c0 + c]*(256 - column.weight) + top[c1 + c]*column.weight;
+					const uint32_t b = bottom[c0 + c]*(256 - column.weight) + bottom[c1 + c]*column.weight;
+					dst_row[x*4 + c] = (t*(256 - row.weight) + b*row.weight + 32768) >> 16;
+				}
+			}
+		}
+	});
+
+	return scaled;
+}
@@ -0,0 +1,129 @@
+#include "threading.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <SDL3/SDL.h>
+
+#include "logging.h"
+
+
+
+// Classes
+ThreadPool::ThreadPool(const int num_threads) {
+	int count = num_threads;
+	if (count <= 0)
+		count = std::max(SDL_GetNumLogicalCPUCores() - 1, 1);
+
+	workers.reserve(count);
+	for (int i = 0; i < count; i++)
+		workers.emplace_back(&ThreadPool::worker_loop, this);
+
+	FLOG_INFO(LOG_CORE, "Thread pool created successfully! ({} threads)", count);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	job_available.notify_all();
+
+	for (auto &worker: workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::get_global() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::worker_loop() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_available.wait(lock, [this] {return stopping || !jobs.empty();});
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			active_jobs++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			active_jobs--;
+			if (jobs.empty() && active_jobs == 0)
+				jobs_finished.notify_all();
+		}
+	}
+}
+
+int ThreadPool::size() const {
+	return workers.size();
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	job_available.notify_one();
+}
+
+void ThreadPool::wait() {
+	// Blocks until all the submitted jobs are finished
+	std::unique_lock<std::mutex> lock(mutex);
+	jobs_finished.wait(lock, [this] {return jobs.empty() && active_jobs == 0;});
+}
+
+void ThreadPool::parallel_for(const int begin, const int end, const std::function<void(int, int)> &func, const int min_band) {
+	const int total = end - begin;
+	if (total <= 0)
+		return;
+
+	// A few bands per thread so that uneven bands get balanced
+	const int max_bands = (total + std::max(min_band, 1) - 1)/std::max(min_band, 1);
+	const int bands = std::min((size() + 1)*4, max_bands);
+	if (bands <= 1 || workers.empty()) {
+		func(begin, end);
+		return;
+	}
+
+	struct State {
+		std::atomic<int> next = 0, finished = 0;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	auto state = std::make_shared<State>();
+
+	// Helpers that start after every band was claimed return without
+	// touching func, so it's safe to capture it by reference
+	auto run_bands = [state, &func, begin, total, bands] {
+		int band;
+		while ((band = state->next++) < bands) {
+			func(
+				begin + static_cast<int>(int64_t(total)*band/bands),
+				begin + static_cast<int>(int64_t(total)*(band + 1)/bands)
+			);
+			if (++state->finished == bands) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->done.notify_all();
+			}
+		}
+	};
+
+	const int helpers = std::min(size(), bands - 1);
+	for (int i = 0; i < helpers; i++)
+		submit(run_bands);
+
+	run_bands();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->done.wait(lock, [&state, bands] {return state->finished == bands;});
+}
@@ -0,0 +1,255 @@
+#include "timer_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+
+// Globals
+static const uint32_t NO_NODE = UINT32_MAX;
+static const uint32_t FREE = UINT32_MAX;
+static const uint32_t FIRING = UINT32_MAX - 1;
+
+static const uint32_t WHEEL_SIZE = 1 << TIMER_WHEEL_BITS;
+static const uint32_t LEVEL_SIZE = 1 << TIMER_LEVEL_BITS;
+static const uint64_t MAX_DELTA = (uint64_t(1) << (TIMER_WHEEL_BITS + TIMER_LEVEL_BITS*(TIMER_WHEEL_LEVELS - 1))) - 1;
+
+
+
+// Helper functions
+static int get_shift(const int level) {
+	// The number of tick bits below the slot index of the level
+	return (level == 0)? 0 : TIMER_WHEEL_BITS + TIMER_LEVEL_BITS*(level - 1);
+}
+
+static uint32_t get_first_slot(const int level) {
+	return (level == 0)? 0 : WHEEL_SIZE + LEVEL_SIZE*(level - 1);
+}
+
+
+
+// Classes
+TimerScheduler::TimerScheduler(const double resolution):
+	slots(WHEEL_SIZE + LEVEL_SIZE*(TIMER_WHEEL_LEVELS - 1), NO_NODE), resolution(resolution) {}
+
+TimerScheduler::TimerNode* TimerScheduler::get_node(const TimerHandle handle) {
+	if (handle.index >= nodes.size())
+		return nullptr;
+
+	TimerNode &node = nodes[handle.index];
+	return (node.generation == handle.generation && node.slot != FREE)? &node : nullptr;
+}
+
+const TimerScheduler::TimerNode* TimerScheduler::get_node(const TimerHandle handle) const {
+	return const_cast<TimerScheduler*>(this)->get_node(handle);
+}
+
+uint64_t TimerScheduler::to_ticks(const double seconds) const {
+	return std::max(std::llround(seconds/resolution), 0LL);
+}
+
+TimerHandle TimerScheduler::add(const double delay, const double interval, std::function<void()> callback, const int event_id) {
+	uint32_t index;
+	if (free_nodes.empty()) {
+		index = nodes.size();
+		nodes.emplace_back();
+	} else {
+		index = free_nodes.back();
+		free_nodes.pop_back();
+	}
+
+	// Fires on the next update at the earliest, repeating timers need at
+	// least one tick between firing
+	TimerNode &node = nodes[index];
+	node.expiry = now + std::max<uint64_t>(to_ticks(delay), 1);
+	node.interval = (interval > 0)? std::max<uint64_t>(to_ticks(interval), 1) : 0;
+	node.callback = std::move(callback);
+	node.event_id = event_id;
+	link(index);
+	active++;
+
+	return {index, node.generation};
+}
+
+void TimerScheduler::link(const uint32_t index) {
+	// Puts the node into the slot of the lowest level which reaches its
+	// expiry, timers beyond the last level go into its furthest slot
+	TimerNode &node = nodes[index];
+	const uint64_t delta = (node.expiry > now)? node.expiry - now : 0;
+	const uint64_t expiry = now + std::min(delta, MAX_DELTA);
+
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (uint64_t(1) << get_shift(level + 1)))
+		level++;
+	const uint32_t mask = ((level == 0)? WHEEL_SIZE : LEVEL_SIZE) - 1;
+	const uint32_t slot = get_first_slot(level) + ((expiry >> get_shift(level)) & mask);
+
+	node.slot = slot;
+	node.prev = NO_NODE;
+	node.next = slots[slot];
+	if (node.next != NO_NODE)
+		nodes[node.next].prev = index;
+	slots[slot] = index;
+}
+
+void TimerScheduler::unlink(const uint32_t index) {
+	TimerNode &node = nodes[index];
+	if (node.prev != NO_NODE)
+		nodes[node.prev].next = node.next;
+	else
+		slots[node.slot] = node.next;
+	if (node.next != NO_NODE)
+		nodes[node.next].prev = node.prev;
+}
+
+void TimerScheduler::release(const uint32_t index) {
+	// Invalidates the handles of the node
+	TimerNode &node = nodes[index];
+	node.callback = nullptr;
+	node.slot = FREE;
+	node.generation++;
+	free_nodes.push_back(index);
+	active--;
+}
+
+void TimerScheduler::cascade(const int level) {
+	// Moves the timers of the current slot of the level to lower levels
+	const uint32_t slot = get_first_slot(level) + ((now >> get_shift(level)) & (LEVEL_SIZE - 1));
+	uint32_t index = slots[slot];
+	slots[slot] = NO_NODE;
+	while (index != NO_NODE) {
+		const uint32_t next = nodes[index].next;
+		link(index);
+		index = next;
+	}
+}
+
+void TimerScheduler::fire(const uint32_t index) {
+	// The callback is moved out while it runs so that it can cancel its own
+	// timer or schedule new ones
+	TimerNode &node = nodes[index];
+	const TimerHandle handle = {index, node.generation};
+	node.slot = FIRING;
+
+	std::function<void()> callback = std::move(node.callback);
+	if (callback)
+		callback();
+	else
+		events.push_back({handle, node.event_id});
+
+	// The node might have been reallocated or cancelled by the callback
+	TimerNode *current = get_node(handle);
+	if (current == nullptr)
+		return;
+
+	if (current->interval > 0) {
+		current->expiry += current->interval;
+		current->callback = std::move(callback);
+		link(index);
+	} else
+		release(index);
+}
+
+TimerHandle TimerScheduler::schedule(const double delay, std::function<void()> callback, const double interval) {
+	return add(delay, interval, std::move(callback), 0);
+}
+
+TimerHandle TimerScheduler::schedule_event(const double delay, const int event_id, const double interval) {
+	return add(delay, interval, nullptr, event_id);
+}
+
+bool TimerScheduler::cancel(const TimerHandle handle) {
+	// Returns false if the timer already finished or was cancelled
+	TimerNode *node = get_node(handle);
+	if (node == nullptr)
+		return false;
+
+	// A firing timer isn't in a list, fire() sees that it was released
+	if (node->slot != FIRING)
+		unlink(handle.index);
+	release(handle.index);
+
+	return true;
+}
+
+bool TimerScheduler::is_active(const TimerHandle handle) const {
+	return get_node(handle) != nullptr;
+}
+
+double TimerScheduler::get_time_left(const TimerHandle handle) const {
+	// In seconds, 0 for timers which aren't active
+	const TimerNode *node = get_node(handle);
+	if (node == nullptr || node->expiry <= now)
+		return 0;
+
+	return std::max((node->expiry - now - pending_ticks)*resolution, 0.0);
+}
+
+size_t TimerScheduler::size() const {
+	return active;
+}
+
+void TimerScheduler::clear() {
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].slot != FREE)
+			release(i);
+	}
+	std::fill(slots.begin(), slots.end(), NO_NODE);
+}
+
+void TimerScheduler::update(const double dt) {
+	// Fires the timers which expire on the way
+	events.clear();
+	if (paused || dt <= 0)
+		return;
+
+	pending_ticks += dt*time_scale/resolution;
+	const uint64_t ticks = pending_ticks;
+	pending_ticks -= ticks;
+
+	for (uint64_t i = 0; i < ticks; i++) {
+		now++;
+		const uint32_t index = now & (WHEEL_SIZE - 1);
+		if (index == 0) {
+			// Higher levels are cascaded when the level below wraps around
+			for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+				cascade(level);
+				if (((now >> get_shift(level)) & (LEVEL_SIZE - 1)) != 0)
+					break;
+			}
+		}
+
+		// Timers scheduled by the callbacks expire on later ticks, so they
+		// never end up in this slot
+		while (slots[index] != NO_NODE) {
+			const uint32_t node = slots[index];
+			unlink(node);
+			fire(node);
+		}
+	}
+}
+
+void TimerScheduler::update(const Clock &clock) {
+	// Uses the frame time of the clock
+	update(clock.frame_time/1000.0);
+}
+
+const std::vector<TimerEvent>& TimerScheduler::get_events() const {
+	return events;
+}
+
+void TimerScheduler::set_paused(const bool paused) {
+	this->paused = paused;
+}
+
+bool TimerScheduler::is_paused() const {
+	return paused;
+}
+
+void TimerScheduler::set_time_scale(const double time_scale) {
+	this->time_scale = std::max(time_scale, 0.0);
+}
+
+double TimerScheduler::get_time_scale() const {
+	return time_scale;
+}
@@ -1,14 +1,14 @@
 #include <SDL3/SDL_main.h>
 
-#include "../src/core.h"
-#include "../src/constants.h"
-#include "../src/enums.h"
-#include "../src/networking.h"
-#include "../src/graphics.h"
-#include "../src/logging.h"
-#include "../src/mixer.h"
-#include "../src/font.h"
-#include "../src/print.h"
+#include "core.h"
+#include "constants.h"
+#include "enums.h"
+#include "networking.h"
+#include "graphics.h"
+#include "logging.h"
+#include "mixer.h"
+#include "font.h"
+#include "print.h"
 
 
 using namespace std;
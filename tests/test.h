@@ -0,0 +1,24 @@
+#ifndef SUPERNOVA_TEST_H
+#define SUPERNOVA_TEST_H
+
+
+#include <cstdio>
+
+
+
+// Globals
+// The tests return the number of failed checks, so ctest sees any failure
+inline int failed_checks = 0;
+
+
+
+// Macros
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			failed_checks++; \
+		} \
+	} while (0)
+
+#endif /* SUPERNOVA_TEST_H */
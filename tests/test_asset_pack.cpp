@@ -0,0 +1,124 @@
+#include "asset_pack.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "test.h"
+
+
+
+// Globals
+static const char PACK_FILE[] = "test_asset_pack.pak";
+
+
+
+// Helper functions
+static std::vector<std::byte> make_random(const size_t size, uint32_t seed) {
+	// A fixed LCG so the incompressible data is the same on every run
+	std::vector<std::byte> data(size);
+	for (std::byte &byte: data) {
+		seed = seed*1664525u + 1013904223u;
+		byte = std::byte(seed >> 24);
+	}
+
+	return data;
+}
+
+static std::vector<std::byte> make_pattern(const size_t size, const size_t period) {
+	std::vector<std::byte> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = std::byte((i % period)*7 + (i % period)/251);
+
+	return data;
+}
+
+static bool round_trip(const std::vector<std::byte> &data) {
+	const std::vector<std::byte> compressed = compress_asset(data);
+	std::vector<std::byte> output(data.size());
+	return decompress_asset(compressed, output) && output == data;
+}
+
+static void check_codec() {
+	CHECK(round_trip({}));
+	// Shorter than a match
+	CHECK(round_trip(make_random(3, 1)));
+	// Long literal runs which need extra length bytes
+	CHECK(round_trip(make_random(15, 2)));
+	CHECK(round_trip(make_random(100000, 3)));
+	// Overlapping matches which need extra length bytes
+	CHECK(round_trip(std::vector<std::byte>(1 << 20, std::byte(0))));
+	CHECK(round_trip(make_pattern(1 << 20, 3)));
+	// Matches at the largest offset and just beyond it
+	CHECK(round_trip(make_pattern(300000, 65535)));
+	CHECK(round_trip(make_pattern(300000, 65536)));
+
+	// Long matches have to shrink the data
+	const std::vector<std::byte> zeros(1 << 20, std::byte(0));
+	CHECK(compress_asset(zeros).size() < zeros.size()/100);
+
+	// Corrupted data and wrong sizes are rejected
+	const std::vector<std::byte> data = make_pattern(4096, 100);
+	const std::vector<std::byte> compressed = compress_asset(data);
+	std::vector<std::byte> output(data.size());
+	CHECK(!decompress_asset(std::span(compressed).first(compressed.size()/2), output));
+	std::vector<std::byte> smaller(data.size() - 1), larger(data.size() + 1);
+	CHECK(!decompress_asset(compressed, smaller));
+	CHECK(!decompress_asset(compressed, larger));
+	CHECK(!decompress_asset(std::vector<std::byte>{std::byte(0x0f), std::byte(1), std::byte(0)}, output));
+}
+
+static void check_pack() {
+	const std::vector<std::byte> text = make_pattern(50000, 40);
+	const std::vector<std::byte> noise = make_random(5000, 4);
+	const std::vector<std::byte> raw = make_random(100, 5);
+
+	AssetPackWriter writer;
+	writer.add("data/text.txt", text, true);
+	writer.add("data/noise.bin", noise, true);
+	writer.add("data/empty", {}, true);
+	writer.add("raw.bin", make_random(10, 6));
+	// Replaces the earlier entry
+	writer.add("raw.bin", raw);
+	CHECK(writer.save(PACK_FILE, 64));
+
+	{
+		AssetPack pack(PACK_FILE);
+		CHECK(pack.is_loaded());
+		CHECK(pack.get_names().size() == 4);
+
+		// Every entry is found through the hash of its name
+		for (const char *name: {"data/text.txt", "data/noise.bin", "data/empty", "raw.bin"}) {
+			const AssetPackEntry *entry = pack.find(name);
+			CHECK(entry != nullptr);
+			if (entry == nullptr)
+				continue;
+			CHECK(entry->hash == hash_asset_name(name));
+			CHECK(pack.get_name(*entry) == name);
+			CHECK(entry->offset % 64 == 0);
+		}
+		CHECK(pack.find("data/text") == nullptr);
+		CHECK(!pack.contains("missing"));
+
+		// Incompressible data is stored as is
+		CHECK(pack.find("data/text.txt")->flags & ASSET_COMPRESSED);
+		CHECK(!(pack.find("data/noise.bin")->flags & ASSET_COMPRESSED));
+
+		CHECK(pack.read("data/text.txt") == text);
+		CHECK(pack.read("data/noise.bin") == noise);
+		CHECK(pack.read("data/empty").empty());
+		CHECK(pack.read("raw.bin") == raw);
+		const std::span<const std::byte> bytes = pack.get_bytes("raw.bin");
+		CHECK(std::vector<std::byte>(bytes.begin(), bytes.end()) == raw);
+	}
+
+	std::remove(PACK_FILE);
+}
+
+
+
+int main() {
+	check_codec();
+	check_pack();
+
+	return failed_checks;
+}
@@ -0,0 +1,221 @@
+#include "ecs.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "test.h"
+
+
+
+// Globals
+static int live_names = 0;
+
+
+
+// Structs
+// Not trivially copyable, so it's moved through ComponentInfo::move, and
+// counts its instances to catch components which are leaked or destroyed
+// twice
+struct Name {
+	std::string text;
+
+	Name(const std::string &text): text(text) {
+		live_names++;
+	}
+	Name(const Name &name): text(name.text) {
+		live_names++;
+	}
+	Name(Name &&name): text(std::move(name.text)) {
+		live_names++;
+	}
+	~Name() {
+		live_names--;
+	}
+
+	Name& operator=(const Name&) = default;
+	Name& operator=(Name&&) = default;
+};
+
+
+// What an entity should have, compared against the world
+struct Expected {
+	bool has_position = false, has_velocity = false, has_name = false;
+	Position position;
+	Velocity velocity;
+	std::string name;
+};
+
+
+
+// Helper functions
+static bool matches(World &world, const Entity entity, const Expected &expected) {
+	if (!world.is_alive(entity))
+		return false;
+	if (world.has<Position>(entity) != expected.has_position || world.has<Velocity>(entity) != expected.has_velocity || world.has<Name>(entity) != expected.has_name)
+		return false;
+	if (expected.has_position && (world.get<Position>(entity)->x != expected.position.x || world.get<Position>(entity)->y != expected.position.y))
+		return false;
+	if (expected.has_velocity && (world.get<Velocity>(entity)->x != expected.velocity.x || world.get<Velocity>(entity)->y != expected.velocity.y))
+		return false;
+	if (expected.has_name && world.get<Name>(entity)->text != expected.name)
+		return false;
+
+	return true;
+}
+
+static void check_changes_during_each() {
+	const int count = 1000;
+	World world;
+	std::vector<Entity> entities;
+	for (int i = 0; i < count; i++)
+		entities.push_back(world.create(Position(i, 0)));
+
+	// Entities created during the iteration aren't visited by it
+	int visited = 0;
+	std::vector<Entity> created;
+	world.each<Position>([&](Position &position) {
+		visited++;
+		created.push_back(world.create(Position(position.x, 1), Name(std::to_string(int(position.x)))));
+	});
+	CHECK(visited == count);
+	CHECK(world.size() == 2*count);
+	for (int i = 0; i < count; i++) {
+		CHECK(world.is_alive(created[i]));
+		CHECK(world.get<Position>(created[i])->x == i && world.get<Position>(created[i])->y == 1);
+		CHECK(world.get<Name>(created[i])->text == std::to_string(i));
+	}
+
+	// Adding moves the entities to another archetype after the iteration
+	visited = 0;
+	world.each<Position>([&](const Entity entity, Position &position) {
+		visited++;
+		if (position.y == 0 && int(position.x) % 2 == 0)
+			world.add(entity, Velocity(position.x, 2));
+	});
+	CHECK(visited == 2*count);
+	int moved = 0;
+	world.each<Position, Velocity>([&](Position &position, Velocity &velocity) {
+		moved++;
+		CHECK(position.x == velocity.x && velocity.y == 2);
+	});
+	CHECK(moved == count/2);
+
+	// Removing moves them back
+	world.each<Velocity>([&](const Entity entity, Velocity&) {
+		world.remove<Velocity>(entity);
+	});
+	moved = 0;
+	world.each<Velocity>([&](Velocity&) { moved++; });
+	CHECK(moved == 0);
+	for (int i = 0; i < count; i++)
+		CHECK(world.get<Position>(entities[i])->x == i && !world.has<Velocity>(entities[i]));
+
+	// Destroying during the iteration, including entities which weren't
+	// visited yet
+	world.each<Name>([&](const Entity entity, Name &name) {
+		const int i = std::stoi(name.text);
+		if (i % 3 == 0) {
+			world.destroy(entity);
+			world.destroy(entities[i]);
+		}
+	});
+	CHECK(world.size() == 2*count - 2*((count + 2)/3));
+	for (int i = 0; i < count; i++) {
+		CHECK(world.is_alive(entities[i]) == (i % 3 != 0));
+		CHECK(world.is_alive(created[i]) == (i % 3 != 0));
+		if (i % 3 != 0)
+			CHECK(world.get<Name>(created[i])->text == std::to_string(i));
+	}
+	CHECK(!world.is_deferring());
+}
+
+static void check_moves_between_archetypes() {
+	// Random structural changes over several chunks, checked against a copy
+	// of what every entity should have after each step
+	{
+		World world;
+		std::vector<Entity> entities;
+		std::unordered_map<uint32_t, Expected> expected;
+		uint32_t seed = 1;
+		auto random = [&seed](const uint32_t range) {
+			seed = seed*1664525u + 1013904223u;
+			return (seed >> 8) % range;
+		};
+
+		for (int step = 0; step < 20000; step++) {
+			const uint32_t operation = random(8);
+			if (operation < 3 || entities.empty()) {
+				Expected values;
+				values.has_position = true;
+				values.position = Position(step, -step);
+				if (operation == 0) {
+					values.has_name = true;
+					values.name = "entity " + std::to_string(step);
+					entities.push_back(world.create(Position(values.position), Name(values.name)));
+				} else
+					entities.push_back(world.create(Position(values.position)));
+				expected[entities.back().index] = values;
+				continue;
+			}
+
+			const size_t i = random(entities.size());
+			const Entity entity = entities[i];
+			Expected &values = expected[entity.index];
+			switch (operation) {
+			case 3:
+				values.has_velocity = true;
+				values.velocity = Velocity(step, step);
+				world.add(entity, Velocity(values.velocity));
+				break;
+			case 4:
+				values.has_velocity = false;
+				world.remove<Velocity>(entity);
+				break;
+			case 5:
+				values.has_name = true;
+				values.name = "renamed " + std::to_string(step);
+				world.add(entity, Name(values.name));
+				break;
+			case 6:
+				values.has_position = false;
+				world.remove<Position>(entity);
+				break;
+			default:
+				// Swaps the last row of the archetype into the gap
+				world.destroy(entity);
+				CHECK(!world.is_alive(entity));
+				expected.erase(entity.index);
+				entities[i] = entities.back();
+				entities.pop_back();
+				break;
+			}
+
+			if (step % 1000 == 0) {
+				for (const Entity other: entities)
+					CHECK(matches(world, other, expected[other.index]));
+			}
+		}
+
+		CHECK(world.size() == entities.size());
+		for (const Entity entity: entities)
+			CHECK(matches(world, entity, expected[entity.index]));
+		int names = 0;
+		for (const Entity entity: entities)
+			names += world.has<Name>(entity);
+		CHECK(live_names == names);
+	}
+
+	// Every component was destroyed exactly once
+	CHECK(live_names == 0);
+}
+
+
+
+int main() {
+	check_changes_during_each();
+	CHECK(live_names == 0);
+	check_moves_between_archetypes();
+
+	return failed_checks;
+}
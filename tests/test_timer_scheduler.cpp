@@ -0,0 +1,128 @@
+#include "timer_scheduler.h"
+
+#include <vector>
+
+#include "test.h"
+
+
+
+// Globals
+// Every test uses a resolution of a second, so delays are whole ticks and
+// the tick is advanced together with the scheduler
+static uint64_t tick = 0;
+
+
+
+// Helper functions
+static void advance(TimerScheduler &timers, const uint64_t ticks) {
+	// One tick at a time so that the callbacks see the tick they fired on
+	for (uint64_t i = 0; i < ticks; i++) {
+		tick++;
+		timers.update(1);
+	}
+}
+
+static void check_wheel_boundaries() {
+	// Delays just below, on and above the size of the first wheel and of the
+	// first level, scheduled at the start and from an unaligned tick
+	const std::vector<uint64_t> delays = {
+		1, 255, 256, 257, 511, 512, (1 << 14) - 1, 1 << 14, (1 << 14) + 1, 1 << 20
+	};
+	for (const uint64_t start: {0, 100, 255}) {
+		TimerScheduler timers(1);
+		tick = 0;
+		advance(timers, start);
+
+		std::vector<uint64_t> fired(delays.size(), 0);
+		for (size_t i = 0; i < delays.size(); i++)
+			timers.schedule(delays[i], [&fired, i]() { fired[i] = tick; });
+		advance(timers, delays.back());
+
+		for (size_t i = 0; i < delays.size(); i++)
+			CHECK(fired[i] == start + delays[i]);
+		CHECK(timers.size() == 0);
+	}
+}
+
+static void check_repeating() {
+	TimerScheduler timers(1);
+	tick = 0;
+	std::vector<uint64_t> short_ticks, long_ticks;
+	timers.schedule(3, [&]() { short_ticks.push_back(tick); }, 5);
+	// Crosses the first wheel on every repeat
+	const TimerHandle handle = timers.schedule(256, [&]() { long_ticks.push_back(tick); }, 256);
+	advance(timers, 1024);
+
+	CHECK(short_ticks.size() == 205);
+	for (size_t i = 0; i < short_ticks.size(); i++)
+		CHECK(short_ticks[i] == 3 + 5*i);
+	CHECK((long_ticks == std::vector<uint64_t>{256, 512, 768, 1024}));
+	CHECK(timers.size() == 2);
+	CHECK(timers.get_time_left(handle) == 256);
+}
+
+static void check_cancel_in_callback() {
+	TimerScheduler timers(1);
+	tick = 0;
+
+	// Cancels itself on the third repeat and schedules a new timer, which
+	// reuses the node of the cancelled one
+	int count = 0;
+	uint64_t replacement_tick = 0;
+	TimerHandle own, replacement;
+	own = timers.schedule(2, [&]() {
+		if (++count < 3)
+			return;
+		CHECK(timers.cancel(own));
+		replacement = timers.schedule(5, [&]() { replacement_tick = tick; });
+		CHECK(replacement.index == own.index);
+	}, 2);
+
+	// Two timers on the same tick which cancel each other, only the one
+	// which happens to fire first runs
+	int pair_count = 0;
+	TimerHandle first, second;
+	first = timers.schedule(10, [&]() { pair_count++; timers.cancel(second); });
+	second = timers.schedule(10, [&]() { pair_count++; timers.cancel(first); });
+
+	advance(timers, 20);
+	CHECK(count == 3);
+	CHECK(!timers.is_active(own));
+	CHECK(!timers.cancel(own));
+	CHECK(replacement_tick == 11);
+	CHECK(!timers.is_active(replacement));
+	CHECK(pair_count == 1);
+	CHECK(!timers.is_active(first) && !timers.is_active(second));
+	CHECK(timers.size() == 0);
+}
+
+
+
+static void check_long_delays() {
+	// Timers beyond the last level wait in its furthest slot and are
+	// cascaded again until they're due
+	const uint64_t delay = (uint64_t(1) << 32) + 300;
+	TimerScheduler timers(1);
+	bool fired = false;
+	const TimerHandle handle = timers.schedule(delay, [&]() { fired = true; });
+	CHECK(timers.get_time_left(handle) == delay);
+
+	timers.update(delay - 1);
+	CHECK(!fired);
+	CHECK(timers.is_active(handle));
+	CHECK(timers.get_time_left(handle) == 1);
+	timers.update(1);
+	CHECK(fired);
+	CHECK(timers.size() == 0);
+}
+
+
+
+int main() {
+	check_wheel_boundaries();
+	check_repeating();
+	check_cancel_in_callback();
+	check_long_delays();
+
+	return failed_checks;
+}
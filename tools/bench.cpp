@@ -0,0 +1,403 @@
+// Micro benchmarks of the hot paths of the engine
+// Usage: supernova_bench [options]
+// Every case is warmed up, then timed for a number of repetitions with
+// enough iterations per repetition to make the timer resolution negligible
+// The results are printed as JSON and can be compared against an earlier
+// result, the exit code is 2 if a case got slower than the threshold
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core.h"
+#include "logging.h"
+#ifdef NET_ENABLED
+#include "networking.h"
+#endif /* NET_ENABLED */
+
+
+
+// Structs
+struct Options {
+	int repetitions = 10;
+	double warmup_ms = 100;
+	// Minimum time of a single repetition
+	double min_time_ms = 20;
+	// Allowed slow down against the baseline in percent
+	double threshold = 10;
+	string filter = "";
+	string output = "";
+	string baseline = "";
+};
+
+
+struct Benchmark {
+	string name;
+	// Runs the case the given number of times
+	std::function<void(uint64_t)> run;
+};
+
+
+struct BenchmarkResult {
+	string name;
+	uint64_t iterations;
+	// Time per iteration in ns of every repetition
+	std::vector<double> samples;
+	double mean, median, min, max, stddev;
+	// Negative if the case isn't in the baseline
+	double baseline = -1;
+};
+
+
+
+// Helper functions
+static void print_usage() {
+	fprintf(stderr,
+		"Usage: supernova_bench [options]\n"
+		"  --filter text      Only runs the cases whose name contains the text\n"
+		"  --repetitions n    Timed repetitions per case (default: 10)\n"
+		"  --warmup ms        Time every case runs before it's timed (default: 100)\n"
+		"  --min-time ms      Minimum time of a repetition (default: 20)\n"
+		"  --output file      Writes the JSON there instead of stdout\n"
+		"  --baseline file    Compares the medians with an earlier output\n"
+		"  --threshold pct    Allowed slow down against the baseline (default: 10)\n"
+		"  --list             Prints the names of the cases\n"
+	);
+}
+
+// Keeps the compiler from optimising the computation of value away
+template <typename T>
+static void keep(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile char sink;
+	sink = *reinterpret_cast<const volatile char*>(&value);
+#endif
+}
+
+static double time_run(const Benchmark &benchmark, const uint64_t iterations) {
+	// Returns the time in ms
+	const auto start = std::chrono::steady_clock::now();
+	benchmark.run(iterations);
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static BenchmarkResult run_benchmark(const Benchmark &benchmark, const Options &options) {
+	// The iterations are doubled until a run is long enough to be scaled
+	// to the minimum time
+	uint64_t iterations = 1;
+	double time;
+	while ((time = time_run(benchmark, iterations)) < options.min_time_ms/10 && iterations < (uint64_t(1) << 40))
+		iterations *= 2;
+	iterations = std::max<uint64_t>(iterations*options.min_time_ms/std::max(time, 1e-6), 1);
+
+	const auto warmup_start = std::chrono::steady_clock::now();
+	while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - warmup_start).count() < options.warmup_ms)
+		time_run(benchmark, std::max<uint64_t>(iterations/10, 1));
+
+	BenchmarkResult result = {benchmark.name, iterations, {}, 0, 0, 0, 0, 0};
+	for (int i = 0; i < options.repetitions; i++)
+		result.samples.push_back(time_run(benchmark, iterations)*1e6/iterations);
+
+	std::vector<double> sorted = result.samples;
+	std::sort(sorted.begin(), sorted.end());
+	const size_t n = sorted.size();
+	result.min = sorted.front();
+	result.max = sorted.back();
+	result.median = (n % 2)? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2])/2;
+	for (const double sample: sorted)
+		result.mean += sample;
+	result.mean /= n;
+	for (const double sample: sorted)
+		result.stddev += (sample - result.mean)*(sample - result.mean);
+	result.stddev = std::sqrt(result.stddev/std::max<size_t>(n - 1, 1));
+
+	return result;
+}
+
+static bool read_baseline(const string &file, std::unordered_map<string, double> &medians) {
+	// Reads the output of an earlier run, every benchmark is on its own line
+	FILE *input = fopen(file.c_str(), "r");
+	if (input == nullptr)
+		return false;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), input)) {
+		const char *name = strstr(line, "\"name\": \"");
+		const char *median = strstr(line, "\"median_ns\": ");
+		if (name == nullptr || median == nullptr)
+			continue;
+
+		name += strlen("\"name\": \"");
+		const char *name_end = strchr(name, '"');
+		if (name_end != nullptr)
+			medians[string(name, name_end)] = std::atof(median + strlen("\"median_ns\": "));
+	}
+	fclose(input);
+
+	return true;
+}
+
+static void write_results(FILE *file, const Options &options, const std::vector<BenchmarkResult> &results) {
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"repetitions\": %d,\n", options.repetitions);
+	fprintf(file, "\t\"min_time_ms\": %.1f,\n", options.min_time_ms);
+	fprintf(file, "\t\"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult &result = results[i];
+		fprintf(file,
+			"\t\t{\"name\": \"%s\", \"iterations\": %llu, \"mean_ns\": %.3f, \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f, \"stddev_ns\": %.3f",
+			result.name.c_str(), (unsigned long long)result.iterations, result.mean, result.median, result.min, result.max, result.stddev
+		);
+		if (result.baseline > 0)
+			fprintf(file, ", \"baseline_ns\": %.3f, \"change_pct\": %.2f", result.baseline, (result.median/result.baseline - 1)*100);
+		fprintf(file, "}%s\n", (i + 1 < results.size())? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+}
+
+
+
+// Functions
+// The inputs of the cases are generated with a fixed seed
+static std::vector<Vector> get_vectors(const size_t count) {
+	std::vector<Vector> vectors;
+	srand(1);
+	for (size_t i = 0; i < count; i++)
+		vectors.push_back({rand()/float(RAND_MAX)*200 - 100, rand()/float(RAND_MAX)*200 - 100});
+
+	return vectors;
+}
+
+static std::vector<Rect> get_rects(const size_t count) {
+	std::vector<Rect> rects;
+	srand(2);
+	for (size_t i = 0; i < count; i++)
+		rects.push_back(Rect(rand() % 1000, rand() % 1000, 1 + rand() % 100, 1 + rand() % 100));
+
+	return rects;
+}
+
+static void add_vector_benchmarks(std::vector<Benchmark> &benchmarks) {
+	const std::vector<Vector> vectors = get_vectors(1024);
+	benchmarks.push_back({"vector/add_scale", [vectors](const uint64_t iterations) {
+		Vector sum = {0, 0};
+		for (uint64_t i = 0; i < iterations; i++)
+			sum = (sum + vectors[i & 1023])*0.5f;
+		keep(sum);
+	}});
+	benchmarks.push_back({"vector/normalize", [vectors](const uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; i++)
+			keep(vectors[i & 1023].normalize());
+	}});
+	benchmarks.push_back({"vector/rotate", [vectors](const uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; i++)
+			keep(vectors[i & 1023].rotate(i & 255));
+	}});
+	benchmarks.push_back({"vector/distance_to", [vectors](const uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; i++)
+			keep(vectors[i & 1023].distance_to(vectors[(i + 1) & 1023]));
+	}});
+}
+
+static void add_rect_benchmarks(std::vector<Benchmark> &benchmarks) {
+	const std::vector<Rect> rects = get_rects(1024);
+	const std::vector<Vector> points = get_vectors(1024);
+	benchmarks.push_back({"rect/collide_rect", [rects](const uint64_t iterations) {
+		int hits = 0;
+		for (uint64_t i = 0; i < iterations; i++)
+			hits += rects[i & 1023].collide_rect(rects[(i*7 + 3) & 1023]);
+		keep(hits);
+	}});
+	benchmarks.push_back({"rect/collide_point", [rects, points](const uint64_t iterations) {
+		int hits = 0;
+		for (uint64_t i = 0; i < iterations; i++)
+			hits += rects[i & 1023].collide_point(points[(i*5 + 1) & 1023]*10);
+		keep(hits);
+	}});
+}
+
+#ifdef NET_ENABLED
+static void add_packet_benchmarks(std::vector<Benchmark> &benchmarks) {
+	// A typical state update of an entity
+	benchmarks.push_back({"packet/encode", [](const uint64_t iterations) {
+		Packet packet;
+		for (uint64_t i = 0; i < iterations; i++) {
+			packet.clear();
+			packet << int(i) << 1.5f << Vector(12.5f, -3.25f) << Rect(1, 2, 30, 40) << "player" << true;
+			keep(packet.buffer.size());
+		}
+	}});
+	benchmarks.push_back({"packet/decode", [](const uint64_t iterations) {
+		Packet encoded;
+		encoded << 42 << 1.5f << Vector(12.5f, -3.25f) << Rect(1, 2, 30, 40) << "player" << true;
+		Packet packet;
+		int id;
+		float speed;
+		Vector pos;
+		Rect bounds;
+		string name;
+		bool alive;
+		for (uint64_t i = 0; i < iterations; i++) {
+			packet.buffer = encoded.buffer;
+			// Elements are read back from the end
+			packet >> alive >> name >> bounds >> pos >> speed >> id;
+			keep(id);
+			keep(pos);
+		}
+	}});
+}
+#endif /* NET_ENABLED */
+
+static void add_log_benchmarks(std::vector<Benchmark> &benchmarks) {
+	benchmarks.push_back({"log/log_to_string", [](const uint64_t iterations) {
+		const Vector pos = {12.5f, -3.25f};
+		for (uint64_t i = 0; i < iterations; i++)
+			keep(log_to_string("Player", int(i), "moved to", pos, 0.5f).size());
+	}});
+	benchmarks.push_back({"log/log_to_string_args", [](const uint64_t iterations) {
+		const LogArgs args = {", ", "[bench] "};
+		for (uint64_t i = 0; i < iterations; i++)
+			keep(log_to_string(args, "frame", int(i), 16.6).size());
+	}});
+}
+
+static void add_event_benchmarks(std::vector<Benchmark> &benchmarks) {
+	// Every iteration pushes and processes a frame of 64 synthetic input
+	// events, the time includes pushing them
+	benchmarks.push_back({"events/process_events_64", [](const uint64_t iterations) {
+		Events events;
+		EventKeys event_keys = {
+			{"UP", {SDLK_W, SDLK_UP}}, {"DOWN", {SDLK_S, SDLK_DOWN}},
+			{"LEFT", {SDLK_A, SDLK_LEFT}}, {"RIGHT", {SDLK_D, SDLK_RIGHT}}
+		};
+		Mouse mouse(LEFT | RIGHT);
+		const SDL_Keycode keys[] = {SDLK_W, SDLK_A, SDLK_S, SDLK_D};
+		SDL_Event event;
+		for (uint64_t i = 0; i < iterations; i++) {
+			for (int j = 0; j < 64; j++) {
+				SDL_zero(event);
+				switch (j % 4) {
+					case 0:
+					case 1:
+						event.type = (j % 4 == 0)? SDL_EVENT_KEY_DOWN : SDL_EVENT_KEY_UP;
+						event.key.key = keys[(j/4) % 4];
+						break;
+					case 2:
+						event.type = SDL_EVENT_MOUSE_MOTION;
+						event.motion.x = j;
+						event.motion.y = i & 1023;
+						event.motion.xrel = 1;
+						break;
+					default:
+						event.type = SDL_EVENT_MOUSE_BUTTON_DOWN;
+						event.button.button = SDL_BUTTON_LEFT;
+						break;
+				}
+				SDL_PushEvent(&event);
+			}
+			events.process_events(&event_keys, &mouse);
+		}
+		keep(mouse.pos);
+	}});
+}
+
+static std::vector<Benchmark> get_benchmarks() {
+	std::vector<Benchmark> benchmarks;
+	add_vector_benchmarks(benchmarks);
+	add_rect_benchmarks(benchmarks);
+#ifdef NET_ENABLED
+	add_packet_benchmarks(benchmarks);
+#endif /* NET_ENABLED */
+	add_log_benchmarks(benchmarks);
+	add_event_benchmarks(benchmarks);
+
+	return benchmarks;
+}
+
+
+
+int main(int argc, char *argv[]) {
+	Options options;
+	bool list = false;
+	for (int i = 1; i < argc; i++) {
+		const string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--filter" && has_value)
+			options.filter = argv[++i];
+		else if (arg == "--repetitions" && has_value)
+			options.repetitions = std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "--warmup" && has_value)
+			options.warmup_ms = std::max(std::atof(argv[++i]), 0.0);
+		else if (arg == "--min-time" && has_value)
+			options.min_time_ms = std::max(std::atof(argv[++i]), 0.1);
+		else if (arg == "--output" && has_value)
+			options.output = argv[++i];
+		else if (arg == "--baseline" && has_value)
+			options.baseline = argv[++i];
+		else if (arg == "--threshold" && has_value)
+			options.threshold = std::atof(argv[++i]);
+		else if (arg == "--list")
+			list = true;
+		else {
+			print_usage();
+			return (arg == "-h" || arg == "--help")? 0 : 1;
+		}
+	}
+
+	std::unordered_map<string, double> baseline;
+	if (!options.baseline.empty() && !read_baseline(options.baseline, baseline)) {
+		fprintf(stderr, "Failed to read the baseline %s\n", options.baseline.c_str());
+		return 1;
+	}
+
+	// Headless so that the event cases run without a display, only the
+	// errors are logged so that they don't mix with the results
+	set_log_level(WARN);
+	Engine engine(SDL_INIT_EVENTS, true);
+
+	std::vector<BenchmarkResult> results;
+	bool regressed = false;
+	for (const Benchmark &benchmark: get_benchmarks()) {
+		if (benchmark.name.find(options.filter) == string::npos)
+			continue;
+		if (list) {
+			printf("%s\n", benchmark.name.c_str());
+			continue;
+		}
+
+		BenchmarkResult result = run_benchmark(benchmark, options);
+		fprintf(stderr, "%-28s %12.3f ns  (+- %.1f%%)", result.name.c_str(), result.median, result.stddev/result.mean*100);
+		const auto it = baseline.find(result.name);
+		if (it != baseline.end() && it->second > 0) {
+			result.baseline = it->second;
+			const double change = (result.median/result.baseline - 1)*100;
+			const bool slower = change > options.threshold;
+			regressed |= slower;
+			fprintf(stderr, "  %+.2f%% against the baseline%s", change, slower? "  REGRESSION" : "");
+		}
+		fprintf(stderr, "\n");
+		results.push_back(result);
+	}
+	if (list)
+		return 0;
+
+	FILE *file = options.output.empty()? stdout : fopen(options.output.c_str(), "w");
+	if (file == nullptr) {
+		fprintf(stderr, "Failed to open %s\n", options.output.c_str());
+		return 1;
+	}
+	write_results(file, options, results);
+	if (file != stdout)
+		fclose(file);
+
+	return regressed? 2 : 0;
+}
@@ -0,0 +1,396 @@
+// Measures the rendering throughput of a set of standard scenes
+// Usage: supernova_bench_render [options]
+// Runs headless by default, drawing into a surface with the software
+// renderer, so the numbers are comparable between machines without a
+// display or a GPU
+// The results are printed as a single JSON object
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core.h"
+#include "graphics.h"
+#include "logging.h"
+#ifdef TTF_ENABLED
+#include "font.h"
+#endif /* TTF_ENABLED */
+
+
+
+// Structs
+struct Options {
+	int frames = 300;
+	int warmup = 30;
+	IVector size = {1280, 720};
+	bool headless = true;
+	string driver = "";
+	string output = "";
+	std::vector<string> scenes;
+};
+
+
+struct Scene {
+	string name;
+	// Draws the given frame, the setup is done when the scene is created
+	std::function<void(int)> draw;
+};
+
+
+struct SceneResult {
+	string name;
+	int frames;
+	double total_ms;
+	// Sorted frame times in ms
+	std::vector<double> times;
+	RenderStats stats;
+};
+
+
+
+// Helper functions
+static void print_usage() {
+	fprintf(stderr,
+		"Usage: supernova_bench_render [options]\n"
+		"  --frames n      Measured frames per scene (default: 300)\n"
+		"  --warmup n      Frames drawn before measuring (default: 30)\n"
+		"  --size WxH      Size of the render target (default: 1280x720)\n"
+		"  --scene name    Only runs the scene, can be repeated\n"
+		"  --window        Renders into a window instead of a surface\n"
+		"  --driver name   Render driver used with --window\n"
+		"  --output file   Writes the JSON there instead of stdout\n"
+		"  --list          Prints the names of the scenes\n"
+	);
+}
+
+// Small deterministic generator so that every run draws the same scenes
+static uint32_t next_random(uint32_t &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static float random_range(uint32_t &state, const float min, const float max) {
+	return min + (next_random(state) & 0xFFFFFF)/float(0xFFFFFF)*(max - min);
+}
+
+// A sheet of columns*rows tiles with a different colour and a border each
+static Texture create_sheet(Renderer &renderer, const int columns, const int rows, const int tile_size) {
+	Surface surface(IVector{columns*tile_size, rows*tile_size});
+	uint32_t state = 0x12345u;
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < columns; x++) {
+			const IRect tile = {x*tile_size, y*tile_size, tile_size, tile_size};
+			const Colour colour = {(uint8_t)(next_random(state) | 64), (uint8_t)(next_random(state) | 64), (uint8_t)(next_random(state) | 64), 255};
+			surface.fill_rect(tile, colour/2);
+			surface.fill_rect({tile.x + 1, tile.y + 1, tile_size - 2, tile_size - 2}, colour);
+		}
+	}
+
+	return Texture(renderer, surface);
+}
+
+static double get_percentile(const std::vector<double> &times, const double percentile) {
+	// Nearest rank on the sorted times
+	if (times.empty())
+		return 0;
+
+	const size_t rank = std::ceil(percentile/100*times.size());
+	return times[std::clamp<size_t>(rank, 1, times.size()) - 1];
+}
+
+
+
+// Functions
+static Scene create_sprites_scene(Renderer &renderer, const IVector &size) {
+	// 100k moving sprites from one sheet, drawn with a sprite batch
+	struct State {
+		Texture sheet;
+		SpriteBatch batch;
+		std::vector<Vector> positions, velocities;
+		std::vector<IRect> src_rects;
+
+		State(Renderer &renderer): sheet(create_sheet(renderer, 4, 4, 16)), batch(sheet, 100000) {}
+	};
+
+	auto state = std::make_shared<State>(renderer);
+	uint32_t random = 1;
+	for (int i = 0; i < 100000; i++) {
+		state->positions.push_back({random_range(random, 0, size.x), random_range(random, 0, size.y)});
+		state->velocities.push_back({random_range(random, -2, 2), random_range(random, -2, 2)});
+		const int tile = next_random(random) % 16;
+		state->src_rects.push_back({(tile % 4)*16, (tile/4)*16, 16, 16});
+	}
+
+	return {"sprites_100k", [state, size](int) {
+		for (size_t i = 0; i < state->positions.size(); i++) {
+			Vector &pos = state->positions[i];
+			pos.x += state->velocities[i].x;
+			pos.y += state->velocities[i].y;
+			if (pos.x < 0 || pos.x > size.x)
+				state->velocities[i].x = -state->velocities[i].x;
+			if (pos.y < 0 || pos.y > size.y)
+				state->velocities[i].y = -state->velocities[i].y;
+			state->batch.add({pos.x - 4, pos.y - 4, 8, 8}, state->src_rects[i]);
+		}
+		state->batch.flush();
+	}};
+}
+
+static Scene create_circles_scene(Renderer &renderer, const IVector &size) {
+	// 10k filled circles of different colours and sizes
+	struct Circles {
+		std::vector<Circle> circles;
+		std::vector<Colour> colours;
+	};
+
+	auto circles = std::make_shared<Circles>();
+	uint32_t random = 2;
+	for (int i = 0; i < 10000; i++) {
+		circles->circles.push_back({random_range(random, 0, size.x), random_range(random, 0, size.y), random_range(random, 2, 12)});
+		circles->colours.push_back({(uint8_t)next_random(random), (uint8_t)next_random(random), (uint8_t)next_random(random), 255});
+	}
+
+	return {"circles_10k", [circles, &renderer](int frame) {
+		const float offset = (frame % 64) - 32;
+		for (size_t i = 0; i < circles->circles.size(); i++)
+			renderer.draw_circle(circles->circles[i].move({offset, 0}), circles->colours[i]);
+	}};
+}
+
+#ifdef TTF_ENABLED
+static Scene create_text_scene(Renderer &renderer, const IVector &size) {
+	// Translucent panels full of text, the glyphs come from a generated
+	// atlas so that no font file is needed
+	const string chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.:,;()/-+ ";
+	const int glyph_w = 7, glyph_h = 12;
+	Surface surface(IVector{(int)chars.size()*glyph_w, glyph_h});
+	surface.fill({0, 0, 0, 0});
+	for (size_t i = 0; i < chars.size(); i++) {
+		if (chars[i] != ' ')
+			surface.fill_rect({(int)i*glyph_w + 1, 2 + (int)i % 3, glyph_w - 2, glyph_h - 4 - (int)i % 3}, WHITE);
+	}
+
+	auto atlas = std::make_shared<FontAtlas>(nullptr, Texture(renderer, surface));
+	atlas->texture.set_blend_mode(SDL_BLENDMODE_BLEND);
+	for (size_t i = 0; i < chars.size(); i++)
+		atlas->data[chars[i]] = {(int)i*glyph_w, 0, glyph_w, glyph_h};
+
+	auto lines = std::make_shared<std::vector<string>>();
+	uint32_t random = 3;
+	for (int i = 0; i < 64; i++) {
+		string line;
+		const int length = 20 + next_random(random) % 40;
+		for (int j = 0; j < length; j++)
+			line += chars[next_random(random) % chars.size()];
+		lines->push_back(line);
+	}
+
+	return {"text_ui", [atlas, lines, size, &renderer](int frame) {
+		const int columns = 3, rows = 2;
+		const int panel_w = size.x/columns, panel_h = size.y/rows;
+		renderer.set_blend_mode(SDL_BLENDMODE_BLEND);
+		for (int panel = 0; panel < columns*rows; panel++) {
+			const int x = (panel % columns)*panel_w, y = (panel/columns)*panel_h;
+			renderer.draw_rect(Rect(x + 4, y + 4, panel_w - 8, panel_h - 8), {30, 30, 40, 200});
+			renderer.draw_rect(Rect(x + 4, y + 4, panel_w - 8, panel_h - 8), {120, 120, 160, 255}, 1);
+			for (int line = 0; (line + 2)*14 < panel_h; line++) {
+				const string &text = (*lines)[(panel*7 + line + frame) % lines->size()];
+				atlas->draw_text(text, {x + 10, y + 10 + line*14}, (line % 4 == 0)? YELLOW : WHITE);
+			}
+		}
+	}};
+}
+#endif /* TTF_ENABLED */
+
+static Scene create_tilemap_scene(Renderer &renderer, const IVector &size) {
+	// A scrolling 512x512 map of 16 px tiles with a static ground layer
+	// and a sparse dynamic layer on top
+	struct State {
+		SpriteSheet sheet;
+		TileMap map;
+		Camera2D camera;
+
+		State(Renderer &renderer, const IVector &size):
+			sheet(create_sheet(renderer, 8, 8, 16), 8, 8), map(renderer, sheet, {512, 512}, 2),
+			camera(Rect(0, 0, size.x, size.y)) {}
+	};
+
+	auto state = std::make_shared<State>(renderer, size);
+	uint32_t random = 4;
+	for (int y = 0; y < 512; y++) {
+		for (int x = 0; x < 512; x++) {
+			state->map.set_tile(0, {x, y}, next_random(random) % 32);
+			if (next_random(random) % 10 == 0)
+				state->map.set_tile(1, {x, y}, 32 + next_random(random) % 32);
+		}
+	}
+	state->map.set_layer_static(1, false);
+
+	return {"tilemap_scroll", [state, size](int frame) {
+		// Diagonal scrolling which keeps entering new chunks, windows as wide
+		// as the map don't scroll horizontally past it
+		const float distance = (frame*3) % std::max(512*16 - size.x, 1);
+		state->camera.set_position({size.x*0.5f + distance, size.y*0.5f + distance*0.5f});
+		state->map.render(state->camera);
+	}};
+}
+
+static std::vector<string> get_scene_names() {
+	std::vector<string> names = {"sprites_100k", "circles_10k"};
+#ifdef TTF_ENABLED
+	names.push_back("text_ui");
+#endif /* TTF_ENABLED */
+	names.push_back("tilemap_scroll");
+	return names;
+}
+
+static Scene create_scene(const string &name, Renderer &renderer, const IVector &size) {
+	if (name == "sprites_100k")
+		return create_sprites_scene(renderer, size);
+	if (name == "circles_10k")
+		return create_circles_scene(renderer, size);
+#ifdef TTF_ENABLED
+	if (name == "text_ui")
+		return create_text_scene(renderer, size);
+#endif /* TTF_ENABLED */
+	return create_tilemap_scene(renderer, size);
+}
+
+static SceneResult run_scene(Scene &scene, Renderer &renderer, const Options &options) {
+	// Every frame is cleared, drawn and presented, the renderer is flushed
+	// so that the time includes the rasterisation
+	SceneResult result = {scene.name, options.frames, 0, {}, {}};
+	result.times.reserve(options.frames);
+	for (int frame = 0; frame < options.warmup + options.frames; frame++) {
+		const auto start = std::chrono::steady_clock::now();
+		renderer.clear({16, 16, 24, 255});
+		scene.draw(frame);
+		renderer.present();
+		renderer.flush();
+		const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (frame >= options.warmup) {
+			result.times.push_back(time);
+			result.total_ms += time;
+		}
+	}
+	result.stats = renderer.get_stats();
+	std::sort(result.times.begin(), result.times.end());
+
+	return result;
+}
+
+static void write_results(FILE *file, const Options &options, Renderer &renderer, const std::vector<SceneResult> &results) {
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"renderer\": \"%s\",\n", renderer.get_driver_name().c_str());
+	fprintf(file, "\t\"headless\": %s,\n", options.headless? "true" : "false");
+	fprintf(file, "\t\"width\": %d,\n\t\"height\": %d,\n", options.size.x, options.size.y);
+	fprintf(file, "\t\"frames\": %d,\n\t\"warmup\": %d,\n", options.frames, options.warmup);
+	fprintf(file, "\t\"scenes\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const SceneResult &result = results[i];
+		const RenderStats &stats = result.stats;
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"name\": \"%s\",\n", result.name.c_str());
+		fprintf(file, "\t\t\t\"fps\": %.2f,\n", (result.total_ms > 0)? result.frames*1000/result.total_ms : 0.0);
+		fprintf(file, "\t\t\t\"mean_ms\": %.3f,\n", result.total_ms/std::max(result.frames, 1));
+		fprintf(file, "\t\t\t\"min_ms\": %.3f,\n", result.times.empty()? 0.0 : result.times.front());
+		fprintf(file, "\t\t\t\"p50_ms\": %.3f,\n", get_percentile(result.times, 50));
+		fprintf(file, "\t\t\t\"p90_ms\": %.3f,\n", get_percentile(result.times, 90));
+		fprintf(file, "\t\t\t\"p95_ms\": %.3f,\n", get_percentile(result.times, 95));
+		fprintf(file, "\t\t\t\"p99_ms\": %.3f,\n", get_percentile(result.times, 99));
+		fprintf(file, "\t\t\t\"max_ms\": %.3f,\n", result.times.empty()? 0.0 : result.times.back());
+		fprintf(file, "\t\t\t\"draw_calls\": %d,\n", stats.draw_calls);
+		fprintf(file, "\t\t\t\"vertices\": %d,\n", stats.vertices);
+		fprintf(file, "\t\t\t\"batches\": %d,\n", stats.batches);
+		fprintf(file, "\t\t\t\"state_changes\": %d\n", stats.state_changes);
+		fprintf(file, "\t\t}%s\n", (i + 1 < results.size())? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+}
+
+
+
+int main(int argc, char *argv[]) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		const string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--frames" && has_value)
+			options.frames = std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "--warmup" && has_value)
+			options.warmup = std::max(std::atoi(argv[++i]), 0);
+		else if (arg == "--size" && has_value) {
+			if (sscanf(argv[++i], "%dx%d", &options.size.x, &options.size.y) != 2 || options.size.x <= 0 || options.size.y <= 0) {
+				print_usage();
+				return 1;
+			}
+		} else if (arg == "--scene" && has_value)
+			options.scenes.push_back(argv[++i]);
+		else if (arg == "--window")
+			options.headless = false;
+		else if (arg == "--driver" && has_value)
+			options.driver = argv[++i];
+		else if (arg == "--output" && has_value)
+			options.output = argv[++i];
+		else if (arg == "--list") {
+			for (const string &name: get_scene_names())
+				printf("%s\n", name.c_str());
+			return 0;
+		} else {
+			print_usage();
+			return (arg == "-h" || arg == "--help")? 0 : 1;
+		}
+	}
+
+	const std::vector<string> names = get_scene_names();
+	if (options.scenes.empty())
+		options.scenes = names;
+	for (const string &scene: options.scenes) {
+		if (std::find(names.begin(), names.end(), scene) == names.end()) {
+			fprintf(stderr, "Unknown scene: %s\n", scene.c_str());
+			return 1;
+		}
+	}
+
+	// Only the errors are logged so that they don't mix with the results
+	set_log_level(WARN);
+	Engine engine(SDL_INIT_VIDEO|SDL_INIT_EVENTS, options.headless);
+	std::unique_ptr<Surface> surface;
+	std::unique_ptr<Window> window;
+	std::unique_ptr<Renderer> renderer;
+	if (options.headless) {
+		surface = std::make_unique<Surface>(options.size);
+		renderer = std::make_unique<Renderer>(*surface);
+	} else {
+		window = std::make_unique<Window>("supernova_bench_render", options.size);
+		renderer = std::make_unique<Renderer>(*window, options.driver);
+	}
+	if (renderer->renderer == nullptr)
+		return 1;
+
+	std::vector<SceneResult> results;
+	for (const string &name: options.scenes) {
+		Scene scene = create_scene(name, *renderer, options.size);
+		results.push_back(run_scene(scene, *renderer, options));
+		fprintf(stderr, "%s: %.2f ms/frame\n", name.c_str(), results.back().total_ms/options.frames);
+	}
+
+	FILE *file = options.output.empty()? stdout : fopen(options.output.c_str(), "w");
+	if (file == nullptr) {
+		fprintf(stderr, "Failed to open %s\n", options.output.c_str());
+		return 1;
+	}
+	write_results(file, options, *renderer, results);
+	if (file != stdout)
+		fclose(file);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+// Turns a binary log back into text
+// Usage: supernova_logdecode [-l level] [-c categories] [-s seconds] [-e seconds] <file>
+// Every message is printed like the text sinks print it
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "binary_log.h"
+
+
+
+static void print_usage() {
+	fprintf(stderr,
+		"Usage: supernova_logdecode [-l level] [-c categories] [-s seconds] [-e seconds] <file>\n"
+		"  -l level       Only print messages up to the level: error, warn or info\n"
+		"  -c categories  Only print the categories in the comma separated list,\n"
+		"                 e.g. net,io\n"
+		"  -s seconds     Only print messages logged at or after the time\n"
+		"  -e seconds     Only print messages logged before the time\n"
+	);
+}
+
+static bool equals_ignore_case(std::string_view text1, std::string_view text2) {
+	if (text1.size() != text2.size())
+		return false;
+
+	for (size_t i = 0; i < text1.size(); i++) {
+		if (std::tolower(static_cast<unsigned char>(text1[i])) != std::tolower(static_cast<unsigned char>(text2[i])))
+			return false;
+	}
+
+	return true;
+}
+
+static bool parse_level(std::string_view name, int &level) {
+	for (const LOGLEVEL value: {ERROR, WARN, INFO}) {
+		if (equals_ignore_case(name, get_log_level_name(value))) {
+			level = value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool parse_categories(std::string_view list, bool *categories) {
+	std::string_view name;
+	Tokenizer tokenizer(list, ',');
+	while (tokenizer.next(name)) {
+		bool found = false;
+		for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+			if (equals_ignore_case(name, get_log_category_name(static_cast<LOGCATEGORY>(i)))) {
+				categories[i] = found = true;
+				break;
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "Unknown category %.*s\n", static_cast<int>(name.size()), name.data());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	int level = INFO;
+	bool categories[LOG_CATEGORY_COUNT] = {};
+	bool filter_categories = false;
+	uint64_t start = 0;
+	uint64_t end = UINT64_MAX;
+	string file;
+
+	for (int i = 1; i < argc; i++) {
+		const string arg = argv[i];
+		if (arg == "-l" && i + 1 < argc) {
+			if (!parse_level(argv[++i], level)) {
+				fprintf(stderr, "Unknown level %s\n", argv[i]);
+				return 1;
+			}
+		} else if (arg == "-c" && i + 1 < argc) {
+			if (!parse_categories(argv[++i], categories))
+				return 1;
+			filter_categories = true;
+		} else if (arg == "-s" && i + 1 < argc)
+			start = std::strtod(argv[++i], nullptr)*1e9;
+		else if (arg == "-e" && i + 1 < argc)
+			end = std::strtod(argv[++i], nullptr)*1e9;
+		else if (arg == "-h" || arg == "--help") {
+			print_usage();
+			return 0;
+		} else
+			file = arg;
+	}
+
+	if (file.empty()) {
+		print_usage();
+		return 1;
+	}
+
+	BinaryLogReader reader(file);
+	if (!reader.is_loaded())
+		return 1;
+
+	BinaryLogMessage message;
+	string text;
+	while (reader.next(message)) {
+		if (message.level > level || message.time < start || message.time >= end)
+			continue;
+		if (filter_categories && (message.category >= LOG_CATEGORY_COUNT || !categories[message.category]))
+			continue;
+
+		if (!format_binary_log_message(message, text))
+			text = "<undecodable message with format \"" + string(message.format) + "\">";
+
+		if (message.category == LOG_APP)
+			printf("[%.3f] %s: %s\n", message.time/1e9, get_log_level_name(message.level), text.c_str());
+		else
+			printf("[%.3f] %s %s: %s\n", message.time/1e9, get_log_level_name(message.level), get_log_category_name(message.category), text.c_str());
+	}
+
+	return 0;
+}
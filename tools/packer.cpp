@@ -0,0 +1,83 @@
+// Packs directories into a single asset pack
+// Usage: supernova_packer [-c] [-a alignment] <output> <directory>...
+// Entries are named by their path relative to the directory they were
+// found in, using '/' as the separator
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "asset_pack.h"
+
+
+namespace fs = std::filesystem;
+
+
+
+static void print_usage() {
+	fprintf(stderr,
+		"Usage: supernova_packer [-c] [-a alignment] <output> <directory>...\n"
+		"  -c            Compress the entries which get smaller\n"
+		"  -a alignment  Align the entry data, a power of two (default: 16)\n"
+	);
+}
+
+int main(int argc, char *argv[]) {
+	bool compress = false;
+	uint32_t alignment = 16;
+	std::vector<string> paths;
+
+	for (int i = 1; i < argc; i++) {
+		const string arg = argv[i];
+		if (arg == "-c")
+			compress = true;
+		else if (arg == "-a" && i + 1 < argc)
+			alignment = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-h" || arg == "--help") {
+			print_usage();
+			return 0;
+		} else
+			paths.push_back(arg);
+	}
+
+	if (paths.size() < 2) {
+		print_usage();
+		return 1;
+	}
+
+	AssetPackWriter writer;
+	size_t count = 0;
+	for (size_t i = 1; i < paths.size(); i++) {
+		const fs::path root = paths[i];
+		std::error_code error;
+		std::vector<fs::path> files;
+		for (const auto &entry: fs::recursive_directory_iterator(root, error)) {
+			if (entry.is_regular_file())
+				files.push_back(entry.path());
+		}
+		if (error) {
+			fprintf(stderr, "Failed to read directory %s: %s\n", root.string().c_str(), error.message().c_str());
+			return 1;
+		}
+
+		// Sorted so that the same directory always produces the same pack
+		std::sort(files.begin(), files.end());
+		for (const fs::path &file: files) {
+			const string name = fs::relative(file, root).generic_string();
+			if (!writer.add_file(file.string(), name, compress)) {
+				fprintf(stderr, "Failed to read %s\n", file.string().c_str());
+				return 1;
+			}
+			count++;
+		}
+	}
+
+	if (!writer.save(paths[0], alignment))
+		return 1;
+
+	printf("Packed %zu files into %s\n", count, paths[0].c_str());
+	return 0;
+}